@@ -3,6 +3,7 @@ import { Graphics } from "../../native";
 import { Clock, Load, IpAddress, Message, Title, Weather, Workspace, CurrentMode } from "./modules";
 import { EventEmitter } from "events";
 import { default as hexRgb } from "hex-rgb";
+import { createRecorder } from "./recorder";
 
 export interface BarModuleConfig
 {
@@ -21,6 +22,8 @@ interface BarConfig
     modules: {[key: string]: { position: Bar.Position, config?: BarModuleConfig }};
     font?: string;
     height?: number;
+    // paint on the render thread instead of the main thread
+    threaded?: boolean;
 }
 
 interface Module
@@ -65,6 +68,7 @@ export class Bar
     private _font: string;
     private _owm: OWMLib;
     private _ctx: Graphics.Context;
+    private _renderer: Graphics.Renderer | undefined;
     private _copyArgs: { src_d: number, dst_d: number, gc: number, width: number, height: number };
     private _modules: Map<Bar.Position, Module[]>;
     private _availableModules: {[key: string]: BarModuleConstructor };
@@ -214,6 +218,19 @@ export class Bar
             height: this._height
         };
 
+        if (config.threaded) {
+            // frames land in the pixmap, exposing copies them to the window like before
+            this._renderer = owm.engine.createRenderer(owm.wm, {
+                width: this._width,
+                height: this._height,
+                drawable: this._pixmap,
+                gc: this._gc,
+                callback: () => {
+                    xcb.send_expose(owm.wm, { window: this._win, width: this._width, height: this._height });
+                }
+            });
+        }
+
         // initialize modules
         const fullGeom = new Geometry({ x: 0, y: 0, width: this._width, height: this._height });
 
@@ -270,6 +287,8 @@ export class Bar
             return;
 
         this._redraw();
+        if (this._renderer)
+            return;
         const owm = this._owm;
         owm.xcb.send_expose(owm.wm, { window: this._win, width: this._width, height: this._height });
     }
@@ -375,7 +394,8 @@ export class Bar
     }
 
     private _redraw() {
-        const engine = this._owm.engine;
+        const ops: Graphics.DrawOp[] = [];
+        const engine = this._renderer ? createRecorder(this._owm.engine, ops) : this._owm.engine;
 
         const { red, green, blue } = makeColor(this._config.backgroundColor);
         engine.setSourceRGB(this._ctx, red, green, blue);
@@ -391,6 +411,10 @@ export class Bar
                 engine.restore(this._ctx);
             }
         }
+
+        if (this._renderer) {
+            this._owm.engine.renderSubmit(this._renderer, ops);
+        }
     }
 }
 
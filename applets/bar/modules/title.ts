@@ -7,6 +7,8 @@ interface TitleConfig extends BarModuleConfig
 {
     textColor?: string;
     font?: string;
+    icon?: boolean;
+    iconSize?: number;
 }
 
 export class Title extends EventEmitter implements BarModule
@@ -18,6 +20,11 @@ export class Title extends EventEmitter implements BarModule
     private _titleGeometry: { width: number, height: number };
     private _monitor: Monitor;
     private _client: Client | undefined;
+    private _icon: Graphics.Surface | undefined;
+    private _iconSize: number;
+    private _owm: OWMLib;
+
+    private static readonly IconPad = 4;
 
     constructor(owm: OWMLib, bar: Bar, config: BarModuleConfig) {
         super();
@@ -25,6 +32,8 @@ export class Title extends EventEmitter implements BarModule
         const titleConfig = config as TitleConfig;
 
         this._config = titleConfig;
+        this._owm = owm;
+        this._iconSize = titleConfig.iconSize || 14;
         this._color = Bar.makeColor(titleConfig.textColor || "#fff");
         this._monitor = bar.monitor;
 
@@ -58,16 +67,32 @@ export class Title extends EventEmitter implements BarModule
                 _updateClient();
             }
         });
+        if (titleConfig.icon) {
+            owm.events.on("clientIconUpdated", client => {
+                if (this._client === client) {
+                    _updateClient();
+                }
+            });
+        }
     }
 
     paint(engine: Graphics.Engine, ctx: Graphics.Context, geometry: Geometry) {
+        if (this._icon) {
+            const size = this._iconSize;
+            const y = Math.max(0, (this._titleGeometry.height - size) / 2);
+            engine.setSourceSurface(ctx, this._icon, 0, y);
+            engine.pathRectangle(ctx, 0, y, size, size);
+            engine.fill(ctx);
+            engine.translate(ctx, size + Title.IconPad, 0);
+        }
         const { red, green, blue } = this._color;
         engine.setSourceRGB(ctx, red, green, blue);
         engine.drawText(ctx, this._title);
     }
 
     geometry(geometry: Geometry) {
-        return new Geometry({ x: 0, y: 0, width: this._titleGeometry.width, height: this._titleGeometry.height });
+        const iconWidth = this._icon ? this._iconSize + Title.IconPad : 0;
+        return new Geometry({ x: 0, y: 0, width: this._titleGeometry.width + iconWidth, height: this._titleGeometry.height });
     }
 
     private _updateFocus(engine: Graphics.Engine, client: Client | undefined) {
@@ -76,6 +101,10 @@ export class Title extends EventEmitter implements BarModule
         } else {
             engine.textSetText(this._title, "<no title>");
         }
+        if (this._config.icon) {
+            // the native side keeps the scaled icon around until the property changes
+            this._icon = client ? engine.createSurfaceFromWindowIcon(this._owm.wm, { window: client.window.window, size: this._iconSize }) : undefined;
+        }
         this._titleGeometry = engine.textMetrics(this._title);
     }
 }
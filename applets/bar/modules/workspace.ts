@@ -1,5 +1,5 @@
 import { Graphics } from "../../../native";
-import { OWMLib, Geometry, Monitor } from "../../../lib";
+import { OWMLib, Geometry, Monitor, Client, Container, Logger, Workspace as OWMWorkspace } from "../../../lib";
 import { Bar, BarModule, BarModuleConfig } from "..";
 import { EventEmitter } from "events";
 
@@ -13,6 +13,19 @@ interface WorkspaceConfig extends BarModuleConfig
     activeTextColor?: string;
     nameMapping?: {[key: string]: string};
     font?: string;
+    thumbnails?: boolean;
+    thumbnailWidth?: number;
+    thumbnailInterval?: number;
+}
+
+// server side preview of one workspace, rescaled only when its windows are damaged
+interface Thumbnail
+{
+    thumbnail: Graphics.Thumbnail;
+    surface: Graphics.Surface;
+    windows: string;
+    lastUpdate: number;
+    timer: NodeJS.Timeout | undefined;
 }
 
 export class Workspace extends EventEmitter implements BarModule
@@ -28,6 +41,11 @@ export class Workspace extends EventEmitter implements BarModule
     private _text: Graphics.Text;
     private _border: number;
     private _monitor: Monitor;
+    private _owm: OWMLib;
+    private _log: Logger;
+    private _thumbnails: Map<OWMWorkspace, Thumbnail> | undefined;
+    private _thumbnailWidth: number;
+    private _thumbnailInterval: number;
 
     private static readonly Pad = 4;
     private static readonly SizePerWorkspace = 18;
@@ -39,6 +57,8 @@ export class Workspace extends EventEmitter implements BarModule
 
         this._monitor = bar.monitor;
         this._config = wsConfig;
+        this._owm = owm;
+        this._log = owm.logger.prefixed("Bar.Workspace");
         this._borderColor = Bar.makeColor(wsConfig.borderColor || "#099");
         this._inactiveBackgroundColor = Bar.makeColor(wsConfig.inactiveBackgroundColor || "#888");
         this._activeBackgroundColor = Bar.makeColor(wsConfig.activeBackgroundColor || "#600");
@@ -46,11 +66,33 @@ export class Workspace extends EventEmitter implements BarModule
         this._activeTextColor = Bar.makeColor(wsConfig.activeTextColor || "#fff");
         this._border = wsConfig.border || 2;
 
+        const screen = this._monitor.screen;
+        this._thumbnailWidth = wsConfig.thumbnailWidth
+            || Math.round(Workspace.SizePerWorkspace * (screen.width / screen.height));
+        this._thumbnailInterval = wsConfig.thumbnailInterval || 500;
+        if (wsConfig.thumbnails) {
+            this._thumbnails = new Map<OWMWorkspace, Thumbnail>();
+        }
+
         owm.events.on("workspaceActivated", (monitor: Monitor) => {
             if (monitor === this._monitor) {
+                if (this._thumbnails && this._monitor.workspace) {
+                    this._scheduleThumbnail(this._monitor.workspace);
+                }
                 this.emit("updated");
             }
         });
+        if (this._thumbnails) {
+            const clientChanged = (client: Client) => {
+                const ws = client.workspace;
+                if (ws && ws.monitor === this._monitor) {
+                    this._scheduleThumbnail(ws);
+                }
+            };
+            owm.events.on("client", clientChanged);
+            owm.events.on("clientRemoved", clientChanged);
+            owm.events.on("clientFocusIn", clientChanged);
+        }
         owm.events.on("workspaceAdded", (monitor: Monitor) => {
             if (monitor === this._monitor) {
                 this.emit("geometryChanged", this);
@@ -58,6 +100,7 @@ export class Workspace extends EventEmitter implements BarModule
         });
         owm.events.on("workspaceRemoved", (monitor: Monitor) => {
             if (monitor === this._monitor) {
+                this._pruneThumbnails();
                 this.emit("geometryChanged", this);
             }
         });
@@ -75,6 +118,11 @@ export class Workspace extends EventEmitter implements BarModule
     }
 
     paint(engine: Graphics.Engine, ctx: Graphics.Context, geometry: Geometry) {
+        if (this._thumbnails) {
+            this._paintThumbnails(engine, ctx);
+            return;
+        }
+
         const wss = this._monitor.workspaces;
         let x = 0;
         for (const ws of wss.workspaces) {
@@ -119,10 +167,140 @@ export class Workspace extends EventEmitter implements BarModule
     }
 
     geometry(geometry: Geometry) {
-        const width = (Workspace.SizePerWorkspace + Workspace.Pad) * this._monitor.workspaces.size;
+        const cell = this._thumbnails ? this._thumbnailWidth : Workspace.SizePerWorkspace;
+        const width = (cell + Workspace.Pad) * this._monitor.workspaces.size;
         return new Geometry({ x: 0, y: 0, width: width, height: 18 });
     }
 
+    private _paintThumbnails(engine: Graphics.Engine, ctx: Graphics.Context) {
+        const wss = this._monitor.workspaces;
+        const width = this._thumbnailWidth;
+        const height = Workspace.SizePerWorkspace;
+        let x = 0;
+        for (const ws of wss.workspaces) {
+            const active = ws === this._monitor.workspace;
+            const thumb = this._thumbnail(ws);
+
+            engine.save(ctx);
+            engine.translate(ctx, x, 0);
+            if (thumb) {
+                // the scaling already happened server side, this is a plain copy
+                engine.setSourceSurface(ctx, thumb.surface);
+            } else {
+                const { red, green, blue } = active ? this._activeBackgroundColor : this._inactiveBackgroundColor;
+                engine.setSourceRGB(ctx, red, green, blue);
+            }
+            engine.pathRectangle(ctx, 0, 0, width, height);
+            engine.fill(ctx);
+
+            if (active) {
+                const { red: bred, green: bgreen, blue: bblue } = this._borderColor;
+                engine.setSourceRGB(ctx, bred, bgreen, bblue);
+                engine.pathRectangle(ctx, this._border / 2, this._border / 2, width - this._border, height - this._border);
+                engine.stroke(ctx, { lineWidth: this._border });
+            }
+
+            const { red: tr, green: tg, blue: tb, alpha: ta } = active ? this._activeTextColor : this._inactiveTextColor;
+            engine.setSourceRGBA(ctx, tr, tg, tb, ta);
+            engine.textSetText(this._text, this._mapName(`${ws.id}`));
+            const m = engine.textMetrics(this._text);
+            engine.translate(ctx, (width / 2) - (m.width / 2), 1);
+            engine.drawText(ctx, this._text);
+            engine.restore(ctx);
+
+            x += width + Workspace.Pad;
+        }
+    }
+
+    private _thumbnail(ws: OWMWorkspace) {
+        if (!this._thumbnails)
+            return undefined;
+        let thumb = this._thumbnails.get(ws);
+        if (thumb)
+            return thumb;
+
+        const { red, green, blue } = this._inactiveBackgroundColor;
+        const background = (Math.round(red * 255) << 16) | (Math.round(green * 255) << 8) | Math.round(blue * 255);
+        try {
+            const thumbnail = this._owm.engine.createThumbnail(this._owm.wm, {
+                width: this._thumbnailWidth,
+                height: Workspace.SizePerWorkspace,
+                background: background,
+                callback: () => { this._scheduleThumbnail(ws); }
+            });
+            thumb = {
+                thumbnail: thumbnail,
+                surface: this._owm.engine.thumbnailSurface(thumbnail),
+                windows: "",
+                lastUpdate: 0,
+                timer: undefined
+            };
+        } catch (err) {
+            // no composite/damage/render, fall back to the plain squares
+            this._log.error("unable to create workspace thumbnails", err.message);
+            this._thumbnails = undefined;
+            this.emit("geometryChanged", this);
+            return undefined;
+        }
+        this._thumbnails.set(ws, thumb);
+        this._scheduleThumbnail(ws);
+        return thumb;
+    }
+
+    private _scheduleThumbnail(ws: OWMWorkspace) {
+        const thumb = this._thumbnails && this._thumbnails.get(ws);
+        if (!thumb || thumb.timer)
+            return;
+        // at most one rescale per workspace per interval, however busy its windows are
+        const delay = Math.max(0, thumb.lastUpdate + this._thumbnailInterval - Date.now());
+        thumb.timer = setTimeout(() => {
+            thumb.timer = undefined;
+            thumb.lastUpdate = Date.now();
+            this._updateThumbnail(ws, thumb);
+        }, delay);
+    }
+
+    private _updateThumbnail(ws: OWMWorkspace, thumb: Thumbnail) {
+        const engine = this._owm.engine;
+        const windows = Workspace._collectWindows(ws.container, []);
+        const key = windows.map(w => `${w.window}:${w.x},${w.y},${w.width}x${w.height}`).join(" ");
+        if (key !== thumb.windows) {
+            engine.thumbnailSetWindows(thumb.thumbnail, windows, this._monitor.screen);
+            thumb.windows = key;
+        }
+        if (engine.thumbnailUpdate(thumb.thumbnail)) {
+            this.emit("updated");
+        }
+    }
+
+    private _pruneThumbnails() {
+        if (!this._thumbnails)
+            return;
+        const current = new Set<OWMWorkspace>(this._monitor.workspaces.workspaces);
+        for (const [ws, thumb] of this._thumbnails) {
+            if (!current.has(ws)) {
+                if (thumb.timer) {
+                    clearTimeout(thumb.timer);
+                }
+                this._owm.engine.destroyThumbnail(thumb.thumbnail);
+                this._thumbnails.delete(ws);
+            }
+        }
+    }
+
+    private static _collectWindows(container: Container, windows: Graphics.ThumbnailWindow[]) {
+        // bottom to top, like the stacking order
+        for (const item of container.stackItems) {
+            if (item instanceof Container) {
+                Workspace._collectWindows(item, windows);
+            } else if (item instanceof Client && item.visible) {
+                const geom = item.frameGeometry;
+                windows.push({ window: item.frame, x: geom.x, y: geom.y, width: geom.width, height: geom.height });
+            }
+        }
+        return windows;
+    }
+
     private _updateSurfaces(owm: OWMLib) {
         const engine = owm.engine;
         const border = this._border;
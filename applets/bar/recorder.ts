@@ -0,0 +1,66 @@
+import { Graphics } from "../../native";
+
+// An engine for modules to paint with when the bar renders on the render
+// thread. Drawing calls are recorded as a drawing list instead of hitting
+// the context, everything else (text objects, metrics, surfaces) goes to
+// the real engine.
+export function createRecorder(engine: Graphics.Engine, ops: Graphics.DrawOp[]): Graphics.Engine {
+    const recorder = Object.create(engine) as Graphics.Engine;
+
+    const unsupported = (name: string) => {
+        return () => { throw new Error(`${name} is not supported by the threaded bar`); };
+    };
+
+    recorder.save = () => { ops.push(["save"]); };
+    recorder.restore = () => { ops.push(["restore"]); };
+    recorder.translate = (ctx: Graphics.Context, tx: number, ty: number) => { ops.push(["translate", tx, ty]); };
+    recorder.scale = (ctx: Graphics.Context, sx: number, sy: number) => { ops.push(["scale", sx, sy]); };
+    recorder.setSourceRGB = (ctx: Graphics.Context, r: number, g: number, b: number) => {
+        ops.push(["setSourceRGB", r, g, b]);
+    };
+    recorder.setSourceRGBA = (ctx: Graphics.Context, r: number, g: number, b: number, a: number) => {
+        ops.push(["setSourceRGBA", r, g, b, a]);
+    };
+    recorder.setSourceSurface = (ctx: Graphics.Context, surface: Graphics.Surface, x?: number, y?: number) => {
+        ops.push(["setSourceSurface", surface, x || 0, y || 0]);
+    };
+    recorder.pathRectangle = (ctx: Graphics.Context, x: number, y: number, width: number, height: number) => {
+        ops.push(["pathRectangle", x, y, width, height]);
+    };
+    recorder.pathMoveTo = (ctx: Graphics.Context, x: number, y: number) => { ops.push(["pathMoveTo", x, y]); };
+    recorder.pathLineTo = (ctx: Graphics.Context, x: number, y: number) => { ops.push(["pathLineTo", x, y]); };
+    recorder.pathArc = (ctx: Graphics.Context, xc: number, yc: number, radius: number, angle1: number, angle2: number) => {
+        ops.push(["pathArc", xc, yc, radius, angle1, angle2]);
+    };
+    recorder.pathClose = () => { ops.push(["pathClose"]); };
+    recorder.fill = (ctx: Graphics.Context, path?: Graphics.Context) => {
+        if (path)
+            throw new Error("fill with a path is not supported by the threaded bar");
+        ops.push(["fill"]);
+    };
+    recorder.stroke = (ctx: Graphics.Context, args?: Graphics.StrokePathArgs) => {
+        if (args && args.path)
+            throw new Error("stroke with a path is not supported by the threaded bar");
+        ops.push(["stroke", args && args.lineWidth !== undefined ? args.lineWidth : 0]);
+    };
+    recorder.clip = (ctx: Graphics.Context, path?: Graphics.Context) => {
+        if (path)
+            throw new Error("clip with a path is not supported by the threaded bar");
+        ops.push(["clip"]);
+    };
+    recorder.paint = () => { ops.push(["paint"]); };
+    recorder.drawText = (ctx: Graphics.Context, txt: Graphics.Text) => {
+        // the list is read when it's submitted, modules reuse their text objects
+        ops.push(["drawText", engine.textCopy(txt)]);
+    };
+
+    recorder.rotate = unsupported("rotate");
+    recorder.transform = unsupported("transform");
+    recorder.setMatrix = unsupported("setMatrix");
+    recorder.identityMatrix = unsupported("identityMatrix");
+    recorder.appendPath = unsupported("appendPath");
+    recorder.pathCurveTo = unsupported("pathCurveTo");
+    recorder.pathArgNegative = unsupported("pathArgNegative");
+
+    return recorder;
+}
@@ -20,6 +20,8 @@ function stringOption(key: string): string | undefined
 const knownCommands = [
     "exit",
     "nudge",
+    "stats",
+    "check-tree",
     "message"
 ];
 
@@ -68,7 +68,7 @@ function init(owmlib) {
     owmlib.bindings.add(`${mod}+Ctrl+${i}`, () => {
       const ws = owmlib.monitors.workspaceById(i);
       if (ws) ws.activate();
-    });
+    }, false); // holding the key doesn't switch again
     // move to workspace
     owmlib.bindings.add(`${mod}+Shift+${i}`, () => {
       const ws = owmlib.monitors.workspaceById(i);
@@ -119,7 +119,7 @@ function init(owmlib) {
         container.layoutPolicy.config.setColumRatio(0, ratio.r);
       }
     }
-  });
+  }, 100); // a step per 100ms while held
   resizeMode.add("Right", () => {
     const container = owmlib.findContainerUnderCursor();
     if (container) {
@@ -134,7 +134,7 @@ function init(owmlib) {
         container.layoutPolicy.config.setColumRatio(0, ratio.r);
       }
     }
-  });
+  }, 100); // a step per 100ms while held
   owmlib.bindings.addMode(`${mod}+Z`, resizeMode);
 
   owmlib.activeColor = "#33c";
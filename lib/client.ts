@@ -6,7 +6,7 @@ import { Monitor } from "./monitor";
 import { Container } from "./container";
 import { Geometry, Strut } from "./utils";
 import { endianness } from "os";
-import { XCB, OWM } from "native";
+import { XCB, OWM, Layout } from "native";
 
 interface ConfigureArgs {
     x?: number;
@@ -17,6 +17,9 @@ interface ConfigureArgs {
     stack_mode?: number;
 }
 
+// scratch space for _syncConfigurePolicy, setPolicy copies it
+let configureHints: Int32Array | undefined;
+
 type MutableWindow = {
     -readonly [K in keyof XCB.Window]: XCB.Window[K];
 }
@@ -112,15 +115,6 @@ export class Client implements ContainerItem
 
         this._state = this._explicitState = Client.State.Withdrawn;
 
-        const borderData = new Uint32Array(4);
-        borderData[0] = border;
-        borderData[1] = border;
-        borderData[2] = border;
-        borderData[3] = border;
-        owm.xcb.change_property(owm.wm, { window: window.window, mode: owm.xcb.propMode.REPLACE,
-                                          property: owm.xcb.atom._NET_FRAME_EXTENTS, type: owm.xcb.atom.CARDINAL,
-                                          format: 32, data: borderData });
-
         owm.ewmh.updateAllowed(this);
 
         const inactive = owm.inactiveColor;
@@ -128,6 +122,8 @@ export class Client implements ContainerItem
             throw new Error("inactive is string, can't happen");
         }
         this._pixel = inactive;
+
+        this._syncConfigurePolicy();
     }
 
     get root() {
@@ -231,6 +227,7 @@ export class Client implements ContainerItem
 
 
         this._border = value;
+        this._syncConfigurePolicy();
         this._owm.relayout();
     }
 
@@ -307,6 +304,7 @@ export class Client implements ContainerItem
             this.workspace = this._monitor.workspace;
         }
 
+        this._syncConfigurePolicy();
         this._owm.ewmh.updateAllowed(this);
     }
 
@@ -321,6 +319,7 @@ export class Client implements ContainerItem
         if (this._container) {
             this._container.reinsert(this);
         }
+        this._owm.ipc.invalidate();
     }
 
     get fullscreen() {
@@ -360,6 +359,7 @@ export class Client implements ContainerItem
                 }
             }
         }
+        this._owm.ipc.invalidate();
     }
 
     get floating() {
@@ -371,6 +371,7 @@ export class Client implements ContainerItem
         if (this._floating === f)
             return;
         this._floating = f;
+        this._syncConfigurePolicy();
         this._owm.relayout();
         const ws = this.workspace;
         if (ws) {
@@ -576,6 +577,56 @@ export class Client implements ContainerItem
         this._owm.resizeByKeyboard(this);
     }
 
+    // Fill in this client's entry for the native layout kernel, see
+    // TilingLayoutPolicy.layout. Mirrors what _enforceSize looks at.
+    packLayoutHints(hints: Int32Array, offset: number) {
+        const layout = this._owm.layout;
+        const hint = layout.hint;
+        const normal = this._window.normalHints;
+
+        let flags = 0;
+        if (!this._floating)
+            flags |= layout.itemFlag.Tiled;
+        if (this.dock)
+            flags |= layout.itemFlag.Dock;
+
+        hints[offset + hint.Border] = this._border;
+        hints[offset + hint.ItemFlags] = flags;
+        hints[offset + hint.Flags] = normal.flags;
+        hints[offset + hint.BaseWidth] = normal.base_width;
+        hints[offset + hint.BaseHeight] = normal.base_height;
+        hints[offset + hint.MinWidth] = normal.min_width;
+        hints[offset + hint.MinHeight] = normal.min_height;
+        hints[offset + hint.MaxWidth] = normal.max_width;
+        hints[offset + hint.MaxHeight] = normal.max_height;
+        hints[offset + hint.WidthInc] = normal.width_inc;
+        hints[offset + hint.HeightInc] = normal.height_inc;
+        hints[offset + hint.MinAspectNum] = normal.min_aspect_num;
+        hints[offset + hint.MinAspectDen] = normal.min_aspect_den;
+        hints[offset + hint.MaxAspectNum] = normal.max_aspect_num;
+        hints[offset + hint.MaxAspectDen] = normal.max_aspect_den;
+    }
+
+    // Take over a geometry computed by the layout kernel. This only updates
+    // our bookkeeping, the caller sends the configures for all clients in
+    // one go with layout.configure.
+    applyLayout(results: Int32Array, offset: number) {
+        const result = this._owm.layout.result;
+
+        this._frameGeometry.x = results[offset + result.FrameX];
+        this._frameGeometry.y = results[offset + result.FrameY];
+        this._frameGeometry.width = results[offset + result.FrameWidth];
+        this._frameGeometry.height = results[offset + result.FrameHeight];
+        this._geometry.x = results[offset + result.X];
+        this._geometry.y = results[offset + result.Y];
+        this._geometry.width = results[offset + result.Width];
+        this._geometry.height = results[offset + result.Height];
+
+        // layouts stay within their monitor, but the workspace itself may
+        // have moved to a different one
+        this._monitor = this._owm.monitors.monitorByContainerItem(this);
+    }
+
     configure(cfg: ConfigureArgs) {
         if (this._floating || this._ignoreWorkspace) {
             const geom = new Geometry(this._geometry);
@@ -624,7 +675,44 @@ export class Client implements ContainerItem
         }
     }
 
+    // A ConfigureRequest that was answered natively, see layout.setPolicy.
+    // The client and its frame are already where they should be, this only
+    // catches up our bookkeeping.
+    nativeConfigured(cfg: Layout.Configured) {
+        const requested = cfg.requested;
+        if (requested.x !== undefined)
+            this._requestedGeometry.x = requested.x;
+        if (requested.y !== undefined)
+            this._requestedGeometry.y = requested.y;
+        if (requested.width !== undefined)
+            this._requestedGeometry.width = requested.width;
+        if (requested.height !== undefined)
+            this._requestedGeometry.height = requested.height;
+
+        if (!this._floating && !this._ignoreWorkspace)
+            return;
+
+        this._geometry.x = cfg.x;
+        this._geometry.y = cfg.y;
+        this._geometry.width = cfg.width;
+        this._geometry.height = cfg.height;
+        this._frameGeometry.x = cfg.x - this._border;
+        this._frameGeometry.y = cfg.y - this._border;
+        this._frameGeometry.width = cfg.width + (this._border * 2);
+        this._frameGeometry.height = cfg.height + (this._border * 2);
+
+        this._updateMonitor();
+        this._owm.ipc.invalidate();
+    }
+
     updateProperty(property: number, isNew: boolean) {
+        const atom = this._owm.xcb.atom;
+        if (property === atom._NET_WM_ICON) {
+            // the icon is fetched and cached natively, it has already been invalidated
+            this._owm.events.emit("clientIconUpdated", this);
+            return;
+        }
+
         let propdata: OWM.GetProperty | undefined;
         if (isNew) {
             propdata = this._owm.xcb.get_property(this._owm.wm, { window: this._window.window, property: property });
@@ -632,7 +720,6 @@ export class Client implements ContainerItem
 
         // this._log.error("prop", this._owm.xcb.get_atom_name(this._owm.wm, property));
 
-        const atom = this._owm.xcb.atom;
         switch (property) {
         case atom.WM_HINTS:
             this._updateWmHints(propdata);
@@ -644,6 +731,7 @@ export class Client implements ContainerItem
             break;
         case atom.WM_NORMAL_HINTS:
             this._updateWmNormalHints(propdata);
+            this._syncConfigurePolicy();
             break;
         case atom.WM_CLIENT_LEADER:
             this._updateWmClientLeader(propdata);
@@ -684,7 +772,7 @@ export class Client implements ContainerItem
         this._owm.xcb.unmap_window(this._owm.wm, this._parent);
     }
 
-    focus() {
+    focus(focusedNatively?: boolean) {
         let client: Client = this;
         for (;;) {
             const clients = this._group.transientsForClient(client);
@@ -697,12 +785,17 @@ export class Client implements ContainerItem
 
         const owm = this._owm;
 
-        if (owm.focused === client) {
+        // a native click focused us, not the modal we redirect to, X has
+        // to be told again even if owm already thinks the modal has it
+        const refocus = focusedNatively === true && client !== this;
+        if (owm.focused === client && !refocus) {
             return true;
         }
 
         const takeFocus = owm.xcb.atom.WM_TAKE_FOCUS;
-        if (client.noinput && client.window.wmProtocols.includes(takeFocus)) {
+        if (focusedNatively && client === this) {
+            // a click already did it, see xcb.set_click_focus
+        } else if (client.noinput && client.window.wmProtocols.includes(takeFocus)) {
             this._log.info("sending client message");
             const data = new Uint32Array(2);
             data[0] = takeFocus;
@@ -764,63 +857,31 @@ export class Client implements ContainerItem
     private _setState(state: Client.State) {
         this._state = state;
 
+        // mapping, unmapping and WM_STATE are done natively, together with
+        // everything else that changes in the same batch
+        this._owm.queueState(this);
+    }
+
+    packState(entries: Int32Array, offset: number) {
         const xcb = this._owm.xcb;
+        const entry = xcb.clientState.entry;
 
-        // we'll change the WM_STATE property regardless of the current state
-        const buf = new Uint32Array(2);
-        switch (state) {
+        let state = xcb.icccm.state.WITHDRAWN;
+        switch (this._state) {
             case Client.State.Normal:
-                buf[0] = xcb.icccm.state.NORMAL;
+                state = xcb.icccm.state.NORMAL;
                 break;
             case Client.State.Iconic:
-                buf[0] = xcb.icccm.state.ICONIC;
-                break;
-            case Client.State.Withdrawn:
-                buf[0] = xcb.icccm.state.WITHDRAWN;
+                state = xcb.icccm.state.ICONIC;
                 break;
         }
 
-        buf[1] = xcb.none;
-        xcb.change_property(this._owm.wm,
-                            { window: this._window.window, mode: xcb.propMode.REPLACE,
-                              property: xcb.atom.WM_STATE, type: xcb.atom.WM_STATE,
-                              format: 32, data: buf });
-
-        if (this._state === Client.State.Normal && this._hidden) {
-            return;
-        }
-
-        let winMask = xcb.eventMask.STRUCTURE_NOTIFY;
-        let frameMask = 0;
-
-        if (state === Client.State.Normal) {
-            frameMask = xcb.eventMask.STRUCTURE_NOTIFY |
-                xcb.eventMask.ENTER_WINDOW |
-                xcb.eventMask.LEAVE_WINDOW |
-                xcb.eventMask.EXPOSURE |
-                xcb.eventMask.SUBSTRUCTURE_REDIRECT |
-                xcb.eventMask.POINTER_MOTION |
-                xcb.eventMask.BUTTON_PRESS |
-                xcb.eventMask.BUTTON_RELEASE;
-            winMask = xcb.eventMask.PROPERTY_CHANGE |
-                xcb.eventMask.STRUCTURE_NOTIFY |
-                xcb.eventMask.FOCUS_CHANGE;
-
-            xcb.change_window_attributes(this._owm.wm, { window: this._window.window, event_mask: winMask });
-            xcb.change_window_attributes(this._owm.wm, { window: this._parent, event_mask: frameMask });
-
-            xcb.map_window(this._owm.wm, this._window.window);
-            xcb.map_window(this._owm.wm, this._parent);
-        } else {
-            // make sure we don't get an unmap notify
-            xcb.change_window_attributes(this._owm.wm, { window: this._window.window, event_mask: 0 });
-            xcb.change_window_attributes(this._owm.wm, { window: this._parent, event_mask: frameMask });
-
-            xcb.unmap_window(this._owm.wm, this._parent);
-            xcb.unmap_window(this._owm.wm, this._window.window);
-
-            xcb.change_window_attributes(this._owm.wm, { window: this._window.window, event_mask: winMask });
-        }
+        entries[offset + entry.Window] = this._window.window;
+        entries[offset + entry.Frame] = this._parent;
+        entries[offset + entry.State] = state;
+        entries[offset + entry.Flags] = this._hidden ? xcb.clientState.flag.Hidden : 0;
+        entries[offset + entry.X] = this._frameGeometry.x;
+        entries[offset + entry.Y] = this._frameGeometry.y;
     }
 
     private _createGC() {
@@ -1149,43 +1210,13 @@ export class Client implements ContainerItem
         let parentArgs = Object.assign({ window: this._parent }, args);
 
         if (hasPos) {
-            const oldmonitor = this._monitor;
-            const oldws = this.workspace;
-
             this._geometry.x = args.x as number;
             this._geometry.y = args.y as number;
 
             parentArgs.x = this._frameGeometry.x = this._geometry.x - this._border;
             parentArgs.y = this._frameGeometry.y = this._geometry.y - this._border;
 
-            // change workspace/monitor if needed
-            const monitor = this._owm.monitors.monitorByContainerItem(this);
-            this._monitor = monitor;
-
-            if (this._ignoreWorkspace && oldmonitor !== monitor) {
-                oldmonitor.removeItem(this);
-                monitor.addItem(this);
-            } else if (oldws && oldws.monitor && oldws.monitor !== monitor) {
-                if (oldws.monitor !== oldmonitor) {
-                    throw new Error("monitor by geometry and old workspace monitor mismatch");
-                }
-                const newws = monitor.workspace;
-                if (!newws) {
-                    throw new Error("client moved to new monitor but monitor didn't have an active workspace");
-                }
-
-                // this will also update our container
-                oldws.removeItem(this);
-                newws.addItem(this);
-
-                // if the old workspace was inactive, normalize this client
-                if (oldws.monitor && oldws.monitor.workspace !== oldws) {
-                    // but not if we've been explicitly unmapped
-                    if (this._explicitState === Client.State.Normal) {
-                        this._setState(Client.State.Normal);
-                    }
-                }
-            }
+            this._updateMonitor();
         }
         if (hasSize) {
             if (!this.dock) {
@@ -1207,6 +1238,7 @@ export class Client implements ContainerItem
 
         this._owm.xcb.configure_window(this._owm.wm, thisArgs);
         this._owm.xcb.configure_window(this._owm.wm, parentArgs);
+        this._owm.ipc.invalidate();
 
         const abs = this.absoluteGeometry;
         if (!hasFiniteNumber(abs.width) || !hasFiniteNumber(abs.height) || abs.width <= 0 || abs.height <= 0) {
@@ -1219,6 +1251,74 @@ export class Client implements ContainerItem
 
         const fake = Object.assign({ window: thisArgs.window, border_width: 0 }, abs);
         this._owm.xcb.send_configure_notify(this._owm.wm, fake);
+
+        this._syncConfigurePolicy();
+    }
+
+    // change workspace/monitor if our position says we should
+    private _updateMonitor() {
+        const oldmonitor = this._monitor;
+        const oldws = this.workspace;
+
+        const monitor = this._owm.monitors.monitorByContainerItem(this);
+        this._monitor = monitor;
+
+        if (this._ignoreWorkspace && oldmonitor !== monitor) {
+            oldmonitor.removeItem(this);
+            monitor.addItem(this);
+        } else if (oldws && oldws.monitor && oldws.monitor !== monitor) {
+            if (oldws.monitor !== oldmonitor) {
+                throw new Error("monitor by geometry and old workspace monitor mismatch");
+            }
+            const newws = monitor.workspace;
+            if (!newws) {
+                throw new Error("client moved to new monitor but monitor didn't have an active workspace");
+            }
+
+            // this will also update our container
+            oldws.removeItem(this);
+            newws.addItem(this);
+
+            // if the old workspace was inactive, normalize this client
+            if (oldws.monitor && oldws.monitor.workspace !== oldws) {
+                // but not if we've been explicitly unmapped
+                if (this._explicitState === Client.State.Normal) {
+                    this._setState(Client.State.Normal);
+                }
+            }
+        }
+    }
+
+    // how a click on our frame focuses us natively, clients that can't
+    // take focus at all are left to js
+    private _syncClickFocus() {
+        const xcb = this._owm.xcb;
+        let mode = xcb.clickFocus.None;
+        if (!this._noinput) {
+            mode = xcb.clickFocus.Input;
+        } else if (this._window.wmProtocols.includes(xcb.atom.WM_TAKE_FOCUS)) {
+            mode = xcb.clickFocus.TakeFocus;
+        }
+        xcb.set_click_focus(this._owm.wm, { frame: this._parent, window: this._window.window, mode: mode });
+    }
+
+    // Hand our ConfigureRequests to the native fast path. Same split as
+    // configure(): floating clients get what they ask for within their
+    // size hints, everyone else gets told where they are.
+    private _syncConfigurePolicy() {
+        const layout = this._owm.layout;
+        const hints = configureHints || (configureHints = new Int32Array(layout.hint.Stride));
+        this.packLayoutHints(hints, 0);
+        layout.setPolicy({
+            window: this._window.window,
+            policy: (this._floating || this._ignoreWorkspace) ? layout.policy.Floating : layout.policy.Ignore,
+            frame: this._parent,
+            hints: hints,
+            x: this._geometry.x,
+            y: this._geometry.y,
+            width: this._geometry.width,
+            height: this._geometry.height
+        });
     }
 
     private _enforceSize(width: number, height: number, keepHeight?: boolean, tiled?: boolean) {
@@ -1370,6 +1470,7 @@ export class Client implements ContainerItem
         this._noinput = dock || notification;
         if (window.wmHints.flags & owm.xcb.icccm.hint.INPUT)
             this._noinput = window.wmHints.input === 0;
+        this._syncClickFocus();
 
         // if we were explicitly set to floating by the
         // configuration system then we need to respect that
@@ -1398,6 +1499,7 @@ export class Client implements ContainerItem
                 }
             }
         }
+        this._syncConfigurePolicy();
         this._relayoutWorkspace();
         owm.ewmh.updateAllowed(this);
     }
@@ -1424,14 +1526,9 @@ export class Client implements ContainerItem
 
     private _raiseClientAndTransients(client: Client, sibling: Client) {
         const owm = this._owm;
-        const xcb = owm.xcb;
 
         // raise self
-        xcb.configure_window(owm.wm, {
-            window: client._parent,
-            sibling: sibling._parent,
-            stack_mode: xcb.stackMode.ABOVE
-        });
+        owm.stacking.raise(client._parent, sibling._parent);
 
         if (this._container) {
             this._container.notifyRaised(client, sibling);
@@ -1460,11 +1557,7 @@ export class Client implements ContainerItem
             const followers = container.sortItemsByStackIndex(this.group.followerClients) as Client[];
             for (const follower of followers) {
                 if (follower.floating && follower.container === container) {
-                    xcb.configure_window(owm.wm, {
-                        window: follower._parent,
-                        sibling: topmostClient._parent,
-                        stack_mode: xcb.stackMode.ABOVE
-                    });
+                    owm.stacking.raise(follower._parent, topmostClient._parent);
                     container.notifyRaised(follower, topmostClient);
                     topmostClient = follower;
                 }
@@ -1478,29 +1571,22 @@ export class Client implements ContainerItem
         }
         for (const t of tr) {
             if (t !== sibling) {
-                xcb.configure_window(owm.wm, {
-                    window: t._parent,
-                    sibling: topmostClient._parent,
-                    stack_mode: xcb.stackMode.ABOVE
-                });
+                owm.stacking.raise(t._parent, topmostClient._parent);
                 if (this._container) {
                     this._container.notifyRaised(t, topmostClient);
                 }
                 topmostClient = t;
             }
         }
+
+        owm.scheduleRestack();
     }
 
     private _lowerClientAndTransients(client: Client, sibling: Client) {
         const owm = this._owm;
-        const xcb = owm.xcb;
 
         // lower self
-        xcb.configure_window(owm.wm, {
-            window: client._parent,
-            sibling: sibling._parent,
-            stack_mode: xcb.stackMode.BELOW
-        });
+        owm.stacking.lower(client._parent, sibling._parent);
 
         if (this._container) {
             this._container.notifyLowered(client, sibling);
@@ -1513,16 +1599,14 @@ export class Client implements ContainerItem
         }
         for (const t of tr) {
             if (t !== sibling) {
-                xcb.configure_window(owm.wm, {
-                    window: t._parent,
-                    sibling: client._parent,
-                    stack_mode: xcb.stackMode.ABOVE
-                });
+                owm.stacking.raise(t._parent, client._parent);
                 if (this._container) {
                     this._container.notifyRaised(t, client);
                 }
             }
         }
+
+        owm.scheduleRestack();
     }
 }
 
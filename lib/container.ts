@@ -218,6 +218,10 @@ export class Container implements ContainerItem
     set visible(v: boolean) {
         this._visible = v;
 
+        if (v && this._containerType === Container.Type.TopLevel) {
+            this._owm.applyDeferredLayout(this._workspace);
+        }
+
         for (let item of this._layoutItems) {
             if (!item.ignoreWorkspace) {
                 item.visible = v;
@@ -375,6 +379,10 @@ export class Container implements ContainerItem
             this._fullscreenItem = undefined;
         }
 
+        if (isContainer(item)) {
+            this._owm.forgetLayout(item);
+        }
+
         this.relayout();
 
         if (Strut.hasStrut(item.strut)) {
@@ -769,6 +777,11 @@ export class Container implements ContainerItem
     }
 
     relayout() {
+        this._owm.scheduleRelayout(this);
+    }
+
+    // lay out immediately, use relayout() unless you know you need this
+    layout() {
         if (!this._layout)
             return;
         if (this._fullscreenItem) {
@@ -25,9 +25,9 @@ export class EWMH {
             clientData[i] = clients[i].window.window;
         }
 
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_CLIENT_LIST, type: xcb.atom.WINDOW,
-                                      format: 32, data: clientData });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_CLIENT_LIST, type: xcb.atom.WINDOW,
+                                   format: 32, data: clientData });
     }
 
     updateWorkarea() {
@@ -52,9 +52,9 @@ export class EWMH {
             waData[((num - 1) * 4) + 3] = geom.height;
         }
 
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_WORKAREA, type: xcb.atom.CARDINAL,
-                                      format: 32, data: waData });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_WORKAREA, type: xcb.atom.CARDINAL,
+                                   format: 32, data: waData });
     }
 
     updateWorkspaces() {
@@ -86,9 +86,9 @@ export class EWMH {
         const wsData = new Uint32Array(1);
         wsData[0] = high;
 
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_NUMBER_OF_DESKTOPS, type: xcb.atom.CARDINAL,
-                                      format: 32, data: wsData });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_NUMBER_OF_DESKTOPS, type: xcb.atom.CARDINAL,
+                                   format: 32, data: wsData });
 
         const nullBuffer = Buffer.alloc(1);
 
@@ -104,9 +104,9 @@ export class EWMH {
         }
 
         const nameBuffer = Buffer.concat(nameArray);
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_DESKTOP_NAMES, type: xcb.atom.UTF8_STRING,
-                                      format: 8, data: nameBuffer });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_DESKTOP_NAMES, type: xcb.atom.UTF8_STRING,
+                                   format: 8, data: nameBuffer });
     }
 
     updateCurrentWorkspace(ws: number) {
@@ -123,9 +123,9 @@ export class EWMH {
         const wsData = new Uint32Array(1);
         wsData[0] = ws - 1;
 
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_CURRENT_DESKTOP, type: xcb.atom.CARDINAL,
-                                      format: 32, data: wsData });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_CURRENT_DESKTOP, type: xcb.atom.CARDINAL,
+                                   format: 32, data: wsData });
 
         this._currentWorkspace = ws;
     }
@@ -156,6 +156,7 @@ export class EWMH {
             atom._NET_WM_STRUT_PARTIAL,
             atom._NET_WM_USER_TIME_WINDOW,
             atom._NET_CLIENT_LIST,
+            atom._NET_CLIENT_LIST_STACKING,
             atom._NET_WM_DESKTOP,
             atom._NET_CURRENT_DESKTOP,
             atom._NET_NUMBER_OF_DESKTOPS,
@@ -170,9 +171,9 @@ export class EWMH {
         for (let i = 0; i < supportedAtoms.length; ++i) {
             supportedData[i] = supportedAtoms[i];
         }
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_SUPPORTED, type: xcb.atom.ATOM,
-                                      format: 32, data: supportedData });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_SUPPORTED, type: xcb.atom.ATOM,
+                                   format: 32, data: supportedData });
     }
 
     updateViewport() {
@@ -182,9 +183,9 @@ export class EWMH {
         const viewportData = new Uint32Array(2);
         viewportData[0] = 0;
         viewportData[1] = 0;
-        xcb.change_property(owm.wm, { window: owm.root, mode: xcb.propMode.REPLACE,
-                                      property: xcb.atom._NET_DESKTOP_VIEWPORT, type: xcb.atom.CARDINAL,
-                                      format: 32, data: viewportData });
+        owm.property.set(owm.wm, { window: owm.root,
+                                   property: xcb.atom._NET_DESKTOP_VIEWPORT, type: xcb.atom.CARDINAL,
+                                   format: 32, data: viewportData });
     }
 
     updateDesktop(client: Client) {
@@ -195,9 +196,9 @@ export class EWMH {
 
             const desktopData = new Uint32Array(1);
             desktopData[0] = ws.id - 1;
-            xcb.change_property(owm.wm, { window: client.window.window, mode: xcb.propMode.REPLACE,
-                                          property: xcb.atom._NET_WM_DESKTOP, type: xcb.atom.CARDINAL,
-                                          format: 32, data: desktopData });
+            owm.property.set(owm.wm, { window: client.window.window,
+                                       property: xcb.atom._NET_WM_DESKTOP, type: xcb.atom.CARDINAL,
+                                       format: 32, data: desktopData });
         }
     }
 
@@ -205,7 +206,7 @@ export class EWMH {
         const owm = this._owm;
         const xcb = owm.xcb;
 
-        xcb.delete_property(owm.wm, { window: client.window.window, property: xcb.atom._NET_WM_DESKTOP });
+        owm.property.remove(owm.wm, { window: client.window.window, property: xcb.atom._NET_WM_DESKTOP });
     }
 
     updateAllowed(client: Client) {
@@ -239,9 +240,9 @@ export class EWMH {
             allowedData[i] = allowed[i];
         }
 
-        owm.xcb.change_property(owm.wm, { window: client.window.window, mode: owm.xcb.propMode.REPLACE,
-                                          property: atom._NET_WM_ALLOWED_ACTIONS, type: owm.xcb.atom.ATOM,
-                                          format: 32, data: allowedData });
+        owm.property.set(owm.wm, { window: client.window.window,
+                                   property: atom._NET_WM_ALLOWED_ACTIONS, type: owm.xcb.atom.ATOM,
+                                   format: 32, data: allowedData });
     }
 
     addStateFocused(client: Client) {
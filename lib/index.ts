@@ -3,7 +3,7 @@ export { Client } from "./client";
 export { Container, ContainerItem } from "./container";
 export { Keybindings } from "./keybindings";
 export { Logger } from "./logger";
-export { Match, MatchCondition, MatchWMClass, MatchWMName } from "./match";
+export { Match, MatchCondition, MatchIndex, MatchWMClass, MatchWMName, MatchWMRole } from "./match";
 export { Monitor, Monitors } from "./monitor";
 export {
     NotificationCloseReason,
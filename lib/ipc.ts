@@ -4,6 +4,9 @@ import { createServer } from "http";
 import { join } from "path";
 import { unlinkSync } from "fs";
 import { OWMLib, Logger } from ".";
+import { Client, isClient } from "./client";
+import { Monitor } from "./monitor";
+import { IPC as NativeIPC, Snapshot } from "native";
 
 export interface IPCMessage
 {
@@ -13,17 +16,34 @@ export interface IPCMessage
     close: () => void;
 }
 
+// events that are forwarded to subscribers of the native endpoint, all of
+// them also mean the published state needs a refresh
+const nativeEvents = [
+    "client", "clientRemoved", "clientFocusIn", "clientFocusOut",
+    "clientEwmhNameUpdated", "clientWmNameUpdated",
+    "workspaceActivated", "workspaceAdded", "workspaceRemoved", "monitors"
+];
+
 export class IPC
 {
+    private _owm: OWMLib;
     private _events: EventEmitter;
     private _ws: WebSocket.Server;
     private _clients: Set<WebSocket>;
     private _log: Logger;
+    private _native: NativeIPC.Engine;
+    private _snapshot: Snapshot.Engine;
+    private _snapshotScheduled: boolean;
 
-    constructor(owm: OWMLib, name: string | undefined, display: string | undefined) {
+    constructor(owm: OWMLib, native: NativeIPC.Engine, snapshot: Snapshot.Engine,
+                name: string | undefined, display: string | undefined) {
+        this._owm = owm;
         this._clients = new Set<WebSocket>();
         this._events = new EventEmitter();
         this._log = owm.logger.prefixed("ipc");
+        this._native = native;
+        this._snapshot = snapshot;
+        this._snapshotScheduled = false;
 
         let rdisplay = display;
         if (rdisplay === undefined) {
@@ -49,6 +69,27 @@ export class IPC
 
         httpServer.listen(path);
 
+        // read-only queries and event subscriptions are served off the
+        // main thread, see native/cppsrc/ipc.cc for the framing
+        try {
+            this._native.listen(join("/tmp", (name || "owm") + "." + rdisplay.substr(eq + 1) + ".state.sock"));
+        } catch (err) {
+            this._log.error("unable to start native ipc endpoint", err.message);
+        }
+        // and the same state once more in shared memory, for readers that
+        // don't want to talk to anyone at all
+        try {
+            this._snapshot.open((name || "owm") + "." + rdisplay.substr(eq + 1));
+        } catch (err) {
+            this._log.error("unable to create state snapshot", err.message);
+        }
+        for (const ev of nativeEvents) {
+            owm.events.on(ev, (arg: any) => {
+                this._native.emit(ev, JSON.stringify(IPC._eventPayload(arg)));
+                this.invalidate();
+            });
+        }
+
         this._ws.on("connection", (ws: WebSocket) => {
             this._clients.add(ws);
 
@@ -102,4 +143,83 @@ export class IPC
     get events() {
         return this._events;
     }
+
+    get native() {
+        return this._native;
+    }
+
+    get snapshot() {
+        return this._snapshot;
+    }
+
+    // State changed, publish a new snapshot once the current batch is done.
+    invalidate() {
+        if (this._snapshotScheduled)
+            return;
+        this._snapshotScheduled = true;
+        setImmediate(() => {
+            this._snapshotScheduled = false;
+            this.publish();
+        });
+    }
+
+    publish() {
+        const owm = this._owm;
+        const focused = owm.focused;
+        const clients = owm.clients.map(IPC._client);
+        this._native.publish("clients", JSON.stringify(clients));
+        this._native.publish("focus", JSON.stringify(focused ? IPC._client(focused) : null));
+
+        const monitors: object[] = [];
+        const workspaces: Snapshot.Workspace[] = [];
+        for (const monitor of owm.monitors.all) {
+            const screen = monitor.screen;
+            monitors.push({ name: screen.name, x: screen.x, y: screen.y, width: screen.width, height: screen.height,
+                            primary: screen.primary, workspace: monitor.workspace ? monitor.workspace.id : undefined });
+            for (const ws of monitor.workspaces.workspaces) {
+                workspaces.push({ id: ws.id, name: ws.name, monitor: screen.name, active: ws.active });
+            }
+        }
+        this._native.publish("monitors", JSON.stringify(monitors));
+        this._native.publish("workspaces", JSON.stringify(workspaces));
+
+        this._snapshot.publish({ focused: focused ? focused.window.window : 0, workspaces: workspaces, clients: clients });
+    }
+
+    close() {
+        this._native.close();
+        this._snapshot.close();
+    }
+
+    private static _client(client: Client) {
+        const window = client.window;
+        const ws = client.workspace;
+        const geometry = client.frameGeometry;
+        return {
+            window: window.window,
+            frame: client.frame,
+            name: client.name,
+            class: window.wmClass.class_name,
+            instance: window.wmClass.instance_name,
+            role: window.wmRole,
+            workspace: ws ? ws.id : undefined,
+            visible: client.visible,
+            floating: client.floating,
+            fullscreen: client.fullscreen,
+            staysOnTop: client.staysOnTop,
+            x: geometry.x,
+            y: geometry.y,
+            width: geometry.width,
+            height: geometry.height
+        };
+    }
+
+    private static _eventPayload(arg: any) {
+        if (arg && isClient(arg)) {
+            return { window: arg.window.window };
+        } else if (arg instanceof Monitor) {
+            return { monitor: arg.screen.name, workspace: arg.workspace ? arg.workspace.id : undefined };
+        }
+        return {};
+    }
 }
@@ -3,6 +3,12 @@ import { Logger } from "./logger";
 import { XCB } from "native";
 import { EventEmitter } from "events";
 
+// What to do while a binding's key is held down. true passes every
+// auto-repeat on, false only the initial press and a number at most one
+// repeat per that many milliseconds. Dropped repeats never reach js. A
+// mode's setting only applies while that mode is the innermost one.
+export type KeyRepeat = boolean | number;
+
 class Keybinding
 {
     private _owm: OWMLib;
@@ -11,15 +17,20 @@ class Keybinding
     private _mods: number;
     private _mode: number;
     private _codes: number[];
+    private _repeat: KeyRepeat;
+    private _anyModifiers: boolean;
     private _callback: (bindings: Keybindings, binding: string) => void;
 
-    constructor(owm: OWMLib, binding: string, callback: (bindings: Keybindings, binding: string) => void, sync?: boolean) {
+    constructor(owm: OWMLib, binding: string, callback: (bindings: Keybindings, binding: string) => void,
+                sync?: boolean, repeat?: KeyRepeat, anyModifiers?: boolean) {
         this._owm = owm;
         this._binding = binding;
         this._callback = callback;
         this._sym = 0;
         this._mods = 0;
         this._codes = [];
+        this._repeat = repeat === undefined ? true : repeat;
+        this._anyModifiers = anyModifiers === true;
 
         this._mode = sync ? owm.xcb.grabMode.SYNC : owm.xcb.grabMode.ASYNC;
 
@@ -50,6 +61,10 @@ class Keybinding
         return this._mode === this._owm.xcb.grabMode.SYNC;
     }
 
+    get repeat() {
+        return this._repeat;
+    }
+
     call(bindings: Keybindings) {
         this._callback(bindings, this._binding);
     }
@@ -60,6 +75,38 @@ class Keybinding
         this._codes = this._owm.xcb.key_symbols_get_keycode(this._owm.wm, this._sym);
     }
 
+    // the native table is global, only the bindings that currently
+    // receive presses (the innermost mode or the root bindings) install
+    // their repeat rule so another mode's rule for the same key can't win
+    applyRepeat() {
+        // every repeat is what the native side does by default
+        if (this._repeat === true)
+            return;
+
+        const xcb = this._owm.xcb;
+        const modifiers = this._anyModifiers ? xcb.modMask.ANY : this._mods;
+        for (const code of this._codes) {
+            if (this._repeat === false) {
+                xcb.set_key_repeat(this._owm.wm, { key: code, modifiers: modifiers, mode: xcb.keyRepeat.First,
+                                                   sync: this.sync });
+            } else {
+                xcb.set_key_repeat(this._owm.wm, { key: code, modifiers: modifiers, mode: xcb.keyRepeat.Throttle,
+                                                   interval: this._repeat, sync: this.sync });
+            }
+        }
+    }
+
+    clearRepeat() {
+        if (this._repeat === true)
+            return;
+
+        const xcb = this._owm.xcb;
+        const modifiers = this._anyModifiers ? xcb.modMask.ANY : this._mods;
+        for (const code of this._codes) {
+            xcb.set_key_repeat(this._owm.wm, { key: code, modifiers: modifiers, mode: xcb.keyRepeat.Every });
+        }
+    }
+
     private parse() {
         this._mods = 0;
         this._sym = 0;
@@ -144,12 +191,12 @@ export class KeybindingsMode extends EventEmitter
         return this._matchModifiers;
     }
 
-    add(binding: string, callback: (mode: KeybindingsMode, binding: string) => void) {
+    add(binding: string, callback: (mode: KeybindingsMode, binding: string) => void, repeat?: KeyRepeat) {
         const keybinding = new Keybinding(this._parent.owm, binding, (bindings: Keybindings, binding: string) => {
             callback(this, binding);
-        }, false);
+        }, false, repeat, !this._matchModifiers);
         keybinding.recreate();
-        this._bindings.set(binding, keybinding);
+        this._set(binding, keybinding);
     }
 
     addMode(binding: string, mode: KeybindingsMode) {
@@ -166,7 +213,7 @@ export class KeybindingsMode extends EventEmitter
                                                                      time: this._parent.owm.currentTime });
         }, true);
         keybinding.recreate();
-        this._bindings.set(binding, keybinding);
+        this._set(binding, keybinding);
     }
 
     exit() {
@@ -174,10 +221,25 @@ export class KeybindingsMode extends EventEmitter
     }
 
     recreate() {
+        const active = this._parent.currentMode === this;
         for (const [key, keybinding] of this._bindings) {
+            if (active)
+                keybinding.clearRepeat();
             keybinding.recreate();
+            if (active)
+                keybinding.applyRepeat();
         }
     }
+
+    private _set(binding: string, keybinding: Keybinding) {
+        if (this._parent.currentMode === this) {
+            const old = this._bindings.get(binding);
+            if (old)
+                old.clearRepeat();
+            keybinding.applyRepeat();
+        }
+        this._bindings.set(binding, keybinding);
+    }
 }
 
 export class Keybindings
@@ -202,8 +264,12 @@ export class Keybindings
         return this._owm;
     }
 
-    add(binding: string, callback: (bindings: Keybindings, binding: string) => void) {
-        this._add(binding, callback, false);
+    get currentMode(): KeybindingsMode | undefined {
+        return this._enteredModes.length > 0 ? this._enteredModes[this._enteredModes.length - 1] : undefined;
+    }
+
+    add(binding: string, callback: (bindings: Keybindings, binding: string) => void, repeat?: KeyRepeat) {
+        this._add(binding, callback, false, repeat);
     }
 
     addMode(binding: string, mode: KeybindingsMode) {
@@ -238,7 +304,9 @@ export class Keybindings
             }
         }
 
+        this._clearRepeat();
         this._enteredModes.push(mode);
+        this._applyRepeat();
 
         mode.emit("entered");
         this._owm.events.emit("enterMode", mode);
@@ -249,7 +317,9 @@ export class Keybindings
             throw new Error("Can't exit mode, current mode is not this mode");
         }
 
+        this._clearRepeat();
         this._enteredModes.pop();
+        this._applyRepeat();
 
         if (mode.matchModifiers) {
             for (const [str, binding] of mode.bindings) {
@@ -337,8 +407,9 @@ export class Keybindings
         }
     }
 
-    private _add(binding: string, callback: (bindings: Keybindings, binding: string) => void, sync: boolean) {
-        const keybinding = new Keybinding(this._owm, binding, callback, sync);
+    private _add(binding: string, callback: (bindings: Keybindings, binding: string) => void, sync: boolean,
+                 repeat?: KeyRepeat) {
+        const keybinding = new Keybinding(this._owm, binding, callback, sync, repeat);
 
         keybinding.recreate();
 
@@ -359,6 +430,12 @@ export class Keybindings
             }
         }
 
+        if (!this._enteredModes.length) {
+            const old = this._bindings.get(binding);
+            if (old)
+                old.clearRepeat();
+            keybinding.applyRepeat();
+        }
         this._bindings.set(binding, keybinding);
     }
 
@@ -366,8 +443,30 @@ export class Keybindings
         for (const mode of this._allModes) {
             mode.recreate();
         }
+        const active = !this._enteredModes.length;
         for (const [key, keybinding] of this._bindings) {
+            if (active)
+                keybinding.clearRepeat();
             keybinding.recreate();
+            if (active)
+                keybinding.applyRepeat();
+        }
+    }
+
+    private _activeBindings() {
+        const mode = this.currentMode;
+        return mode ? mode.bindings : this._bindings;
+    }
+
+    private _applyRepeat() {
+        for (const [key, keybinding] of this._activeBindings()) {
+            keybinding.applyRepeat();
+        }
+    }
+
+    private _clearRepeat() {
+        for (const [key, keybinding] of this._activeBindings()) {
+            keybinding.clearRepeat();
         }
     }
 
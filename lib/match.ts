@@ -1,42 +1,122 @@
 import { Client } from "./client";
 
+export type MatchValue = string | RegExp | { prefix: string };
+export type MatchField = "class" | "instance" | "role" | "name";
+
+export interface MatchKey
+{
+    field: MatchField;
+    value: MatchValue;
+}
+
 export interface MatchCondition
 {
     match(client: Client): boolean;
+    // conditions that can name the one value they require let
+    // the index skip them for clients that can't possibly match
+    key?(): MatchKey | undefined;
 };
 
+type Matcher = (value: string) => boolean;
+
+// compiled once per condition rather than per client
+function compileValue(value: MatchValue): Matcher {
+    if (typeof value === "string") {
+        return (str: string) => str === value;
+    } else if (value instanceof RegExp) {
+        // a global or sticky regexp keeps state between test() calls
+        const re = (value.global || value.sticky) ? new RegExp(value.source, value.flags.replace(/[gy]/g, "")) : value;
+        return (str: string) => re.test(str);
+    }
+    const prefix = value.prefix;
+    return (str: string) => str.startsWith(prefix);
+}
+
+function fieldValues(client: Client, field: MatchField): string[] {
+    const window = client.window;
+    switch (field) {
+    case "class":
+        return [window.wmClass.class_name];
+    case "instance":
+        return [window.wmClass.instance_name];
+    case "role":
+        return [window.wmRole];
+    case "name":
+        return [window.ewmhName, window.wmName];
+    }
+}
+
 export class MatchWMClass implements MatchCondition
 {
-    private _instance?: string;
-    private _class?: string;
+    private _instance?: MatchValue;
+    private _class?: MatchValue;
+    private _instanceMatcher?: Matcher;
+    private _classMatcher?: Matcher;
 
-    constructor(obj: { instance?: string, class?: string }) {
+    constructor(obj: { instance?: MatchValue, class?: MatchValue }) {
         this._instance = obj.instance;
         this._class = obj.class;
+        if (this._instance)
+            this._instanceMatcher = compileValue(this._instance);
+        if (this._class)
+            this._classMatcher = compileValue(this._class);
     }
 
     match(client: Client) {
-        if (!this._instance && !this._class)
+        if (!this._instanceMatcher && !this._classMatcher)
             return false;
-        if (this._instance && client.window.wmClass.instance_name !== this._instance)
+        if (this._instanceMatcher && !this._instanceMatcher(client.window.wmClass.instance_name))
             return false;
-        if (this._class && client.window.wmClass.class_name !== this._class)
+        if (this._classMatcher && !this._classMatcher(client.window.wmClass.class_name))
             return false;
         return true;
     }
+
+    key(): MatchKey | undefined {
+        if (this._class)
+            return { field: "class", value: this._class };
+        if (this._instance)
+            return { field: "instance", value: this._instance };
+        return undefined;
+    }
 }
 
 export class MatchWMName implements MatchCondition
 {
-    private _name: string;
+    private _name: MatchValue;
+    private _matcher: Matcher;
 
-    constructor(name: string) {
+    constructor(name: MatchValue) {
         this._name = name;
+        this._matcher = compileValue(name);
     }
 
     match(client: Client) {
-        return (client.window.ewmhName === this._name
-                || client.window.wmName === this._name);
+        return (this._matcher(client.window.ewmhName)
+                || this._matcher(client.window.wmName));
+    }
+
+    key(): MatchKey | undefined {
+        return { field: "name", value: this._name };
+    }
+}
+
+export class MatchWMRole implements MatchCondition
+{
+    private _role: MatchValue;
+    private _matcher: Matcher;
+
+    constructor(role: MatchValue) {
+        this._role = role;
+        this._matcher = compileValue(role);
+    }
+
+    match(client: Client) {
+        return this._matcher(client.window.wmRole);
+    }
+
+    key(): MatchKey | undefined {
+        return { field: "role", value: this._role };
     }
 }
 
@@ -45,9 +125,11 @@ export class Match
     private _conditions: MatchCondition[];
     private _callback: (client: Client) => void;
     private _type: Match.MatchType;
+    private _index?: MatchIndex;
 
     public static readonly MatchWMClass = MatchWMClass;
     public static readonly MatchWMName = MatchWMName;
+    public static readonly MatchWMRole = MatchWMRole;
 
     constructor(callback: (client: Client) => void, type?: Match.MatchType) {
         this._callback = callback;
@@ -57,6 +139,45 @@ export class Match
 
     addCondition(cond: MatchCondition) {
         this._conditions.push(cond);
+        if (this._index)
+            this._index.update(this);
+    }
+
+    set index(index: MatchIndex | undefined) {
+        this._index = index;
+    }
+
+    // the keys a client has to hit for this match to possibly succeed,
+    // undefined if any client could match
+    keys(): MatchKey[] | undefined {
+        if (!this._conditions.length)
+            return [];
+
+        if (this._type === Match.MatchType.And) {
+            // every condition has to hold, any one key will do. exact
+            // keys are the cheapest to look up so prefer those
+            let best: MatchKey | undefined;
+            for (const cond of this._conditions) {
+                const key = cond.key ? cond.key() : undefined;
+                if (!key)
+                    continue;
+                if (typeof key.value === "string")
+                    return [key];
+                if (!best || (best.value instanceof RegExp && !(key.value instanceof RegExp)))
+                    best = key;
+            }
+            return best ? [best] : undefined;
+        }
+
+        // any condition may hold, all of them need a key
+        const keys: MatchKey[] = [];
+        for (const cond of this._conditions) {
+            const key = cond.key ? cond.key() : undefined;
+            if (!key)
+                return undefined;
+            keys.push(key);
+        }
+        return keys;
     }
 
     match(client: Client) {
@@ -87,3 +208,219 @@ export namespace Match {
         Or
     }
 }
+
+interface RegExpEntry
+{
+    matcher: Matcher;
+    matches: Set<Match>;
+}
+
+class FieldIndex
+{
+    private _exact: Map<string, Set<Match>>;
+    private _prefix: Map<string, Set<Match>>;
+    private _prefixLengths: number[];
+    private _regexps: Map<string, RegExpEntry>;
+
+    constructor() {
+        this._exact = new Map<string, Set<Match>>();
+        this._prefix = new Map<string, Set<Match>>();
+        this._prefixLengths = [];
+        this._regexps = new Map<string, RegExpEntry>();
+    }
+
+    get empty() {
+        return !this._exact.size && !this._prefix.size && !this._regexps.size;
+    }
+
+    add(value: MatchValue, match: Match) {
+        if (typeof value === "string") {
+            FieldIndex._insert(this._exact, value, match);
+        } else if (value instanceof RegExp) {
+            // identical expressions share one compiled matcher
+            const source = `/${value.source}/${value.flags}`;
+            let entry = this._regexps.get(source);
+            if (!entry) {
+                entry = { matcher: compileValue(value), matches: new Set<Match>() };
+                this._regexps.set(source, entry);
+            }
+            entry.matches.add(match);
+        } else {
+            FieldIndex._insert(this._prefix, value.prefix, match);
+            this._updatePrefixLengths();
+        }
+    }
+
+    remove(value: MatchValue, match: Match) {
+        if (typeof value === "string") {
+            FieldIndex._erase(this._exact, value, match);
+        } else if (value instanceof RegExp) {
+            const source = `/${value.source}/${value.flags}`;
+            const entry = this._regexps.get(source);
+            if (entry) {
+                entry.matches.delete(match);
+                if (!entry.matches.size)
+                    this._regexps.delete(source);
+            }
+        } else {
+            FieldIndex._erase(this._prefix, value.prefix, match);
+            this._updatePrefixLengths();
+        }
+    }
+
+    collect(value: string, out: Set<Match>) {
+        const exact = this._exact.get(value);
+        if (exact) {
+            for (const m of exact)
+                out.add(m);
+        }
+        // one map lookup per distinct prefix length instead of
+        // one startsWith per rule
+        for (const len of this._prefixLengths) {
+            if (len > value.length)
+                break;
+            const prefixed = this._prefix.get(value.substr(0, len));
+            if (prefixed) {
+                for (const m of prefixed)
+                    out.add(m);
+            }
+        }
+        for (const [, entry] of this._regexps) {
+            if (entry.matcher(value)) {
+                for (const m of entry.matches)
+                    out.add(m);
+            }
+        }
+    }
+
+    private _updatePrefixLengths() {
+        const lengths = new Set<number>();
+        for (const [prefix] of this._prefix)
+            lengths.add(prefix.length);
+        this._prefixLengths = Array.from(lengths).sort((a, b) => a - b);
+    }
+
+    private static _insert(map: Map<string, Set<Match>>, key: string, match: Match) {
+        let set = map.get(key);
+        if (!set) {
+            set = new Set<Match>();
+            map.set(key, set);
+        }
+        set.add(match);
+    }
+
+    private static _erase(map: Map<string, Set<Match>>, key: string, match: Match) {
+        const set = map.get(key);
+        if (set) {
+            set.delete(match);
+            if (!set.size)
+                map.delete(key);
+        }
+    }
+}
+
+// Buckets matches by the class, instance, role or name they require so
+// that a new client only runs the conditions of rules that can apply to
+// it. Matches whose conditions can't be keyed are always run.
+export class MatchIndex
+{
+    private _order: Map<Match, number>;
+    private _keys: Map<Match, MatchKey[]>;
+    private _fields: Map<MatchField, FieldIndex>;
+    private _generic: Set<Match>;
+    private _serial: number;
+
+    constructor() {
+        this._order = new Map<Match, number>();
+        this._keys = new Map<Match, MatchKey[]>();
+        this._fields = new Map<MatchField, FieldIndex>();
+        this._generic = new Set<Match>();
+        this._serial = 0;
+    }
+
+    get size() {
+        return this._order.size;
+    }
+
+    has(match: Match) {
+        return this._order.has(match);
+    }
+
+    add(match: Match) {
+        if (this._order.has(match))
+            return;
+        this._order.set(match, this._serial++);
+        match.index = this;
+        this._insert(match);
+    }
+
+    delete(match: Match) {
+        if (!this._order.delete(match))
+            return false;
+        match.index = undefined;
+        this._erase(match);
+        return true;
+    }
+
+    // conditions changed, rekey without losing its place in the order
+    update(match: Match) {
+        if (!this._order.has(match))
+            return;
+        this._erase(match);
+        this._insert(match);
+    }
+
+    private _insert(match: Match) {
+        const keys = match.keys();
+        if (keys === undefined) {
+            this._generic.add(match);
+            return;
+        }
+        this._keys.set(match, keys);
+        for (const key of keys) {
+            let field = this._fields.get(key.field);
+            if (!field) {
+                field = new FieldIndex();
+                this._fields.set(key.field, field);
+            }
+            field.add(key.value, match);
+        }
+    }
+
+    private _erase(match: Match) {
+        this._generic.delete(match);
+        const keys = this._keys.get(match);
+        if (keys) {
+            this._keys.delete(match);
+            for (const key of keys) {
+                const field = this._fields.get(key.field);
+                if (field) {
+                    field.remove(key.value, match);
+                    if (field.empty)
+                        this._fields.delete(key.field);
+                }
+            }
+        }
+    }
+
+    // the matches that may apply to client, in the order they were added
+    candidates(client: Client): Match[] {
+        const found = new Set<Match>(this._generic);
+        for (const [name, field] of this._fields) {
+            for (const value of fieldValues(client, name)) {
+                field.collect(value, found);
+            }
+        }
+        const ret = Array.from(found);
+        if (ret.length > 1) {
+            ret.sort((a, b) => (this._order.get(a) as number) - (this._order.get(b) as number));
+        }
+        return ret;
+    }
+
+    match(client: Client) {
+        for (const m of this.candidates(client)) {
+            m.match(client);
+        }
+    }
+}
@@ -51,15 +51,19 @@ export class Monitor
         if (this._workspace === ws) {
             return;
         }
+        const owm = this._monitors.owm;
+        owm.batchStates(() => {
+            if (this._workspace) {
+                this._workspace.visible = false;
+            }
+            this._workspace = ws;
+            if (this._workspace) {
+                this._workspace.visible = true;
+            }
+        });
         if (this._workspace) {
-            this._workspace.visible = false;
-        }
-        this._workspace = ws;
-        if (this._workspace) {
-            this._workspace.visible = true;
-
-            this._monitors.owm.ewmh.updateCurrentWorkspace(this._workspace.id);
-            this._monitors.owm.events.emit("workspaceActivated", this);
+            owm.ewmh.updateCurrentWorkspace(this._workspace.id);
+            owm.events.emit("workspaceActivated", this);
         }
     }
 
@@ -255,6 +259,10 @@ export class Monitors
         // delete oldMonitors from current map
         for (const [key, monitor] of oldMonitors) {
             this._monitors.delete(key);
+            monitor.workspaces.forEachWorkspace((ws: Workspace) => {
+                this._owm.forgetLayout(ws.container);
+                return true;
+            });
         }
 
         this._monitors = new Map<string, Monitor>([...this._monitors, ...newMonitors]);
@@ -1,4 +1,4 @@
-import { XCB, OWM, Graphics } from "native";
+import { XCB, OWM, Graphics, Compositor, Layout, Spatial, Stacking, Property, IPC as NativeIPC, Snapshot, Tree } from "native";
 import { EWMH } from "./ewmh";
 import { Policy } from "./policy";
 import { Keybindings, KeybindingsMode } from "./keybindings";
@@ -7,7 +7,7 @@ import { Workspace } from "./workspace";
 import { Monitors } from "./monitor";
 import { Client, ClientGroup, isClient } from "./client";
 import { Container, ContainerItemType, isContainer } from "./container";
-import { Match } from "./match";
+import { Match, MatchIndex } from "./match";
 import { Geometry } from "./utils";
 import { IPC, IPCMessage } from "./ipc";
 import { Notifications } from "./notifications";
@@ -39,11 +39,24 @@ interface LaunchOptions
     stdio?: string;
 }
 
+interface LayoutStats
+{
+    // relayout() calls
+    requested: number;
+    // layouts actually run
+    performed: number;
+    // calls folded into an already pending layout
+    saved: number;
+    // layouts put off because their workspace wasn't visible
+    deferred: number;
+}
+
 interface OWMOptions
 {
     display: string | undefined,
     level: Logger.Level,
-    killTimeout: number
+    killTimeout: number,
+    hideStrategy: string | undefined
 }
 
 enum ResizeHandle
@@ -61,6 +74,9 @@ class MoveResize {
     public resizingKeyboard: Client | undefined;
 
     public static readonly AdjustBy = 20;
+    // held arrow keys move or resize at most once per frame or so, each
+    // step is a relayout
+    public static readonly RepeatInterval = 33;
 
     constructor() {
     }
@@ -85,13 +101,37 @@ function calculateBorder(win: XCB.Window, xcb: OWM.XCB) {
     return dock ? 0 : 2;
 }
 
+function addToLookup(map: Map<string, Set<Client>>, key: string, client: Client) {
+    if (!key.length)
+        return;
+    let set = map.get(key);
+    if (!set) {
+        set = new Set<Client>();
+        map.set(key, set);
+    }
+    set.add(client);
+}
+
+function removeFromLookup(map: Map<string, Set<Client>>, key: string, client: Client) {
+    const set = map.get(key);
+    if (set) {
+        set.delete(client);
+        if (!set.size)
+            map.delete(key);
+    }
+}
+
 export class OWMLib {
     private readonly _wm: OWM.WM;
     private readonly _xcb: OWM.XCB;
     private readonly _xkb: OWM.XKB;
     private _ewmh: EWMH;
     private _clients: Client[];
-    private _matches: Set<Match>;
+    private _matches: MatchIndex;
+    private _clientsByClass: Map<string, Set<Client>>;
+    private _clientsByInstance: Map<string, Set<Client>>;
+    private _clientsByName: Map<string, Set<Client>>;
+    private _clientLookupKeys: Map<Client, { class: string, instance: string, names: string[] }>;
     private _monitors: Monitors;
     private _currentTime: number;
     private _clientsByWindow: Map<number, Client>;
@@ -108,6 +148,20 @@ export class OWMLib {
     private _inactiveColor: number;
     private _groups: Map<number, ClientGroup>;
     private _engine: Graphics.Engine;
+    private _compositor: Compositor.Engine;
+    private _layout: Layout.Engine;
+    private _spatial: Spatial.Engine;
+    private _stacking: Stacking.Engine;
+    private _property: Property.Engine;
+    private _tree: Tree.Engine;
+    private _restackScheduled: boolean;
+    private _stateBatch: Set<Client> | undefined;
+    private _stateEntries: Int32Array;
+    private _hideStrategy: number;
+    private _dirtyContainers: Set<Container>;
+    private _deferredContainers: Set<Container>;
+    private _layoutScheduled: boolean;
+    private _layoutStats: LayoutStats;
     private _options: OWMOptions;
     private _moveModifier: string;
     private _moveModifierMask: number;
@@ -121,17 +175,45 @@ export class OWMLib {
     public readonly Bar = Bar;
     public readonly makePixel = makePixel;
 
-    constructor(wm: OWM.WM, xcb: OWM.XCB, xkb: OWM.XKB, engine: Graphics.Engine, options: OWMOptions) {
+    constructor(wm: OWM.WM, xcb: OWM.XCB, xkb: OWM.XKB, engine: Graphics.Engine, compositor: Compositor.Engine,
+                layout: Layout.Engine, spatial: Spatial.Engine, stacking: Stacking.Engine,
+                property: Property.Engine, ipc: NativeIPC.Engine, snapshot: Snapshot.Engine, tree: Tree.Engine,
+                options: OWMOptions) {
         this._wm = wm;
         this._xcb = xcb;
         this._xkb = xkb;
         this._options = options;
         this._engine = engine;
+        this._compositor = compositor;
+        this._layout = layout;
+        // ConfigureRequests for windows we don't manage are forwarded as is
+        // natively, see configureRequest for what's left
+        this._layout.setDefaultPolicy(this._layout.policy.PassThrough);
+        this._spatial = spatial;
+        this._stacking = stacking;
+        this._property = property;
+        this._initPropertyNotify();
+        this._tree = tree;
+        this._restackScheduled = false;
+        this._stateBatch = undefined;
+        this._stateEntries = new Int32Array(64 * xcb.clientState.entry.Stride);
+        this._hideStrategy = xcb.clientState.hide.Unmap;
+        this._dirtyContainers = new Set<Container>();
+        this._deferredContainers = new Set<Container>();
+        this._layoutScheduled = false;
+        this._layoutStats = { requested: 0, performed: 0, saved: 0, deferred: 0 };
 
         this._log = new ConsoleLogger(options.level);
+        if (options.hideStrategy !== undefined) {
+            try {
+                this.hideStrategy = options.hideStrategy;
+            } catch (e) {
+                this._log.error(e.message);
+            }
+        }
         this._root = 0;
         this._events = new EventEmitter();
-        this._ipc = new IPC(this, "owm", options.display);
+        this._ipc = new IPC(this, ipc, snapshot, "owm", options.display);
         this._notifications = new Notifications(this);
 
         this._policy = new Policy(this);
@@ -139,7 +221,11 @@ export class OWMLib {
         this._ewmh = new EWMH(this);
 
         this._clients = [];
-        this._matches = new Set<Match>();
+        this._matches = new MatchIndex();
+        this._clientsByClass = new Map<string, Set<Client>>();
+        this._clientsByInstance = new Map<string, Set<Client>>();
+        this._clientsByName = new Map<string, Set<Client>>();
+        this._clientLookupKeys = new Map<Client, { class: string, instance: string, names: string[] }>();
         this._monitors = new Monitors(this);
         this._clientsByWindow = new Map<number, Client>();
         this._clientsByFrame = new Map<number, Client>();
@@ -183,7 +269,7 @@ export class OWMLib {
                     return;
                 client.resize(geom.width - MoveResize.AdjustBy, geom.height);
             }
-        });
+        }, MoveResize.RepeatInterval);
         this._moveResizeMode.add("Right", (mode: KeybindingsMode, binding: string) => {
             if (this._moveResize.movingKeyboard) {
                 const client = this._moveResize.movingKeyboard;
@@ -194,7 +280,7 @@ export class OWMLib {
                 const geom = client.frameGeometry;
                 client.resize(geom.width + MoveResize.AdjustBy, geom.height);
             }
-        });
+        }, MoveResize.RepeatInterval);
         this._moveResizeMode.add("Up", (mode: KeybindingsMode, binding: string) => {
             if (this._moveResize.movingKeyboard) {
                 const client = this._moveResize.movingKeyboard;
@@ -208,7 +294,7 @@ export class OWMLib {
                     return;
                 client.resize(geom.width, geom.height - MoveResize.AdjustBy, true);
             }
-        });
+        }, MoveResize.RepeatInterval);
         this._moveResizeMode.add("Down", (mode: KeybindingsMode, binding: string) => {
             if (this._moveResize.movingKeyboard) {
                 const client = this._moveResize.movingKeyboard;
@@ -219,7 +305,7 @@ export class OWMLib {
                 const geom = client.frameGeometry;
                 client.resize(geom.width, geom.height + MoveResize.AdjustBy, true);
             }
-        });
+        }, MoveResize.RepeatInterval);
 
         this._ipc.events.on("message", (msg: IPCMessage) => {
             // this._log.file("Got message from ipc", msg);
@@ -245,6 +331,19 @@ export class OWMLib {
                 }
                 msg.close();
                 break;
+            case "stats":
+                msg.reply("stats", { layout: this._layoutStats, spatial: this._spatial.stats(),
+                                     stacking: this._stacking.stats(), property: this._property.stats(),
+                                     ipc: this._ipc.native.stats(), snapshot: this._ipc.snapshot.stats(),
+                                     tree: this._tree.stats(), configure: this._layout.stats(),
+                                     propertyNotify: this._propertyNotifyStats(),
+                                     keyRepeat: this._xcb.key_repeat_stats(this._wm) });
+                msg.close();
+                break;
+            case "check-tree":
+                msg.reply("check-tree", this._tree.check(this._wm));
+                msg.close();
+                break;
             case "message":
                 this._events.emit("message", msg);
                 break;
@@ -268,6 +367,30 @@ export class OWMLib {
         return this._engine;
     }
 
+    get compositor() {
+        return this._compositor;
+    }
+
+    get layout() {
+        return this._layout;
+    }
+
+    get spatial() {
+        return this._spatial;
+    }
+
+    get stacking() {
+        return this._stacking;
+    }
+
+    get property() {
+        return this._property;
+    }
+
+    get tree() {
+        return this._tree;
+    }
+
     get ewmh() {
         return this._ewmh;
     }
@@ -308,6 +431,10 @@ export class OWMLib {
         return this._notifications;
     }
 
+    get ipc() {
+        return this._ipc;
+    }
+
     get groups() {
         return this._groups;
     }
@@ -361,6 +488,26 @@ export class OWMLib {
         return this._options;
     }
 
+    // how clients on hidden workspaces are kept out of sight, "unmap" or
+    // "offscreen". Offscreen clients stay mapped with _NET_WM_STATE_HIDDEN
+    // set and don't have to repaint when their workspace comes back
+    get hideStrategy() {
+        return this._hideStrategy === this._xcb.clientState.hide.Offscreen ? "offscreen" : "unmap";
+    }
+
+    set hideStrategy(strategy: string) {
+        switch (strategy) {
+            case "unmap":
+                this._hideStrategy = this._xcb.clientState.hide.Unmap;
+                break;
+            case "offscreen":
+                this._hideStrategy = this._xcb.clientState.hide.Offscreen;
+                break;
+            default:
+                throw new Error(`invalid hide strategy ${strategy}`);
+        }
+    }
+
     exit(exitCode?: number) {
         this._events.emit("exit", exitCode);
     }
@@ -386,15 +533,19 @@ export class OWMLib {
             cls = { instance_name: "", class_name: cls };
         }
         const ret: Client[] = [];
-        const compareInstance = cls.instance_name.length > 0;
-        const compareClass = cls.class_name.length > 0;
-        for (const client of this._clients) {
-            if (compareInstance && client.window.wmClass.instance_name === cls.instance_name) {
-                ret.push(client);
-            } else if (compareClass && client.window.wmClass.class_name === cls.class_name) {
+        const byInstance = cls.instance_name.length > 0 ? this._clientsByInstance.get(cls.instance_name) : undefined;
+        const byClass = cls.class_name.length > 0 ? this._clientsByClass.get(cls.class_name) : undefined;
+        if (byInstance) {
+            for (const client of byInstance) {
                 ret.push(client);
             }
         }
+        if (byClass) {
+            for (const client of byClass) {
+                if (!byInstance || !byInstance.has(client))
+                    ret.push(client);
+            }
+        }
         return ret;
     }
 
@@ -402,42 +553,45 @@ export class OWMLib {
         if (typeof cls === "string") {
             cls = { instance_name: "", class_name: cls };
         }
-        const compareInstance = cls.instance_name.length > 0;
-        const compareClass = cls.class_name.length > 0;
-        for (const client of this._clients) {
-            if (compareInstance && client.window.wmClass.instance_name === cls.instance_name) {
-                return client;
-            } else if (compareClass && client.window.wmClass.class_name === cls.class_name) {
-                return client;
-            }
+        if (cls.instance_name.length > 0) {
+            const byInstance = this._clientsByInstance.get(cls.instance_name);
+            if (byInstance && byInstance.size)
+                return byInstance.values().next().value;
+        }
+        if (cls.class_name.length > 0) {
+            const byClass = this._clientsByClass.get(cls.class_name);
+            if (byClass && byClass.size)
+                return byClass.values().next().value;
         }
         return undefined;
     }
 
     findClientsByName(name: string): Client[] {
-        const ret: Client[] = [];
-        for (const client of this._clients) {
-            if (client.window.ewmhName === name) {
-                ret.push(client);
-            } else if (client.window.wmName === name) {
-                ret.push(client);
-            }
-        }
-        return ret;
+        const byName = this._clientsByName.get(name);
+        return byName ? Array.from(byName) : [];
     }
 
     findClientByName(name: string): Client | undefined {
-        for (const client of this._clients) {
-            if (client.window.ewmhName === name) {
-                return client;
-            } else if (client.window.wmName === name) {
-                return client;
-            }
-        }
+        const byName = this._clientsByName.get(name);
+        if (byName && byName.size)
+            return byName.values().next().value;
         return undefined;
     }
 
     findClientByPosition(x: number, y: number): Client | undefined {
+        // the spatial index knows the topmost mapped frame, that's the
+        // answer unless it's something that doesn't live on a workspace
+        const frame = this._spatial.windowAt(x, y);
+        if (frame) {
+            const client = this._clientsByFrame.get(frame);
+            if (client && client.workspace && !client.ignoreWorkspace) {
+                return client;
+            }
+        } else {
+            // nothing mapped there
+            return undefined;
+        }
+
         const monitor = this._monitors.monitorByPosition(x, y);
         const item = monitor.findItemByPosition(x, y, ContainerItemType.Client);
         if (item && isClient(item)) {
@@ -457,6 +611,14 @@ export class OWMLib {
     }
 
     findContainerByPosition(x: number, y: number): Container | undefined {
+        const frame = this._spatial.windowAt(x, y);
+        if (frame) {
+            const client = this._clientsByFrame.get(frame);
+            if (client && client.workspace && !client.ignoreWorkspace && client.container) {
+                return client.container;
+            }
+        }
+
         const monitor = this._monitors.monitorByPosition(x, y);
         const item = monitor.findItemByPosition(x, y, ContainerItemType.Container);
         if (item && isContainer(item)) {
@@ -473,18 +635,12 @@ export class OWMLib {
     addClient(win: XCB.Window, focus?: boolean) {
         this._log.debug("client", win);
 
-        // reparent to new window
+        // reparent to new window, this also sets up stacking and the spatial index for it
         const border = calculateBorder(win, this._xcb);
-        const parent = this._xcb.create_window(this._wm, { x: win.geometry.x, y: win.geometry.y,
-                                                         width: win.geometry.width + (border * 2),
-                                                         height: win.geometry.height + (border * 2),
-                                                         parent: win.geometry.root });
-
-        this._xcb.change_window_attributes(this._wm, { window: parent, override_redirect: 1, back_pixel: 0 });
-        // make sure we don't get an unparent notify for this window when we reparent
-        this._xcb.change_window_attributes(this._wm, { window: win.window, event_mask: 0 });
-        this._xcb.reparent_window(this._wm, { window: win.window, parent: parent, x: border, y: border });
-        this._xcb.change_save_set(this._wm, { window: win.window, mode: this._xcb.setMode.INSERT });
+        const parent = this._xcb.manage(this._wm, { window: win.window, x: win.geometry.x, y: win.geometry.y,
+                                                    width: win.geometry.width, height: win.geometry.height,
+                                                    border: border, parent: win.geometry.root });
+        this.scheduleRestack();
 
         const client = new Client(this, parent, win, border);
 
@@ -498,10 +654,9 @@ export class OWMLib {
         this._clients.push(client);
 
         this._ewmh.updateClientList();
+        this._updateClientLookup(client);
 
-        for (let m of this._matches) {
-            m.match(client);
-        }
+        this._matches.match(client);
 
         this._events.emit("client", client);
 
@@ -527,6 +682,8 @@ export class OWMLib {
     }
 
     warpPointerToClient(client: Client, x?: number, y?: number) {
+        // callers usually just moved the client somewhere
+        this.flushLayout();
         this._xcb.warp_pointer(this._wm, { dst_window: client.window.window,
                                            dst_x: x || client.geometry.width / 2,
                                            dst_y: y || client.geometry.height / 2 });
@@ -548,6 +705,42 @@ export class OWMLib {
         this._matches.delete(match);
     }
 
+    private _updateClientLookup(client: Client) {
+        const window = client.window;
+        const keys = {
+            class: window.wmClass.class_name,
+            instance: window.wmClass.instance_name,
+            names: [window.ewmhName, window.wmName]
+        };
+        const old = this._clientLookupKeys.get(client);
+        if (old) {
+            if (old.class === keys.class && old.instance === keys.instance
+                && old.names[0] === keys.names[0] && old.names[1] === keys.names[1])
+                return;
+            this._removeClientLookup(client);
+        }
+        // class and names are published
+        this._ipc.invalidate();
+        this._clientLookupKeys.set(client, keys);
+        addToLookup(this._clientsByClass, keys.class, client);
+        addToLookup(this._clientsByInstance, keys.instance, client);
+        for (const name of keys.names) {
+            addToLookup(this._clientsByName, name, client);
+        }
+    }
+
+    private _removeClientLookup(client: Client) {
+        const keys = this._clientLookupKeys.get(client);
+        if (!keys)
+            return;
+        this._clientLookupKeys.delete(client);
+        removeFromLookup(this._clientsByClass, keys.class, client);
+        removeFromLookup(this._clientsByInstance, keys.instance, client);
+        for (const name of keys.names) {
+            removeFromLookup(this._clientsByName, name, client);
+        }
+    }
+
     updateScreens(screens: OWM.Screens) {
         this._log.info("screens", screens);
         this._root = screens.root;
@@ -557,9 +750,14 @@ export class OWMLib {
         const events = this._xcb.eventMask.BUTTON_PRESS | this._xcb.eventMask.BUTTON_RELEASE;
         const syncMode = this._xcb.grabMode.SYNC;
         const asyncMode = this._xcb.grabMode.ASYNC;
-        this._xcb.grab_button(this._wm, { window: this._root, modifiers: 0,
-                                          button: 1, owner_events: 1, event_mask: events,
-                                          pointer_mode: syncMode, keyboard_mode: asyncMode });
+        // passive grabs match modifiers exactly, CapsLock and NumLock are
+        // latched and shouldn't take a click away from the focus policy
+        const mask = this._xcb.modMask;
+        for (const locks of [0, mask.LOCK, mask["2"], mask.LOCK | mask["2"]]) {
+            this._xcb.grab_button(this._wm, { window: this._root, modifiers: locks,
+                                              button: 1, owner_events: 1, event_mask: events,
+                                              pointer_mode: syncMode, keyboard_mode: asyncMode });
+        }
     }
 
     mapRequest(event: XCB.MapRequest) {
@@ -606,8 +804,24 @@ export class OWMLib {
         const client = this.findClient(event.window);
         if (client) {
             client.configure(cfg);
-        } else {
-            this._xcb.configure_window(this._wm, cfg);
+        } else if (!this._xcb.configure_window(this._wm, cfg)) {
+            // nothing changed so the server won't say anything, the client
+            // may well be waiting to hear back though
+            const win = this._tree.window(event.window);
+            if (win) {
+                this._xcb.send_configure_notify(this._wm, { window: event.window, x: win.x, y: win.y,
+                                                            width: win.width, height: win.height,
+                                                            border_width: win.border_width });
+            }
+        }
+    }
+
+    handleConfigured(configured: Layout.Configured[]) {
+        for (const cfg of configured) {
+            const client = this._clientsByWindow.get(cfg.window);
+            if (client) {
+                client.nativeConfigured(cfg);
+            }
         }
     }
 
@@ -719,9 +933,7 @@ export class OWMLib {
                             client.staysOnTop = true;
                         else if (u32[0] === action.TOGGLE)
                             client.staysOnTop = !client.staysOnTop;
-                        for (let m of this._matches) {
-                            m.match(client);
-                        }
+                        this._matches.match(client);
                     }
                 }
             }
@@ -829,17 +1041,26 @@ export class OWMLib {
 
     propertyNotify(event: XCB.PropertyNotify) {
         this._log.info("property", event);
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         const client = this._clientsByWindow.get(event.window);
         if (!client)
             return;
 
         client.updateProperty(event.atom, event.state === this._xcb.propState.NEW_VALUE);
+
+        const atom = this._xcb.atom;
+        switch (event.atom) {
+        case atom.WM_CLASS:
+        case atom.WM_NAME:
+        case atom._NET_WM_NAME:
+            this._updateClientLookup(client);
+            break;
+        }
     }
 
     buttonPress(event: XCB.ButtonPress) {
         this._log.info("press", event);
-        this._currentTime = event.time;
+        this._updateTime(event.time);
 
         // if this is our modifier grab, process that
         if (event.state === this._moveModifierMask) {
@@ -861,14 +1082,23 @@ export class OWMLib {
                 this._resizeClient(client, event);
             }
         } else {
-            this._xcb.allow_events(this._wm, { mode: this._xcb.allow.REPLAY_POINTER, time: event.time });
+            if (event.focused === undefined) {
+                this._xcb.allow_events(this._wm, { mode: this._xcb.allow.REPLAY_POINTER, time: event.time });
+            } else {
+                // replayed and focused natively already, catch up before
+                // the policy sees it
+                const client = this._clientsByWindow.get(event.focused);
+                if (client) {
+                    client.focus(true);
+                }
+            }
             this._policy.buttonPress(event);
         }
     }
 
     buttonRelease(event: XCB.ButtonPress) {
         this._log.info("release", event);
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         if (this._moveResize.moving) {
             this._moveResizeMode.exit();
 
@@ -907,7 +1137,7 @@ export class OWMLib {
 
     motionNotify(event: XCB.MotionNotify) {
         this._log.info("motion", event);
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         if (this._moveResize.moving) {
             // move
             this._moveResize.moving.client.move(this._moveResize.moving.x + event.root_x, this._moveResize.moving.y + event.root_y);
@@ -935,23 +1165,23 @@ export class OWMLib {
     }
 
     keyPress(event: XCB.KeyPress) {
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         this._policy.keyPress(event);
         this._bindings.feed(event);
     }
 
     keyRelease(event: XCB.KeyPress) {
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         this._policy.keyRelease(event);
     }
 
     enterNotify(event: XCB.EnterNotify) {
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         this._policy.enterNotify(event);
     }
 
     leaveNotify(event: XCB.EnterNotify) {
-        this._currentTime = event.time;
+        this._updateTime(event.time);
         this._policy.leaveNotify(event);
     }
 
@@ -980,6 +1210,7 @@ export class OWMLib {
         }
 
         this._focused = client;
+        this._xcb.set_focused_frame(this._wm, client.frame);
 
         this._focused.framePixel = this._activeColor;
         this._xcb.send_expose(this._wm, { window: this._focused.frame, width: this._focused.frameWidth, height: this._focused.frameHeight });
@@ -1005,11 +1236,10 @@ export class OWMLib {
             return;
         }
 
-        // revert focus to root window
-        this._focused.framePixel = this._inactiveColor;
-        this._xcb.send_expose(this._wm, { window: this._focused.frame, width: this._focused.frameWidth, height: this._focused.frameHeight });
-
+        // revert focus to root window, a destroyed client's frame is already gone
         if (!fromDestroy) {
+            this._focused.framePixel = this._inactiveColor;
+            this._xcb.send_expose(this._wm, { window: this._focused.frame, width: this._focused.frameWidth, height: this._focused.frameHeight });
             this._ewmh.removeStateFocused(this._focused);
         }
 
@@ -1017,6 +1247,7 @@ export class OWMLib {
 
         const root = this._focused.root;
         this._focused = undefined;
+        this._xcb.set_focused_frame(this._wm, 0);
 
         this._xcb.set_input_focus(this._wm, { window: root, revert_to: this._xcb.inputFocus.NONE, time: this.currentTime });
 
@@ -1035,6 +1266,170 @@ export class OWMLib {
         this._monitors.relayout();
     }
 
+    // Containers don't lay themselves out right away, they get marked dirty
+    // here and every dirty container runs once after the current batch of X
+    // events has been handled. A single map can otherwise end up laying out
+    // the same workspace several times over.
+    scheduleRelayout(container: Container) {
+        ++this._layoutStats.requested;
+        if (this._dirtyContainers.has(container)) {
+            ++this._layoutStats.saved;
+            return;
+        }
+        this._dirtyContainers.add(container);
+        if (!this._layoutScheduled) {
+            this._layoutScheduled = true;
+            setImmediate(() => {
+                this._layoutScheduled = false;
+                this.flushLayout();
+            });
+        }
+    }
+
+    // Run pending layouts now, for callers that need the resulting geometry
+    // right away.
+    flushLayout() {
+        const performed = this._layoutStats.performed;
+        // laying out a container resizes its nested containers which
+        // marks those dirty in turn, keep going until nothing is left but
+        // don't spin forever on a layout that keeps invalidating itself
+        for (let round = 0; round < 16 && this._dirtyContainers.size > 0; ++round) {
+            const dirty = Array.from(this._dirtyContainers);
+            this._dirtyContainers.clear();
+            for (const container of dirty) {
+                if (!container.workspace.active) {
+                    // nobody would see the result, and configuring the
+                    // clients would only make them repaint for nothing
+                    if (!this._deferredContainers.has(container)) {
+                        this._deferredContainers.add(container);
+                        ++this._layoutStats.deferred;
+                    }
+                    continue;
+                }
+                ++this._layoutStats.performed;
+                container.layout();
+            }
+        }
+        if (this._dirtyContainers.size > 0) {
+            this._log.error("layout did not settle, giving up on", this._dirtyContainers.size, "containers");
+            this._dirtyContainers.clear();
+        }
+        if (performed !== this._layoutStats.performed) {
+            // geometry is part of the published client state
+            this._ipc.invalidate();
+        }
+    }
+
+    // Bring the layout of a workspace that's about to become visible up to
+    // date, before its clients get mapped.
+    applyDeferredLayout(ws: Workspace) {
+        let pending = false;
+        for (const container of this._deferredContainers) {
+            if (container.workspace === ws) {
+                this._deferredContainers.delete(container);
+                this._dirtyContainers.add(container);
+                pending = true;
+            }
+        }
+        if (pending) {
+            this.flushLayout();
+        }
+    }
+
+    // Drop pending and deferred layouts of a container that's going away,
+    // along with everything nested in it.
+    forgetLayout(container: Container) {
+        const within = (c: Container) => {
+            for (let p: Container | undefined = c; p; p = p.container) {
+                if (p === container)
+                    return true;
+            }
+            return false;
+        };
+        for (const c of this._dirtyContainers) {
+            if (within(c))
+                this._dirtyContainers.delete(c);
+        }
+        for (const c of this._deferredContainers) {
+            if (within(c))
+                this._deferredContainers.delete(c);
+        }
+    }
+
+    // Frames are restacked in the native stacking model, the server only gets
+    // to see the net result once the current batch of events is done.
+    scheduleRestack() {
+        if (this._restackScheduled)
+            return;
+        this._restackScheduled = true;
+        setImmediate(() => {
+            this._restackScheduled = false;
+            this._stacking.commit(this._wm);
+        });
+    }
+
+    // Client state changes made inside fn are sent to the server in one go
+    // once it returns, a workspace switch is a single native call no matter
+    // how many clients it shows or hides.
+    batchStates(fn: () => void) {
+        if (this._stateBatch) {
+            fn();
+            return;
+        }
+        const batch = this._stateBatch = new Set<Client>();
+        try {
+            fn();
+        } finally {
+            this._stateBatch = undefined;
+            this._commitStates(batch);
+        }
+    }
+
+    queueState(client: Client) {
+        if (this._stateBatch) {
+            this._stateBatch.add(client);
+            return;
+        }
+        this._commitStates([ client ]);
+    }
+
+    private _commitStates(clients: Iterable<Client>) {
+        // clients are mapped at the geometry packed below, a new tiled client
+        // would otherwise show up at its old spot until the layout catches up
+        if (this._dirtyContainers.size > 0) {
+            this.flushLayout();
+        }
+
+        const stride = this._xcb.clientState.entry.Stride;
+        let count = 0;
+        for (const client of clients) {
+            if ((count + 1) * stride > this._stateEntries.length) {
+                const entries = new Int32Array(this._stateEntries.length * 2);
+                entries.set(this._stateEntries);
+                this._stateEntries = entries;
+            }
+            client.packState(this._stateEntries, count * stride);
+            ++count;
+        }
+        if (!count)
+            return;
+        this._xcb.set_states(this._wm, this._stateEntries, this._hideStrategy, count);
+
+        // unmapping the focused client reverts focus in the server, one that's
+        // only been moved away still has it
+        if (this._focused && !this._focused.visible && this._hideStrategy === this._xcb.clientState.hide.Offscreen) {
+            this.revertFocus();
+        }
+    }
+
+    get layoutStats() {
+        return this._layoutStats;
+    }
+
+    resetLayoutStats() {
+        this._layoutStats = { requested: 0, performed: 0, saved: 0, deferred: 0 };
+    }
+
     recreateKeyBindings() {
         this._bindings.recreate();
         this._moveResizeMode.recreate();
@@ -1109,6 +1504,7 @@ export class OWMLib {
 
     cleanup() {
         this._notifications.cleanup();
+        this._ipc.close();
         for (const client of this._clients) {
             const window = ((client as unknown) as ClientInternal)._window.window;
             this._xcb.change_window_attributes(this._wm, { window: window, event_mask: 0 });
@@ -1184,6 +1580,34 @@ export class OWMLib {
         }
     }
 
+    // Only what Client.updateProperty actually looks at goes to js, titles at
+    // most every 100ms. Everything else, _NET_WM_USER_TIME and friends, is
+    // counted natively and dropped.
+    private _initPropertyNotify() {
+        const atom = this._xcb.atom;
+        const policy = this._property.notifyPolicy;
+
+        this._property.setDefaultNotifyPolicy(policy.Absorb);
+
+        const deliver = [
+            atom.WM_HINTS, atom.WM_NORMAL_HINTS, atom.WM_CLIENT_LEADER, atom.WM_TRANSIENT_FOR,
+            atom.WM_WINDOW_ROLE, atom.WM_CLASS, atom._NET_WM_STRUT, atom._NET_WM_STRUT_PARTIAL,
+            atom._NET_WM_WINDOW_TYPE, atom._NET_WM_ICON
+        ];
+        for (const a of deliver) {
+            this._property.setNotifyPolicy({ atom: a, policy: policy.Deliver });
+        }
+        for (const a of [ atom.WM_NAME, atom._NET_WM_NAME ]) {
+            this._property.setNotifyPolicy({ atom: a, policy: policy.Coalesce, delay: 100 });
+        }
+    }
+
+    private _propertyNotifyStats() {
+        return this._property.notifyStats().map(s => {
+            return Object.assign({ name: this._xcb.get_atom_name(this._wm, s.atom) }, s);
+        });
+    }
+
     private _grabPointer(time: number) {
         const events = this._xcb.eventMask.BUTTON_RELEASE | this._xcb.eventMask.POINTER_MOTION;
         const asyncMode = this._xcb.grabMode.ASYNC;
@@ -1267,6 +1691,12 @@ export class OWMLib {
 
         this._clientsByWindow.delete(window);
         this._clientsByFrame.delete(client.frame);
+        this._removeClientLookup(client);
+        // the frame has to be out of the way before we look for something
+        // else to focus below
+        this._xcb.unmanage(this._wm, { window: window, frame: client.frame, parent: client.root,
+                                       gc: client.frameGC, destroyed: !unmap });
+        this.scheduleRestack();
         const ws = client.workspace;
         if (ws) {
             ws.removeItem(client);
@@ -1278,22 +1708,22 @@ export class OWMLib {
             this.revertFocus(true);
         }
 
-        this._xcb.change_window_attributes(this._wm, { window: window, event_mask: 0 });
-        this._xcb.unmap_window(this._wm, client.frame);
-        this._xcb.reparent_window(this._wm, { window: window, parent: client.root, x: 0, y: 0 });
-        const gc = client.frameGC;
-        if (gc !== undefined) {
-            this._xcb.free_gc(this._wm, gc)
-        }
-        this._xcb.destroy_window(this._wm, client.frame);
-
-        this._xcb.change_save_set(this._wm, { window: window, mode: this._xcb.setMode.DELETE });
-
         if (client.ignoreWorkspace) {
             this.relayout();
         }
     }
 
+    // Events don't necessarily arrive in server time order, coalesced property
+    // notifies come out late and the event pump reorders. Only ever move
+    // forward, X time is 32 bit milliseconds and wraps
+    private _updateTime(time: number) {
+        if (time === 0)
+            return;
+        if (this._currentTime === 0 || ((time - this._currentTime) >>> 0) < 0x80000000) {
+            this._currentTime = time;
+        }
+    }
+
     private _parseMoveModifier(mod: string) {
         const mask = this._xcb.modMask;
         switch (mod.toLowerCase()) {
@@ -6,9 +6,26 @@ import { XCB } from "native";
 export class FocusFollowsMousePolicy implements FocusPolicy
 {
     private _policy: Policy;
+    private _suppressLayoutCrossings: boolean;
 
     constructor(policy: Policy) {
         this._policy = policy;
+        this._suppressLayoutCrossings = true;
+    }
+
+    get focusOnClick() {
+        return true;
+    }
+
+    get suppressLayoutCrossings() {
+        return this._suppressLayoutCrossings;
+    }
+
+    set suppressLayoutCrossings(suppress: boolean) {
+        this._suppressLayoutCrossings = suppress;
+        if (this._policy.focus === this) {
+            this._policy.updateCrossingFilter();
+        }
     }
 
     buttonPress(event: XCB.ButtonPress) {
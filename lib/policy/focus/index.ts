@@ -3,6 +3,13 @@ import { Policy } from "..";
 
 export interface FocusPolicy
 {
+    // drop EnterNotify events caused by owm moving, mapping or restacking
+    // windows under the pointer rather than by the pointer moving
+    readonly suppressLayoutCrossings?: boolean;
+    // a button press on a client focuses it, owm can then do that natively
+    // before js even sees the click
+    readonly focusOnClick?: boolean;
+
     buttonPress(event: XCB.ButtonPress): void;
     buttonRelease(event: XCB.ButtonPress): void;
     keyPress(event: XCB.KeyPress): void;
@@ -19,6 +19,8 @@ export class Policy
         this._focus = new FocusFollowsMousePolicy(this);
         this._layoutConstructor = TilingLayoutPolicy;
         this._layoutConfig = new TilingLayoutConfig();
+        this.updateCrossingFilter();
+        this.updateClickFocus();
     }
 
     get owm() {
@@ -31,6 +33,16 @@ export class Policy
 
     set focus(arg: FocusPolicy) {
         this._focus = arg;
+        this.updateCrossingFilter();
+        this.updateClickFocus();
+    }
+
+    updateCrossingFilter() {
+        this._owm.layout.setCrossingFilter(!!this._focus.suppressLayoutCrossings);
+    }
+
+    updateClickFocus() {
+        this._owm.xcb.set_click_focus_enabled(this._owm.wm, !!this._focus.focusOnClick);
     }
 
     get layoutConfig() {
@@ -2,6 +2,8 @@ import { ContainerItem } from "../../container";
 import { Geometry } from "../../utils";
 import { Policy } from "..";
 import { Workspace } from "../../workspace";
+import { OWMLib } from "../../owm";
+import { isClient } from "../../client";
 
 export interface LayoutConfig
 {
@@ -20,3 +22,48 @@ export interface LayoutPolicy
 
 export type LayoutPolicyConstructor = { new(policy: Policy, ws: Workspace, cfg: LayoutConfig): LayoutPolicy };
 export type LayoutConfigConstructor = { new(): LayoutConfig };
+
+// Lays out items in a rows x columns grid in a single call to the native
+// layout kernel, which also applies the clients' size hints. The resulting
+// geometries go out as one batch of configures. Nested containers and clients
+// that aren't part of the workspace just get their cell and move themselves.
+export function layoutGrid(owm: OWMLib, items: ContainerItem[], geometry: Geometry, rows: number, columns: number,
+                           rowRatios?: Float64Array, columnRatios?: Float64Array) {
+    const layout = owm.layout;
+    const hint = layout.hint;
+    const result = layout.result;
+
+    const hints = new Int32Array(items.length * hint.Stride);
+    const native: boolean[] = [];
+    for (let no = 0; no < items.length; ++no) {
+        const item = items[no];
+        if (isClient(item) && !item.ignoreWorkspace) {
+            item.packLayoutHints(hints, no * hint.Stride);
+            native.push(true);
+        } else {
+            hints[(no * hint.Stride) + hint.ItemFlags] = layout.itemFlag.Plain;
+            native.push(false);
+        }
+    }
+
+    const results = layout.tile({
+        x: geometry.x, y: geometry.y, width: geometry.width, height: geometry.height,
+        rows: rows, columns: columns, rowRatios: rowRatios, columnRatios: columnRatios,
+        hints: hints, count: items.length
+    });
+
+    const windows = new Uint32Array(items.length * 2);
+    for (let no = 0; no < items.length; ++no) {
+        const item = items[no];
+        const off = no * result.Stride;
+        if (native[no] && isClient(item)) {
+            item.applyLayout(results, off);
+            windows[no * 2] = item.frame;
+            windows[(no * 2) + 1] = item.window.window;
+        } else {
+            item.move(results[off + result.FrameX], results[off + result.FrameY]);
+            item.resize(results[off + result.FrameWidth], results[off + result.FrameHeight]);
+        }
+    }
+    layout.configure(owm.wm, windows, results);
+}
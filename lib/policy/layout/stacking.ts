@@ -1,7 +1,7 @@
 import { Client, isClient as itemIsClient } from "../../client";
 import { Workspace, Monitor, Geometry, Logger, ContainerItem } from "../..";
 import { Graphics } from "../../../native";
-import { LayoutPolicy, LayoutConfig } from ".";
+import { LayoutPolicy, LayoutConfig, layoutGrid } from ".";
 import { Policy } from "..";
 import { default as hexRgb } from "hex-rgb";
 
@@ -210,8 +210,7 @@ export class StackingLayoutPolicy implements LayoutPolicy
         // top item gets it all
         const item = filtered[filtered.length - 1];
         item.raise();
-        item.move(newgeom.x, newgeom.y);
-        item.resize(newgeom.width, newgeom.height);
+        layoutGrid(this._policy.owm, [item], newgeom, 1, 1);
     }
 
     initialize() {
@@ -1,9 +1,8 @@
 import { ContainerItem } from "../../container";
 import { Geometry } from "../../utils";
 import { Logger } from "../../logger";
-import { Client } from "../../client";
 import { Workspace } from "../../workspace";
-import { LayoutPolicy, LayoutConfig } from ".";
+import { LayoutPolicy, LayoutConfig, layoutGrid } from ".";
 import { Policy } from "..";
 
 export class TilingLayoutConfig implements LayoutConfig
@@ -136,40 +135,18 @@ export class TilingLayoutPolicy implements LayoutPolicy
             columns = filtered.length;
         }
 
-        const wper = geometry.width / columns;
-        const hper = geometry.height / rows;
+        this._log.info("calculated", rows, columns, geometry);
 
-        let itemno = 0;
-
-        const setItemGeometry = (no: number, x: number, y: number, w: number, h: number) => {
-            if (no >= filtered.length)
-                return;
-            const item = filtered[no];
-            item.move(x, y);
-            item.resize(w, h);
-        };
-
-        this._log.info("calculated", rows, columns, wper, hper, geometry);
-
-        let y = geometry.y;
-        let h = hper;
+        const rowRatios = new Float64Array(rows);
         for (let row = 0; row < rows; ++row) {
-            if (row === rows - 1) {
-                // take up the remaining space
-                h = (geometry.y + geometry.height) - y;
-            }
-            let x = geometry.x;
-            let w = wper;
-            for (let column = 0; column < columns; ++column) {
-                if (column === columns - 1) {
-                    // take up the remaining space
-                    w = (geometry.x + geometry.width) - x;
-                }
-                setItemGeometry(itemno++, x, y, w * this._cfg.columnRatio(column), h * this._cfg.rowRatio(row));
-                x += w * this._cfg.columnRatio(column);
-            }
-            y += h * this._cfg.rowRatio(row);
+            rowRatios[row] = this._cfg.rowRatio(row);
         }
+        const columnRatios = new Float64Array(columns);
+        for (let column = 0; column < columns; ++column) {
+            columnRatios[column] = this._cfg.columnRatio(column);
+        }
+
+        layoutGrid(this._policy.owm, filtered, geometry, rows, columns, rowRatios, columnRatios);
     }
 
     initialize() {
@@ -215,6 +215,7 @@ export class Workspaces
         if (old) {
             old.monitor = undefined;
             this._workspaces.delete(old);
+            this._owm.forgetLayout(old.container);
 
             this._owm.ewmh.updateWorkspaces();
             this._owm.ewmh.updateWorkarea();
@@ -229,6 +230,7 @@ export class Workspaces
         if (old) {
             old.monitor = undefined;
             this._workspaces.delete(old);
+            this._owm.forgetLayout(old.container);
 
             this._owm.ewmh.updateWorkspaces();
             this._owm.ewmh.updateWorkarea();
@@ -17,7 +17,15 @@
 	    "libxcb-errors/src/xcb_errors.c",
 	    "cppsrc/main.cc",
 	    "cppsrc/owm.cc",
-	    "cppsrc/graphics.cc"
+	    "cppsrc/graphics.cc",
+	    "cppsrc/compositor.cc",
+	    "cppsrc/layout.cc",
+	    "cppsrc/spatial.cc",
+	    "cppsrc/stacking.cc",
+	    "cppsrc/property.cc",
+	    "cppsrc/ipc.cc",
+	    "cppsrc/snapshot.cc",
+	    "cppsrc/tree.cc"
 	],
 	'include_dirs': [
 	    "libxcb-errors/include",
@@ -34,8 +42,14 @@
 	    "-lxcb-xkb",
 	    "-lxcb-keysyms",
 	    "-lxcb-randr",
+	    "-lxcb-shm",
+	    "-lxcb-composite",
+	    "-lxcb-damage",
+	    "-lxcb-xfixes",
+	    "-lxcb-render",
 	    "-lxkbcommon",
 	    "-lxkbcommon-x11",
+	    "-lrt",
 	    "<!@(pkg-config pixman-1 --libs)",
 	    "<!@(pkg-config cairo --libs)",
 	    "<!@(pkg-config libpng --libs)",
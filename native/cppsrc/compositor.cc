@@ -0,0 +1,919 @@
+#include "compositor.h"
+#include "owm.h"
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include <xcb/xfixes.h>
+#include <xcb/render.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <unordered_set>
+
+template<typename T>
+using Wrap = owm::Wrap<T>;
+using WM = owm::WM;
+
+namespace compositor {
+
+// The compositor runs on a connection of its own, polled from the same loop
+// as the main one. Selecting SubstructureNotify on the root and receiving
+// damage events there would otherwise feed a stream of events to JS that it
+// has no use for, and some of them (unmaps reported on the root) it would
+// misinterpret.
+
+struct Window
+{
+    xcb_window_t window;
+    int16_t x, y;
+    uint16_t width, height, border;
+    bool mapped, inputOnly, alpha;
+    xcb_render_pictformat_t format;
+    xcb_damage_damage_t damage;
+    xcb_pixmap_t pixmap;
+    xcb_render_picture_t picture;
+
+    uint16_t outerWidth() const { return width + (border * 2); }
+    uint16_t outerHeight() const { return height + (border * 2); }
+};
+
+struct Stats
+{
+    uint64_t frames { 0 };
+    uint64_t damageEvents { 0 };
+    uint64_t unredirects { 0 };
+    uint64_t totalRepaintUs { 0 };
+    uint64_t lastRepaintUs { 0 };
+    uint64_t maxRepaintUs { 0 };
+    uint32_t lastPainted { 0 };
+};
+
+struct State
+{
+    std::weak_ptr<WM> wm;
+    xcb_connection_t* conn { nullptr };
+    xcb_screen_t* screen { nullptr };
+    xcb_window_t root { XCB_NONE };
+    xcb_window_t overlay { XCB_NONE };
+    xcb_window_t cmWindow { XCB_NONE };
+    xcb_atom_t cmAtom { XCB_NONE };
+    uint8_t damageEvent { 0 };
+    uv_poll_t* poll { nullptr };
+
+    uint16_t width { 0 }, height { 0 };
+    xcb_render_pictformat_t rootFormat { 0 };
+    xcb_pixmap_t bufferPixmap { XCB_NONE };
+    xcb_render_picture_t bufferPicture { XCB_NONE };
+    xcb_render_picture_t overlayPicture { XCB_NONE };
+    xcb_render_color_t background { 0, 0, 0, 0xffff };
+
+    // accumulated damage in root coordinates, cleared on every repaint
+    xcb_xfixes_region_t dirty { XCB_NONE };
+    bool damaged { false };
+
+    std::unordered_map<xcb_visualid_t, xcb_render_pictformat_t> formats;
+    std::unordered_set<xcb_render_pictformat_t> alphaFormats;
+
+    // bottom to top
+    std::vector<std::unique_ptr<Window> > stack;
+    // a window was stacked above one we don't track, the order gets
+    // re-read from the server before the next repaint
+    bool stale { false };
+
+    bool redirected { false };
+    bool unredirectFullscreen { true };
+    bool sync { false };
+    Stats stats;
+};
+
+static std::unique_ptr<State> state;
+
+static void disable();
+
+static std::vector<std::unique_ptr<Window> >::iterator find_window(xcb_window_t window)
+{
+    return std::find_if(state->stack.begin(), state->stack.end(), [window](const std::unique_ptr<Window>& w) {
+        return w->window == window;
+    });
+}
+
+static void damage_rect(int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+    const xcb_rectangle_t rect = { x, y, width, height };
+    const xcb_xfixes_region_t region = xcb_generate_id(state->conn);
+    xcb_xfixes_create_region(state->conn, region, 1, &rect);
+    xcb_xfixes_union_region(state->conn, state->dirty, region, state->dirty);
+    xcb_xfixes_destroy_region(state->conn, region);
+    state->damaged = true;
+}
+
+static inline void damage_window(const Window* w)
+{
+    damage_rect(w->x, w->y, w->outerWidth(), w->outerHeight());
+}
+
+static inline void damage_screen()
+{
+    damage_rect(0, 0, state->width, state->height);
+}
+
+static void release_picture(Window* w)
+{
+    if (w->picture) {
+        xcb_render_free_picture(state->conn, w->picture);
+        w->picture = XCB_NONE;
+    }
+    if (w->pixmap) {
+        xcb_free_pixmap(state->conn, w->pixmap);
+        w->pixmap = XCB_NONE;
+    }
+}
+
+static bool ensure_picture(Window* w)
+{
+    if (w->picture)
+        return true;
+    if (!w->format)
+        return false;
+
+    // the named pixmap goes stale whenever the window is resized or remapped,
+    // errors from racing against an unmap come back as events and are ignored
+    w->pixmap = xcb_generate_id(state->conn);
+    xcb_composite_name_window_pixmap(state->conn, w->window, w->pixmap);
+
+    const uint32_t values[] = { XCB_SUBWINDOW_MODE_INCLUDE_INFERIORS };
+    w->picture = xcb_generate_id(state->conn);
+    xcb_render_create_picture(state->conn, w->picture, w->pixmap, w->format, XCB_RENDER_CP_SUBWINDOW_MODE, values);
+    return true;
+}
+
+static void map_window(Window* w)
+{
+    w->mapped = true;
+    if (w->inputOnly)
+        return;
+    if (!w->damage) {
+        w->damage = xcb_generate_id(state->conn);
+        xcb_damage_create(state->conn, w->damage, w->window, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    }
+    release_picture(w);
+    damage_window(w);
+}
+
+static void unmap_window(Window* w)
+{
+    if (!w->mapped)
+        return;
+    w->mapped = false;
+    if (w->inputOnly)
+        return;
+    if (w->damage) {
+        xcb_damage_destroy(state->conn, w->damage);
+        w->damage = XCB_NONE;
+    }
+    release_picture(w);
+    damage_window(w);
+}
+
+static void add_window(xcb_window_t window, xcb_window_t above)
+{
+    if (window == state->overlay || window == state->cmWindow || find_window(window) != state->stack.end())
+        return;
+
+    auto attribCookie = xcb_get_window_attributes_unchecked(state->conn, window);
+    auto geomCookie = xcb_get_geometry_unchecked(state->conn, window);
+    auto attrib = xcb_get_window_attributes_reply(state->conn, attribCookie, nullptr);
+    auto geom = xcb_get_geometry_reply(state->conn, geomCookie, nullptr);
+    if (!attrib || !geom) {
+        // already gone
+        free(attrib);
+        free(geom);
+        return;
+    }
+
+    std::unique_ptr<Window> w(new Window);
+    w->window = window;
+    w->x = geom->x;
+    w->y = geom->y;
+    w->width = geom->width;
+    w->height = geom->height;
+    w->border = geom->border_width;
+    w->mapped = false;
+    w->inputOnly = attrib->_class == XCB_WINDOW_CLASS_INPUT_ONLY;
+    w->damage = XCB_NONE;
+    w->pixmap = XCB_NONE;
+    w->picture = XCB_NONE;
+
+    const auto format = state->formats.find(attrib->visual);
+    w->format = format != state->formats.end() ? format->second : 0;
+    w->alpha = w->format && state->alphaFormats.count(w->format) > 0;
+
+    const bool viewable = attrib->map_state == XCB_MAP_STATE_VIEWABLE;
+    free(attrib);
+    free(geom);
+
+    Window* ptr = w.get();
+    if (above == XCB_NONE) {
+        state->stack.insert(state->stack.begin(), std::move(w));
+    } else {
+        auto it = find_window(above);
+        if (it == state->stack.end()) {
+            state->stack.push_back(std::move(w));
+            state->stale = true;
+        } else {
+            state->stack.insert(it + 1, std::move(w));
+        }
+    }
+
+    if (viewable) {
+        map_window(ptr);
+    }
+}
+
+static void remove_window(xcb_window_t window, bool destroyed)
+{
+    auto it = find_window(window);
+    if (it == state->stack.end())
+        return;
+    Window* w = it->get();
+    if (w->mapped && !w->inputOnly) {
+        damage_window(w);
+    }
+    // a destroyed window takes its damage object with it
+    if (w->damage && !destroyed) {
+        xcb_damage_destroy(state->conn, w->damage);
+    }
+    release_picture(w);
+    state->stack.erase(it);
+}
+
+static void restack_window(xcb_window_t window, xcb_window_t above)
+{
+    auto it = find_window(window);
+    if (it == state->stack.end())
+        return;
+    std::unique_ptr<Window> w = std::move(*it);
+    state->stack.erase(it);
+
+    if (above == XCB_NONE) {
+        state->stack.insert(state->stack.begin(), std::move(w));
+        return;
+    }
+    auto sibling = find_window(above);
+    if (sibling == state->stack.end()) {
+        state->stack.push_back(std::move(w));
+        state->stale = true;
+    } else {
+        state->stack.insert(sibling + 1, std::move(w));
+    }
+}
+
+static bool create_buffer()
+{
+    auto conn = state->conn;
+
+    if (state->bufferPicture) {
+        xcb_render_free_picture(conn, state->bufferPicture);
+    }
+    if (state->bufferPixmap) {
+        xcb_free_pixmap(conn, state->bufferPixmap);
+    }
+
+    state->bufferPixmap = xcb_generate_id(conn);
+    xcb_create_pixmap(conn, state->screen->root_depth, state->bufferPixmap, state->root, state->width, state->height);
+    state->bufferPicture = xcb_generate_id(conn);
+    xcb_render_create_picture(conn, state->bufferPicture, state->bufferPixmap, state->rootFormat, 0, nullptr);
+    return true;
+}
+
+// a fullscreen, opaque window on top gets to draw straight to the screen,
+// there's nothing to composite and going through us would only cost a copy
+static void update_redirect()
+{
+    bool fullscreen = false;
+    if (state->unredirectFullscreen) {
+        for (auto it = state->stack.rbegin(); it != state->stack.rend(); ++it) {
+            const Window* w = it->get();
+            if (!w->mapped || w->inputOnly)
+                continue;
+            fullscreen = !w->alpha && w->x <= 0 && w->y <= 0
+                && w->x + w->outerWidth() >= state->width
+                && w->y + w->outerHeight() >= state->height;
+            break;
+        }
+    }
+
+    if (fullscreen && state->redirected) {
+        xcb_composite_unredirect_subwindows(state->conn, state->root, XCB_COMPOSITE_REDIRECT_MANUAL);
+        xcb_unmap_window(state->conn, state->overlay);
+        for (auto& w : state->stack) {
+            release_picture(w.get());
+        }
+        state->redirected = false;
+        ++state->stats.unredirects;
+    } else if (!fullscreen && !state->redirected) {
+        xcb_composite_redirect_subwindows(state->conn, state->root, XCB_COMPOSITE_REDIRECT_MANUAL);
+        xcb_map_window(state->conn, state->overlay);
+        state->redirected = true;
+        damage_screen();
+    }
+}
+
+static void resync_stack()
+{
+    state->stale = false;
+
+    auto cookie = xcb_query_tree(state->conn, state->root);
+    auto tree = xcb_query_tree_reply(state->conn, cookie, nullptr);
+    if (!tree)
+        return;
+
+    // children come bottom to top, anything the server no longer knows
+    // about stays on top until its DestroyNotify arrives
+    std::unordered_map<xcb_window_t, int> order;
+    const auto children = xcb_query_tree_children(tree);
+    for (int i = 0; i < tree->children_len; ++i) {
+        order[children[i]] = i;
+    }
+    free(tree);
+
+    std::stable_sort(state->stack.begin(), state->stack.end(), [&order](const std::unique_ptr<Window>& a, const std::unique_ptr<Window>& b) {
+        const auto ait = order.find(a->window);
+        const auto bit = order.find(b->window);
+        const int aidx = ait != order.end() ? ait->second : std::numeric_limits<int>::max();
+        const int bidx = bit != order.end() ? bit->second : std::numeric_limits<int>::max();
+        return aidx < bidx;
+    });
+
+    damage_screen();
+    update_redirect();
+}
+
+static void paint()
+{
+    auto conn = state->conn;
+    const auto start = std::chrono::steady_clock::now();
+    const xcb_rectangle_t screen = { 0, 0, state->width, state->height };
+
+    // what's still to be painted, shrinks as opaque windows are drawn top down
+    const xcb_xfixes_region_t region = xcb_generate_id(conn);
+    xcb_xfixes_create_region(conn, region, 0, nullptr);
+    xcb_xfixes_copy_region(conn, state->dirty, region);
+
+    struct Translucent
+    {
+        const Window* window;
+        xcb_xfixes_region_t clip;
+    };
+    std::vector<Translucent> translucent;
+    uint32_t painted = 0;
+
+    for (auto it = state->stack.rbegin(); it != state->stack.rend(); ++it) {
+        Window* w = it->get();
+        if (!w->mapped || w->inputOnly)
+            continue;
+        if (w->x >= state->width || w->y >= state->height || w->x + w->outerWidth() <= 0 || w->y + w->outerHeight() <= 0)
+            continue;
+        if (!ensure_picture(w))
+            continue;
+
+        if (w->alpha) {
+            // drawn bottom up later, over whatever ends up below
+            const xcb_xfixes_region_t clip = xcb_generate_id(conn);
+            xcb_xfixes_create_region(conn, clip, 0, nullptr);
+            xcb_xfixes_copy_region(conn, region, clip);
+            translucent.push_back({ w, clip });
+            continue;
+        }
+
+        xcb_xfixes_set_picture_clip_region(conn, state->bufferPicture, region, 0, 0);
+        xcb_render_composite(conn, XCB_RENDER_PICT_OP_SRC, w->picture, XCB_NONE, state->bufferPicture,
+                             0, 0, 0, 0, w->x, w->y, w->outerWidth(), w->outerHeight());
+        ++painted;
+
+        const xcb_rectangle_t rect = { w->x, w->y, w->outerWidth(), w->outerHeight() };
+        const xcb_xfixes_region_t covered = xcb_generate_id(conn);
+        xcb_xfixes_create_region(conn, covered, 1, &rect);
+        xcb_xfixes_subtract_region(conn, region, covered, region);
+        xcb_xfixes_destroy_region(conn, covered);
+    }
+
+    // whatever is left uncovered shows the background
+    xcb_xfixes_set_picture_clip_region(conn, state->bufferPicture, region, 0, 0);
+    xcb_render_fill_rectangles(conn, XCB_RENDER_PICT_OP_SRC, state->bufferPicture, state->background, 1, &screen);
+
+    for (auto it = translucent.rbegin(); it != translucent.rend(); ++it) {
+        const Window* w = it->window;
+        xcb_xfixes_set_picture_clip_region(conn, state->bufferPicture, it->clip, 0, 0);
+        xcb_render_composite(conn, XCB_RENDER_PICT_OP_OVER, w->picture, XCB_NONE, state->bufferPicture,
+                             0, 0, 0, 0, w->x, w->y, w->outerWidth(), w->outerHeight());
+        xcb_xfixes_destroy_region(conn, it->clip);
+        ++painted;
+    }
+
+    // only the damaged part of the back buffer goes to the screen
+    xcb_xfixes_set_picture_clip_region(conn, state->bufferPicture, XCB_NONE, 0, 0);
+    xcb_xfixes_set_picture_clip_region(conn, state->overlayPicture, state->dirty, 0, 0);
+    xcb_render_composite(conn, XCB_RENDER_PICT_OP_SRC, state->bufferPicture, XCB_NONE, state->overlayPicture,
+                         0, 0, 0, 0, 0, 0, state->width, state->height);
+
+    xcb_xfixes_destroy_region(conn, region);
+    xcb_xfixes_set_region(conn, state->dirty, 0, nullptr);
+    state->damaged = false;
+
+    if (state->sync) {
+        // wait for the server so the counters include the actual rendering
+        auto cookie = xcb_get_input_focus(conn);
+        free(xcb_get_input_focus_reply(conn, cookie, nullptr));
+    } else {
+        xcb_flush(conn);
+    }
+
+    const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    auto& stats = state->stats;
+    ++stats.frames;
+    stats.lastRepaintUs = us;
+    stats.totalRepaintUs += us;
+    stats.maxRepaintUs = std::max(stats.maxRepaintUs, us);
+    stats.lastPainted = painted;
+}
+
+static void handle_event(xcb_generic_event_t* event)
+{
+    const auto type = event->response_type & ~0x80;
+
+    if (type == state->damageEvent + XCB_DAMAGE_NOTIFY) {
+        auto notify = reinterpret_cast<xcb_damage_notify_event_t*>(event);
+        ++state->stats.damageEvents;
+        auto it = find_window(notify->drawable);
+        if (it == state->stack.end())
+            return;
+        const Window* w = it->get();
+
+        // take the damaged area, this also rearms the NON_EMPTY notification
+        const xcb_xfixes_region_t parts = xcb_generate_id(state->conn);
+        xcb_xfixes_create_region(state->conn, parts, 0, nullptr);
+        xcb_damage_subtract(state->conn, notify->damage, XCB_NONE, parts);
+        xcb_xfixes_translate_region(state->conn, parts, w->x + w->border, w->y + w->border);
+        xcb_xfixes_union_region(state->conn, state->dirty, parts, state->dirty);
+        xcb_xfixes_destroy_region(state->conn, parts);
+        state->damaged = true;
+        return;
+    }
+
+    switch (type) {
+    case XCB_CREATE_NOTIFY: {
+        auto create = reinterpret_cast<xcb_create_notify_event_t*>(event);
+        if (create->parent == state->root) {
+            // new windows go on top of the stack
+            add_window(create->window, state->stack.empty() ? XCB_NONE : state->stack.back()->window);
+        }
+        break; }
+    case XCB_DESTROY_NOTIFY: {
+        auto destroy = reinterpret_cast<xcb_destroy_notify_event_t*>(event);
+        remove_window(destroy->window, true);
+        update_redirect();
+        break; }
+    case XCB_MAP_NOTIFY: {
+        auto map = reinterpret_cast<xcb_map_notify_event_t*>(event);
+        auto it = find_window(map->window);
+        if (it != state->stack.end()) {
+            map_window(it->get());
+            update_redirect();
+        }
+        break; }
+    case XCB_UNMAP_NOTIFY: {
+        auto unmap = reinterpret_cast<xcb_unmap_notify_event_t*>(event);
+        auto it = find_window(unmap->window);
+        if (it != state->stack.end()) {
+            unmap_window(it->get());
+            update_redirect();
+        }
+        break; }
+    case XCB_REPARENT_NOTIFY: {
+        auto reparent = reinterpret_cast<xcb_reparent_notify_event_t*>(event);
+        if (reparent->parent == state->root) {
+            add_window(reparent->window, state->stack.empty() ? XCB_NONE : state->stack.back()->window);
+        } else {
+            remove_window(reparent->window, false);
+        }
+        update_redirect();
+        break; }
+    case XCB_CONFIGURE_NOTIFY: {
+        auto configure = reinterpret_cast<xcb_configure_notify_event_t*>(event);
+        if (configure->window == state->root) {
+            if (configure->width != state->width || configure->height != state->height) {
+                state->width = configure->width;
+                state->height = configure->height;
+                create_buffer();
+                damage_screen();
+            }
+            break;
+        }
+        auto it = find_window(configure->window);
+        if (it == state->stack.end())
+            break;
+        Window* w = it->get();
+        const bool visible = w->mapped && !w->inputOnly;
+        if (visible) {
+            damage_window(w);
+        }
+        if (w->width != configure->width || w->height != configure->height || w->border != configure->border_width) {
+            release_picture(w);
+        }
+        w->x = configure->x;
+        w->y = configure->y;
+        w->width = configure->width;
+        w->height = configure->height;
+        w->border = configure->border_width;
+        restack_window(configure->window, configure->above_sibling);
+        if (visible) {
+            damage_window(w);
+        }
+        update_redirect();
+        break; }
+    case XCB_CIRCULATE_NOTIFY: {
+        auto circulate = reinterpret_cast<xcb_circulate_notify_event_t*>(event);
+        auto it = find_window(circulate->window);
+        if (it == state->stack.end())
+            break;
+        std::unique_ptr<Window> w = std::move(*it);
+        state->stack.erase(it);
+        if (w->mapped && !w->inputOnly) {
+            damage_window(w.get());
+        }
+        if (circulate->place == XCB_PLACE_ON_TOP) {
+            state->stack.push_back(std::move(w));
+        } else {
+            state->stack.insert(state->stack.begin(), std::move(w));
+        }
+        update_redirect();
+        break; }
+    case XCB_EXPOSE: {
+        auto expose = reinterpret_cast<xcb_expose_event_t*>(event);
+        if (expose->window == state->overlay) {
+            damage_rect(expose->x, expose->y, expose->width, expose->height);
+        }
+        break; }
+    case XCB_SELECTION_CLEAR: {
+        auto clear = reinterpret_cast<xcb_selection_clear_event_t*>(event);
+        if (clear->selection == state->cmAtom) {
+            // someone else took over compositing
+            disable();
+        }
+        break; }
+    case 0:
+        // errors, mostly from windows going away under our feet
+        break;
+    }
+}
+
+static void process()
+{
+    for (;;) {
+        if (xcb_connection_has_error(state->conn)) {
+            disable();
+            return;
+        }
+        xcb_generic_event_t* event;
+        while (state && (event = xcb_poll_for_event(state->conn))) {
+            handle_event(event);
+            free(event);
+        }
+        if (state && state->stale) {
+            resync_stack();
+        }
+        if (!state || !state->damaged)
+            return;
+        if (state->redirected) {
+            // syncing may pull more events off the socket, go around again
+            paint();
+        } else {
+            xcb_xfixes_set_region(state->conn, state->dirty, 0, nullptr);
+            state->damaged = false;
+            xcb_flush(state->conn);
+            return;
+        }
+    }
+}
+
+static bool query_formats()
+{
+    auto cookie = xcb_render_query_pict_formats(state->conn);
+    auto reply = xcb_render_query_pict_formats_reply(state->conn, cookie, nullptr);
+    if (!reply)
+        return false;
+
+    auto formats = xcb_render_query_pict_formats_formats_iterator(reply);
+    for (; formats.rem; xcb_render_pictforminfo_next(&formats)) {
+        const auto info = formats.data;
+        if (info->type == XCB_RENDER_PICT_TYPE_DIRECT && info->direct.alpha_mask) {
+            state->alphaFormats.insert(info->id);
+        }
+    }
+
+    auto screens = xcb_render_query_pict_formats_screens_iterator(reply);
+    for (; screens.rem; xcb_render_pictscreen_next(&screens)) {
+        auto depths = xcb_render_pictscreen_depths_iterator(screens.data);
+        for (; depths.rem; xcb_render_pictdepth_next(&depths)) {
+            auto visuals = xcb_render_pictdepth_visuals_iterator(depths.data);
+            for (; visuals.rem; xcb_render_pictvisual_next(&visuals)) {
+                state->formats[visuals.data->visual] = visuals.data->format;
+            }
+        }
+    }
+    free(reply);
+
+    auto root = state->formats.find(state->screen->root_visual);
+    if (root == state->formats.end())
+        return false;
+    state->rootFormat = root->second;
+    return true;
+}
+
+static void enable(napi_env env, const std::shared_ptr<WM>& wm, const Napi::Object& args)
+{
+    state.reset(new State);
+    state->wm = wm;
+
+    if (args.Has("unredirectFullscreen")) {
+        state->unredirectFullscreen = args.Get("unredirectFullscreen").ToBoolean();
+    }
+    if (args.Has("sync")) {
+        state->sync = args.Get("sync").ToBoolean();
+    }
+    if (args.Has("background")) {
+        const uint32_t rgb = args.Get("background").As<Napi::Number>().Uint32Value();
+        state->background.red = ((rgb >> 16) & 0xff) * 0x101;
+        state->background.green = ((rgb >> 8) & 0xff) * 0x101;
+        state->background.blue = (rgb & 0xff) * 0x101;
+    }
+
+    auto fail = [env](const char* msg) {
+        if (state->conn) {
+            xcb_disconnect(state->conn);
+        }
+        state.reset();
+        throw Napi::TypeError::New(env, std::string("compositor.enable ") + msg);
+    };
+
+    int screenNo;
+    state->conn = xcb_connect(wm->display.empty() ? nullptr : wm->display.c_str(), &screenNo);
+    if (xcb_connection_has_error(state->conn)) {
+        fail("unable to connect");
+    }
+    auto conn = state->conn;
+
+    state->screen = xcb_aux_get_screen(conn, wm->defaultScreenNo);
+    if (!state->screen) {
+        fail("couldn't get screen");
+    }
+    state->root = state->screen->root;
+    state->width = state->screen->width_in_pixels;
+    state->height = state->screen->height_in_pixels;
+    state->cmAtom = wm->ewmh->_NET_WM_CM_Sn[wm->defaultScreenNo];
+
+    xcb_prefetch_extension_data(conn, &xcb_composite_id);
+    xcb_prefetch_extension_data(conn, &xcb_damage_id);
+    xcb_prefetch_extension_data(conn, &xcb_xfixes_id);
+    xcb_prefetch_extension_data(conn, &xcb_render_id);
+
+    auto present = [conn](xcb_extension_t* ext) {
+        auto reply = xcb_get_extension_data(conn, ext);
+        return reply && reply->present;
+    };
+    if (!present(&xcb_composite_id) || !present(&xcb_damage_id) || !present(&xcb_xfixes_id) || !present(&xcb_render_id)) {
+        fail("needs Composite, Damage, XFixes and Render");
+    }
+    state->damageEvent = xcb_get_extension_data(conn, &xcb_damage_id)->first_event;
+
+    // the version queries are mandatory before using damage and xfixes
+    auto compositeCookie = xcb_composite_query_version(conn, XCB_COMPOSITE_MAJOR_VERSION, XCB_COMPOSITE_MINOR_VERSION);
+    auto damageCookie = xcb_damage_query_version(conn, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+    auto xfixesCookie = xcb_xfixes_query_version(conn, XCB_XFIXES_MAJOR_VERSION, XCB_XFIXES_MINOR_VERSION);
+    auto renderCookie = xcb_render_query_version(conn, XCB_RENDER_MAJOR_VERSION, XCB_RENDER_MINOR_VERSION);
+    auto compositeVersion = xcb_composite_query_version_reply(conn, compositeCookie, nullptr);
+    auto damageVersion = xcb_damage_query_version_reply(conn, damageCookie, nullptr);
+    auto xfixesVersion = xcb_xfixes_query_version_reply(conn, xfixesCookie, nullptr);
+    auto renderVersion = xcb_render_query_version_reply(conn, renderCookie, nullptr);
+    // overlay windows need composite 0.3, region clips need xfixes 2
+    const bool versionsOk = compositeVersion && damageVersion && xfixesVersion && renderVersion
+        && (compositeVersion->major_version > 0 || compositeVersion->minor_version >= 3)
+        && xfixesVersion->major_version >= 2;
+    free(compositeVersion);
+    free(damageVersion);
+    free(xfixesVersion);
+    free(renderVersion);
+    if (!versionsOk) {
+        fail("extension versions too old");
+    }
+
+    if (!query_formats()) {
+        fail("no render format for the root visual");
+    }
+
+    {
+        auto cookie = xcb_get_selection_owner(conn, state->cmAtom);
+        auto reply = xcb_get_selection_owner_reply(conn, cookie, nullptr);
+        const bool owned = reply && reply->owner != XCB_NONE;
+        free(reply);
+        if (owned) {
+            fail("another compositing manager is running");
+        }
+    }
+
+    state->cmWindow = xcb_generate_id(conn);
+    xcb_create_window(conn, XCB_COPY_FROM_PARENT, state->cmWindow, state->root, -1, -1, 1, 1, 0,
+                      XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, XCB_NONE, nullptr);
+    xcb_icccm_set_wm_class(conn, state->cmWindow, 7, "owm\0Owm");
+    xcb_set_selection_owner(conn, state->cmWindow, state->cmAtom, XCB_CURRENT_TIME);
+
+    {
+        // the set can silently lose against another manager claiming the
+        // selection between our check and now
+        auto cookie = xcb_get_selection_owner(conn, state->cmAtom);
+        auto reply = xcb_get_selection_owner_reply(conn, cookie, nullptr);
+        const bool ours = reply && reply->owner == state->cmWindow;
+        free(reply);
+        if (!ours) {
+            fail("lost the compositing manager selection");
+        }
+    }
+
+    {
+        // ICCCM manager selection announcement
+        xcb_client_message_event_t event;
+        memset(&event, 0, sizeof(event));
+        event.response_type = XCB_CLIENT_MESSAGE;
+        event.format = 32;
+        event.window = state->root;
+        event.type = wm->ewmh->MANAGER;
+        event.data.data32[0] = XCB_CURRENT_TIME;
+        event.data.data32[1] = state->cmAtom;
+        event.data.data32[2] = state->cmWindow;
+        xcb_send_event(conn, 0, state->root, XCB_EVENT_MASK_STRUCTURE_NOTIFY, reinterpret_cast<const char*>(&event));
+    }
+
+    // hold the server so no window slips through between the query and the redirect
+    xcb_grab_server(conn);
+
+    {
+        const uint32_t values[] = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY | XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+        xcb_change_window_attributes(conn, state->root, XCB_CW_EVENT_MASK, values);
+    }
+
+    {
+        auto cookie = xcb_composite_get_overlay_window(conn, state->root);
+        auto reply = xcb_composite_get_overlay_window_reply(conn, cookie, nullptr);
+        if (!reply) {
+            xcb_ungrab_server(conn);
+            fail("unable to get the overlay window");
+        }
+        state->overlay = reply->overlay_win;
+        free(reply);
+    }
+
+    {
+        // the overlay shouldn't take any input
+        const xcb_xfixes_region_t region = xcb_generate_id(conn);
+        xcb_xfixes_create_region(conn, region, 0, nullptr);
+        xcb_xfixes_set_window_shape_region(conn, state->overlay, XCB_SHAPE_SK_INPUT, 0, 0, region);
+        xcb_xfixes_destroy_region(conn, region);
+
+        const uint32_t values[] = { XCB_EVENT_MASK_EXPOSURE };
+        xcb_change_window_attributes(conn, state->overlay, XCB_CW_EVENT_MASK, values);
+    }
+
+    state->overlayPicture = xcb_generate_id(conn);
+    xcb_render_create_picture(conn, state->overlayPicture, state->overlay, state->rootFormat, 0, nullptr);
+    create_buffer();
+
+    state->dirty = xcb_generate_id(conn);
+    xcb_xfixes_create_region(conn, state->dirty, 0, nullptr);
+
+    {
+        auto cookie = xcb_query_tree(conn, state->root);
+        auto tree = xcb_query_tree_reply(conn, cookie, nullptr);
+        if (tree) {
+            // children come bottom to top
+            const auto children = xcb_query_tree_children(tree);
+            xcb_window_t above = XCB_NONE;
+            for (int i = 0; i < tree->children_len; ++i) {
+                add_window(children[i], above);
+                above = children[i];
+            }
+            free(tree);
+        }
+    }
+
+    update_redirect();
+    damage_screen();
+
+    xcb_ungrab_server(conn);
+    xcb_flush(conn);
+
+    state->poll = new uv_poll_t;
+    uv_poll_init(uv_default_loop(), state->poll, xcb_get_file_descriptor(conn));
+    uv_poll_start(state->poll, UV_READABLE, [](uv_poll_t*, int, int) {
+        if (state) {
+            process();
+        }
+    });
+
+    // replies above may already have queued events we won't get woken up for
+    process();
+}
+
+static void disable()
+{
+    if (!state)
+        return;
+
+    if (state->poll) {
+        uv_poll_stop(state->poll);
+        uv_close(reinterpret_cast<uv_handle_t*>(state->poll), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_poll_t*>(handle);
+        });
+    }
+
+    // the server drops redirection, the overlay, damage objects and the
+    // selection along with the connection
+    xcb_disconnect(state->conn);
+    state.reset();
+}
+
+void stop()
+{
+    disable();
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object compositor = Napi::Object::New(env);
+
+    compositor.Set("enable", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "compositor.enable requires at least one argument");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        if (state) {
+            return env.Undefined();
+        }
+
+        const auto args = info.Length() > 1 && info[1].IsObject() ? info[1].As<Napi::Object>() : Napi::Object::New(env);
+        enable(env, wm, args);
+
+        return env.Undefined();
+    }));
+
+    compositor.Set("disable", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        disable();
+
+        return env.Undefined();
+    }));
+
+    compositor.Set("enabled", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        return Napi::Boolean::New(env, state != nullptr);
+    }));
+
+    compositor.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (!state) {
+            return env.Undefined();
+        }
+
+        const auto& stats = state->stats;
+        auto ret = Napi::Object::New(env);
+        ret.Set("redirected", Napi::Boolean::New(env, state->redirected));
+        ret.Set("windows", Napi::Number::New(env, state->stack.size()));
+        ret.Set("frames", Napi::Number::New(env, stats.frames));
+        ret.Set("damageEvents", Napi::Number::New(env, stats.damageEvents));
+        ret.Set("unredirects", Napi::Number::New(env, stats.unredirects));
+        ret.Set("lastRepaintUs", Napi::Number::New(env, stats.lastRepaintUs));
+        ret.Set("maxRepaintUs", Napi::Number::New(env, stats.maxRepaintUs));
+        ret.Set("totalRepaintUs", Napi::Number::New(env, stats.totalRepaintUs));
+        ret.Set("avgRepaintUs", Napi::Number::New(env, stats.frames ? stats.totalRepaintUs / static_cast<double>(stats.frames) : 0));
+        ret.Set("lastPainted", Napi::Number::New(env, stats.lastPainted));
+        return ret;
+    }));
+
+    compositor.Set("resetStats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (state) {
+            state->stats = Stats();
+        }
+
+        return env.Undefined();
+    }));
+
+    return compositor;
+}
+} // namespace compositor
@@ -0,0 +1,15 @@
+#ifndef OWM_COMPOSITOR_H
+#define OWM_COMPOSITOR_H
+
+#include <napi.h>
+#include <uv.h>
+#include <xcb/xcb.h>
+
+namespace compositor {
+
+Napi::Object make(napi_env env);
+void stop();
+
+}
+
+#endif
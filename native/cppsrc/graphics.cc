@@ -1,7 +1,15 @@
 #include "graphics.h"
 #include "owm.h"
+#include "tree.h"
 #include <cairo-xcb.h>
 #include <pango/pangocairo.h>
+#include <algorithm>
+#include <condition_variable>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 template<typename T>
 using Wrap = owm::Wrap<T>;
@@ -59,17 +67,46 @@ struct Cairo
     bool pathChanged;
 };
 
+static void png_cache_release(uint64_t hash);
+
 struct Surface
 {
     Surface(cairo_surface_t* s, uint32_t w, uint32_t h)
-        : surface(s), width(w), height(h)
+        : surface(s), width(w), height(h), pngHash(0), pngCached(false), shared(false)
     {
     }
     ~Surface()
     {
-        if (surface) {
-            cairo_surface_destroy(surface);
-        }
+        release();
+    }
+
+    void release()
+    {
+        if (!surface)
+            return;
+        if (pngCached) {
+            png_cache_release(pngHash);
+            pngCached = false;
+        }
+        cairo_surface_destroy(surface);
+        surface = nullptr;
+    }
+
+    // cached PNG and icon surfaces are shared between handles, anything
+    // that's about to draw into one gets a private copy first
+    void detach()
+    {
+        if (!shared)
+            return;
+        auto copy = cairo_image_surface_create(cairo_image_surface_get_format(surface), width, height);
+        auto cr = cairo_create(copy);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(cr, surface, 0, 0);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+        release();
+        surface = copy;
+        shared = false;
     }
 
     struct Data
@@ -78,10 +115,45 @@ struct Surface
         size_t off, rem;
     };
 
+    // attached as user data to image surfaces whose pixels live in a MIT-SHM
+    // segment, owned by the cairo surface since contexts may outlive us
+    struct Shm
+    {
+        ~Shm()
+        {
+            auto locked = wm.lock();
+            if (locked && locked->conn) {
+                xcb_shm_detach(locked->conn, seg);
+            }
+            shmdt(addr);
+        }
+
+        std::weak_ptr<WM> wm;
+        xcb_shm_seg_t seg;
+        void* addr;
+        // the server may still be reading the segment until the completion
+        // event for the put with this sequence comes in, see shm_fence
+        uint16_t sequence { 0 };
+        bool busy { false };
+    };
+
+    Shm* shm() const
+    {
+        return surface ? static_cast<Shm*>(cairo_surface_get_user_data(surface, &shmKey)) : nullptr;
+    }
+
     cairo_surface_t* surface;
     uint32_t width, height;
+    uint64_t pngHash;
+    bool pngCached;
+    // the pixels belong to a cache, see detach
+    bool shared;
+
+    static cairo_user_data_key_t shmKey;
 };
 
+cairo_user_data_key_t Surface::shmKey;
+
 struct Pango
 {
     Pango(const std::shared_ptr<Cairo>& c)
@@ -90,6 +162,11 @@ struct Pango
         layout = pango_cairo_create_layout(c->cairo);
         cairoId = c->transformId;
     }
+    Pango(const std::shared_ptr<Pango>& other)
+        : cairoId(other->cairoId), cairo(other->cairo)
+    {
+        layout = other->layout ? pango_layout_copy(other->layout) : nullptr;
+    }
     ~Pango()
     {
         if (layout) {
@@ -145,7 +222,1217 @@ static inline xcb_visualtype_t* find_visual(xcb_connection_t* c, xcb_visualid_t
     return nullptr;
 }
 
+// PNG surfaces are keyed on a hash of their encoded bytes so that identical
+// buffers (the same icon loaded by several bar modules, say) decode once and
+// share one cairo surface. The bytes are kept and compared on a hit, a hash
+// collision just doesn't get cached. The cache holds a reference of its own
+// and counts the handles using an entry, both under the same lock, the entry
+// goes away with the last handle. Handles are read-only, see Surface::detach.
+class PNGWorker;
+
+struct PNGCache
+{
+    struct Entry
+    {
+        std::vector<uint8_t> data;
+        cairo_surface_t* surface;
+        uint32_t users;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> surfaces;
+    // decodes in flight, only touched on the main thread
+    std::unordered_map<uint64_t, PNGWorker*> pending;
+};
+
+static PNGCache pngCache;
+
+static inline uint64_t png_hash(const uint8_t* data, size_t size)
+{
+    // 64-bit FNV-1a, seeded with the size to make truncated buffers differ
+    uint64_t hash = 14695981039346656037ULL ^ static_cast<uint64_t>(size);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static inline bool png_same(const std::vector<uint8_t>& cached, const uint8_t* data, size_t size)
+{
+    return cached.size() == size && !memcmp(cached.data(), data, size);
+}
+
+// returns a new reference and counts a user, or null
+static cairo_surface_t* png_cache_find(uint64_t hash, const uint8_t* data, size_t size)
+{
+    std::lock_guard<std::mutex> locker(pngCache.mutex);
+    auto it = pngCache.surfaces.find(hash);
+    if (it == pngCache.surfaces.end() || !png_same(it->second.data, data, size))
+        return nullptr;
+    ++it->second.users;
+    return cairo_surface_reference(it->second.surface);
+}
+
+// takes over the reference to surface. returns the surface to use, which is
+// an already cached one if the same bytes got there first. cached is false
+// if the hash is taken by different bytes
+static cairo_surface_t* png_cache_insert(uint64_t hash, const uint8_t* data, size_t size,
+                                         cairo_surface_t* surface, bool& cached)
+{
+    std::lock_guard<std::mutex> locker(pngCache.mutex);
+    auto it = pngCache.surfaces.find(hash);
+    if (it != pngCache.surfaces.end()) {
+        cached = png_same(it->second.data, data, size);
+        if (!cached)
+            return surface;
+        cairo_surface_destroy(surface);
+        ++it->second.users;
+        return cairo_surface_reference(it->second.surface);
+    }
+    cached = true;
+    pngCache.surfaces[hash] = { std::vector<uint8_t>(data, data + size), cairo_surface_reference(surface), 1 };
+    return surface;
+}
+
+static void png_cache_release(uint64_t hash)
+{
+    cairo_surface_t* surface = nullptr;
+    {
+        std::lock_guard<std::mutex> locker(pngCache.mutex);
+        auto it = pngCache.surfaces.find(hash);
+        if (it == pngCache.surfaces.end() || --it->second.users > 0)
+            return;
+        surface = it->second.surface;
+        pngCache.surfaces.erase(it);
+    }
+    cairo_surface_destroy(surface);
+}
+
+static cairo_surface_t* png_decode(const uint8_t* data, size_t size)
+{
+    Surface::Data surfaceData { data, 0, size };
+    return cairo_image_surface_create_from_png_stream([](void* user, unsigned char* data, unsigned int length) {
+        Surface::Data* d = static_cast<Surface::Data*>(user);
+        if (length > d->rem) {
+            return CAIRO_STATUS_READ_ERROR;
+        }
+        memcpy(data, d->data + d->off, length);
+        d->off += length;
+        d->rem -= length;
+        return CAIRO_STATUS_SUCCESS;
+    }, &surfaceData);
+}
+
+static bool png_data(const Napi::Value& ndata, const uint8_t** data, size_t* size)
+{
+    if (ndata.IsArrayBuffer()) {
+        auto buffer = ndata.As<Napi::ArrayBuffer>();
+        *data = reinterpret_cast<const uint8_t*>(buffer.Data());
+        *size = buffer.ByteLength();
+        return true;
+    } else if (ndata.IsTypedArray()) {
+        const auto tdata = ndata.As<Napi::TypedArray>();
+        *data = reinterpret_cast<const uint8_t*>(tdata.ArrayBuffer().Data()) + tdata.ByteOffset();
+        *size = tdata.ByteLength();
+        return true;
+    }
+    return false;
+}
+
+static inline Napi::Value png_wrap(napi_env env, cairo_surface_t* surface, uint64_t hash, bool cached)
+{
+    const uint32_t w = cairo_image_surface_get_width(surface);
+    const uint32_t h = cairo_image_surface_get_height(surface);
+
+    auto s = std::make_shared<Surface>(surface, w, h);
+    s->pngHash = hash;
+    s->pngCached = cached;
+    s->shared = cached;
+    return Wrap<std::shared_ptr<Surface> >::wrap(env, s);
+}
+
+class PNGWorker : public Napi::AsyncWorker
+{
+public:
+    PNGWorker(Napi::Env env, uint64_t hash, std::vector<uint8_t>&& data)
+        : Napi::AsyncWorker(env), mHash(hash), mData(std::move(data)), mSurface(nullptr)
+    {
+    }
+
+    bool matches(const uint8_t* data, size_t size) const
+    {
+        return png_same(mData, data, size);
+    }
+
+    void wait(const Napi::Promise::Deferred& deferred)
+    {
+        mDeferreds.push_back(deferred);
+    }
+
+    void Execute() override
+    {
+        mSurface = png_decode(mData.data(), mData.size());
+        if (cairo_surface_status(mSurface) != CAIRO_STATUS_SUCCESS) {
+            SetError(std::string("cairo.createSurfaceFromPNGAsync ") + cairo_status_to_string(cairo_surface_status(mSurface)));
+            cairo_surface_destroy(mSurface);
+            mSurface = nullptr;
+        }
+    }
+
+    void OnOK() override
+    {
+        auto env = Env();
+        Napi::HandleScope scope(env);
+
+        done();
+
+        // a synchronous load of the same data might have beaten us to it
+        bool cached;
+        auto surface = png_cache_insert(mHash, mData.data(), mData.size(), mSurface, cached);
+        mSurface = nullptr;
+
+        for (size_t i = 0; i < mDeferreds.size(); ++i) {
+            // the first waiter inherits our reference, everyone else is another user
+            cairo_surface_t* handle = surface;
+            if (i > 0) {
+                handle = cached ? png_cache_find(mHash, mData.data(), mData.size()) : nullptr;
+                if (!handle)
+                    handle = cairo_surface_reference(surface);
+            }
+            mDeferreds[i].Resolve(png_wrap(env, handle, mHash, cached));
+        }
+    }
+
+    void OnError(const Napi::Error& e) override
+    {
+        auto env = Env();
+        Napi::HandleScope scope(env);
+
+        done();
+
+        for (auto& deferred : mDeferreds) {
+            deferred.Reject(e.Value());
+        }
+    }
+
+private:
+    void done()
+    {
+        auto it = pngCache.pending.find(mHash);
+        if (it != pngCache.pending.end() && it->second == this) {
+            pngCache.pending.erase(it);
+        }
+    }
+
+    uint64_t mHash;
+    std::vector<uint8_t> mData;
+    cairo_surface_t* mSurface;
+    std::vector<Napi::Promise::Deferred> mDeferreds;
+};
+
+// _NET_WM_ICON is non-premultiplied ARGB, cairo wants it premultiplied
+static void premultiply_argb(uint32_t* dst, const uint32_t* src, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    // after unpacking to 16 bits the alpha of each pixel is in lane 3 and lane 7
+    const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        const __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        const __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        // c * a / 255, rounded
+        __m128i mlo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), bias);
+        __m128i mhi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), bias);
+        mlo = _mm_srli_epi16(_mm_add_epi16(mlo, _mm_srli_epi16(mlo, 8)), 8);
+        mhi = _mm_srli_epi16(_mm_add_epi16(mhi, _mm_srli_epi16(mhi, 8)), 8);
+        // keep the original alpha
+        lo = _mm_or_si128(_mm_and_si128(alphaMask, lo), _mm_andnot_si128(alphaMask, mlo));
+        hi = _mm_or_si128(_mm_and_si128(alphaMask, hi), _mm_andnot_si128(alphaMask, mhi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; ++i) {
+        const uint32_t p = src[i];
+        const uint32_t a = p >> 24;
+        auto mul = [a](uint32_t c) -> uint32_t {
+            c = c * a + 128;
+            return (c + (c >> 8)) >> 8;
+        };
+        dst[i] = (a << 24) | (mul((p >> 16) & 0xff) << 16) | (mul((p >> 8) & 0xff) << 8) | mul(p & 0xff);
+    }
+}
+
+// Decoded _NET_WM_ICON images per window along with the versions scaled to
+// the sizes that have been asked for. Entries without images remember that
+// the window has no icon. Everything for a window is dropped when the
+// property changes or the window goes away, see invalidateIcon.
+struct IconCache
+{
+    struct Image
+    {
+        uint32_t width, height;
+        cairo_surface_t* surface;
+    };
+
+    struct Entry
+    {
+        ~Entry()
+        {
+            for (auto& image : images) {
+                cairo_surface_destroy(image.surface);
+            }
+            for (auto& scaled : sizes) {
+                cairo_surface_destroy(scaled.second);
+            }
+        }
+
+        std::vector<Image> images;
+        std::unordered_map<uint32_t, cairo_surface_t*> sizes;
+    };
+
+    std::unordered_map<xcb_window_t, std::unique_ptr<Entry> > windows;
+    // the first chunk, asked for as soon as the property changed, see invalidateIcon
+    std::unordered_map<xcb_window_t, xcb_get_property_cookie_t> pending;
+};
+
+static IconCache iconCache;
+
+// in 32-bit units, icons tend to come in sets of 16 to 256 pixels squared
+enum { IconChunkSize = 16384 };
+
+static inline xcb_get_property_cookie_t icon_request(const std::shared_ptr<WM>& wm, xcb_window_t window, uint32_t offset)
+{
+    return xcb_get_property(wm->conn, 0, window, wm->ewmh->_NET_WM_ICON, XCB_ATOM_CARDINAL, offset, IconChunkSize);
+}
+
+static bool icon_append(xcb_get_property_reply_t* reply, std::vector<uint32_t>& data)
+{
+    if (!reply) {
+        return false;
+    }
+    if (reply->format != 32 || reply->type != XCB_ATOM_CARDINAL) {
+        free(reply);
+        return false;
+    }
+    auto values = static_cast<const uint32_t*>(xcb_get_property_value(reply));
+    data.insert(data.end(), values, values + (xcb_get_property_value_length(reply) / 4));
+    free(reply);
+    return true;
+}
+
+static void icon_fetch(const std::shared_ptr<WM>& wm, xcb_window_t window, std::vector<uint32_t>& data)
+{
+    xcb_get_property_cookie_t cookie;
+    auto pending = iconCache.pending.find(window);
+    if (pending != iconCache.pending.end()) {
+        cookie = pending->second;
+        iconCache.pending.erase(pending);
+    } else {
+        cookie = icon_request(wm, window, 0);
+    }
+
+    auto reply = xcb_get_property_reply(wm->conn, cookie, nullptr);
+    if (!reply) {
+        return;
+    }
+    const uint32_t remaining = reply->bytes_after / 4;
+    data.reserve((xcb_get_property_value_length(reply) / 4) + remaining);
+    if (!icon_append(reply, data) || data.empty() || !remaining) {
+        return;
+    }
+
+    // the size is known now, ask for the rest in one go and collect after
+    std::vector<xcb_get_property_cookie_t> cookies;
+    const uint32_t end = data.size() + remaining;
+    for (uint32_t offset = data.size(); offset < end; offset += IconChunkSize) {
+        cookies.push_back(icon_request(wm, window, offset));
+    }
+    bool ok = true;
+    for (const auto& chunk : cookies) {
+        if (!ok) {
+            xcb_discard_reply(wm->conn, chunk.sequence);
+            continue;
+        }
+        ok = icon_append(xcb_get_property_reply(wm->conn, chunk, nullptr), data);
+    }
+}
+
+static std::unique_ptr<IconCache::Entry> icon_load(const std::shared_ptr<WM>& wm, xcb_window_t window)
+{
+    auto entry = std::make_unique<IconCache::Entry>();
+
+    std::vector<uint32_t> data;
+    icon_fetch(wm, window, data);
+
+    // the property is a list of width, height, width * height pixels
+    size_t off = 0;
+    while (off + 2 <= data.size()) {
+        const uint32_t w = data[off];
+        const uint32_t h = data[off + 1];
+        const size_t count = static_cast<size_t>(w) * h;
+        off += 2;
+        if (count > data.size() - off) {
+            // truncated, there's nothing after this one
+            break;
+        }
+        if (!w || !h || w > 1024 || h > 1024) {
+            off += count;
+            continue;
+        }
+
+        auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+        if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy(surface);
+            off += count;
+            continue;
+        }
+        cairo_surface_flush(surface);
+        auto pixels = cairo_image_surface_get_data(surface);
+        const int stride = cairo_image_surface_get_stride(surface);
+        for (uint32_t y = 0; y < h; ++y) {
+            premultiply_argb(reinterpret_cast<uint32_t*>(pixels + (y * stride)), &data[off + (y * w)], w);
+        }
+        cairo_surface_mark_dirty(surface);
+
+        entry->images.push_back({ w, h, surface });
+        off += count;
+    }
+
+    return entry;
+}
+
+static cairo_surface_t* icon_for_size(IconCache::Entry* entry, uint32_t size)
+{
+    auto scaled = entry->sizes.find(size);
+    if (scaled != entry->sizes.end()) {
+        return scaled->second;
+    }
+
+    // the smallest image that's at least as big as what we want, otherwise the biggest one
+    const IconCache::Image* best = nullptr;
+    for (const auto& image : entry->images) {
+        const auto dim = std::max(image.width, image.height);
+        if (!best) {
+            best = &image;
+            continue;
+        }
+        const auto bestDim = std::max(best->width, best->height);
+        if (bestDim < size ? dim > bestDim : (dim >= size && dim < bestDim)) {
+            best = &image;
+        }
+    }
+    if (!best) {
+        return nullptr;
+    }
+
+    if (best->width == size && best->height == size) {
+        return best->surface;
+    }
+
+    // scale into a size x size square keeping the aspect ratio
+    auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    auto cairo = cairo_create(surface);
+    const double factor = static_cast<double>(size) / std::max(best->width, best->height);
+    cairo_translate(cairo, (size - (best->width * factor)) / 2., (size - (best->height * factor)) / 2.);
+    cairo_scale(cairo, factor, factor);
+    cairo_set_source_surface(cairo, best->surface, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cairo), CAIRO_FILTER_GOOD);
+    cairo_paint(cairo);
+    cairo_destroy(cairo);
+    cairo_surface_flush(surface);
+
+    entry->sizes[size] = surface;
+    return surface;
+}
+
+// segments with a put in flight are looked up by their completion events
+static std::unordered_map<xcb_shm_seg_t, Surface::Shm*> shmSegments;
+
+static std::unique_ptr<Surface::Shm> shm_create(const std::shared_ptr<WM>& wm, size_t size)
+{
+    const int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shmid == -1) {
+        return nullptr;
+    }
+    void* addr = shmat(shmid, nullptr, 0);
+    if (addr == reinterpret_cast<void*>(-1)) {
+        shmctl(shmid, IPC_RMID, nullptr);
+        return nullptr;
+    }
+
+    const xcb_shm_seg_t seg = xcb_generate_id(wm->conn);
+    auto cookie = xcb_shm_attach_checked(wm->conn, seg, shmid, 0);
+    std::unique_ptr<xcb_generic_error_t, decltype(&free)> err(xcb_request_check(wm->conn, cookie), free);
+
+    // the segment stays around until both we and the server have detached
+    shmctl(shmid, IPC_RMID, nullptr);
+
+    if (err) {
+        // most likely a remote display, don't bother trying again
+        wm->shm.present = false;
+        shmdt(addr);
+        return nullptr;
+    }
+
+    return std::unique_ptr<Surface::Shm>(new Surface::Shm { wm, seg, addr });
+}
+
+// an image surface in the root's format, backed by MIT-SHM if asked for and
+// available. null if it can't be created
+static cairo_surface_t* image_surface_create(const std::shared_ptr<WM>& wm, uint32_t width, uint32_t height, bool useShm)
+{
+    // match the root depth so the result can be put straight onto our pixmaps
+    const auto format = wm->defaultScreen->root_depth == 32 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+    const int stride = cairo_format_stride_for_width(format, width);
+
+    std::unique_ptr<Surface::Shm> shm;
+    if (useShm && wm->shm.present) {
+        shm = shm_create(wm, static_cast<size_t>(stride) * height);
+    }
+
+    cairo_surface_t* surface;
+    if (shm) {
+        surface = cairo_image_surface_create_for_data(static_cast<unsigned char*>(shm->addr), format, width, height, stride);
+    } else {
+        surface = cairo_image_surface_create(format, width, height);
+    }
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return nullptr;
+    }
+
+    if (shm) {
+        shmSegments[shm->seg] = shm.get();
+        cairo_surface_set_user_data(surface, &Surface::shmKey, shm.release(), [](void* data) {
+            auto shm = static_cast<Surface::Shm*>(data);
+            shmSegments.erase(shm->seg);
+            delete shm;
+        });
+    }
+    return surface;
+}
+
+// blocks until the server is done reading a segment, usually its completion
+// event came in through the event loop already and this is free
+static void shm_fence(const std::shared_ptr<WM>& wm, Surface::Shm* shm)
+{
+    if (!shm || !shm->busy)
+        return;
+    // requests are handled in order, once this is answered the put is done
+    auto cookie = xcb_get_input_focus(wm->conn);
+    free(xcb_get_input_focus_reply(wm->conn, cookie, nullptr));
+    shm->busy = false;
+}
+
+static void put_image_surface(const std::shared_ptr<WM>& wm, const Surface* s, xcb_drawable_t drawable, xcb_gcontext_t gc,
+                              int32_t src_x, int32_t src_y, int32_t dst_x, int32_t dst_y, uint32_t width, uint32_t height)
+{
+    cairo_surface_flush(s->surface);
+
+    const uint8_t depth = wm->defaultScreen->root_depth;
+    const int stride = cairo_image_surface_get_stride(s->surface);
+
+    if (auto shm = s->shm()) {
+        // the server reads the pixels whenever it gets to the request, the
+        // segment isn't to be drawn on again until it says it's done. errors
+        // come in through the event loop like for any other unchecked request
+        auto cookie = xcb_shm_put_image(wm->conn, drawable, gc, stride / 4, s->height, src_x, src_y, width, height,
+                                        dst_x, dst_y, depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 1, shm->seg, 0);
+        shm->sequence = static_cast<uint16_t>(cookie.sequence);
+        shm->busy = true;
+        xcb_flush(wm->conn);
+    } else {
+        // push the pixels through the socket, split in bands that fit in a request
+        const auto data = cairo_image_surface_get_data(s->surface);
+        const size_t maxRequest = (xcb_get_maximum_request_length(wm->conn) * 4) - sizeof(xcb_put_image_request_t);
+        const size_t rowBytes = width * 4;
+        const uint32_t bandRows = std::max<uint32_t>(1, std::min<size_t>(height, maxRequest / rowBytes));
+
+        std::vector<uint8_t> band;
+        for (uint32_t y = 0; y < height; y += bandRows) {
+            const uint32_t rows = std::min(bandRows, height - y);
+            const uint8_t* src = data + ((src_y + y) * stride) + (src_x * 4);
+            if (src_x == 0 && width * 4 == static_cast<uint32_t>(stride)) {
+                xcb_put_image(wm->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, gc, width, rows, dst_x, dst_y + y,
+                              0, depth, rows * rowBytes, src);
+            } else {
+                band.resize(rows * rowBytes);
+                for (uint32_t r = 0; r < rows; ++r) {
+                    memcpy(band.data() + (r * rowBytes), src + (r * stride), rowBytes);
+                }
+                xcb_put_image(wm->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, gc, width, rows, dst_x, dst_y + y,
+                              0, depth, band.size(), band.data());
+            }
+        }
+        uv_async_send(wm->asyncFlush);
+    }
+}
+
+// a retained drawing list, built from JS on the main thread and rasterized
+// on the render thread. ops mirror the immediate mode functions below
+struct DrawOp
+{
+    enum Type {
+        Save,
+        Restore,
+        Translate,
+        Scale,
+        SetSourceRGB,
+        SetSourceRGBA,
+        SetSourceSurface,
+        PathRectangle,
+        PathMoveTo,
+        PathLineTo,
+        PathArc,
+        PathClose,
+        Fill,
+        Stroke,
+        Clip,
+        Paint,
+        DrawText,
+        DrawMarkup,
+        DrawLayout
+    };
+
+    Type type;
+    double args[5];
+    std::string font, text;
+    // a private copy of the source, or a shared read-only one, see draw_list_source
+    std::shared_ptr<cairo_surface_t> surface;
+    // attributes of a text object, copied since js keeps changing it
+    std::shared_ptr<PangoAttrList> attributes;
+};
+
+struct DrawList
+{
+    uint64_t frame;
+    std::vector<DrawOp> ops;
+};
+
+static void draw_list_render(cairo_t* cr, PangoContext* pango, const DrawList& list)
+{
+    for (const auto& op : list.ops) {
+        const double* a = op.args;
+        switch (op.type) {
+        case DrawOp::Save:
+            cairo_save(cr);
+            break;
+        case DrawOp::Restore:
+            cairo_restore(cr);
+            break;
+        case DrawOp::Translate:
+            cairo_translate(cr, a[0], a[1]);
+            break;
+        case DrawOp::Scale:
+            cairo_scale(cr, a[0], a[1]);
+            break;
+        case DrawOp::SetSourceRGB:
+            cairo_set_source_rgb(cr, a[0], a[1], a[2]);
+            break;
+        case DrawOp::SetSourceRGBA:
+            cairo_set_source_rgba(cr, a[0], a[1], a[2], a[3]);
+            break;
+        case DrawOp::SetSourceSurface:
+            cairo_set_source_surface(cr, op.surface.get(), a[0], a[1]);
+            break;
+        case DrawOp::PathRectangle:
+            cairo_rectangle(cr, a[0], a[1], a[2], a[3]);
+            break;
+        case DrawOp::PathMoveTo:
+            cairo_move_to(cr, a[0], a[1]);
+            break;
+        case DrawOp::PathLineTo:
+            cairo_line_to(cr, a[0], a[1]);
+            break;
+        case DrawOp::PathArc:
+            cairo_arc(cr, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case DrawOp::PathClose:
+            cairo_close_path(cr);
+            break;
+        case DrawOp::Fill:
+            cairo_fill(cr);
+            break;
+        case DrawOp::Stroke:
+            cairo_save(cr);
+            if (a[0] > 0)
+                cairo_set_line_width(cr, a[0]);
+            cairo_stroke(cr);
+            cairo_restore(cr);
+            break;
+        case DrawOp::Clip:
+            cairo_clip(cr);
+            break;
+        case DrawOp::Paint:
+            cairo_paint(cr);
+            break;
+        case DrawOp::DrawText:
+        case DrawOp::DrawMarkup:
+        case DrawOp::DrawLayout: {
+            // the transform may have changed since the last text op
+            pango_cairo_update_context(cr, pango);
+            auto layout = pango_layout_new(pango);
+            if (!op.font.empty()) {
+                auto desc = pango_font_description_from_string(op.font.c_str());
+                if (desc) {
+                    pango_layout_set_font_description(layout, desc);
+                    pango_font_description_free(desc);
+                }
+            }
+            if (op.type == DrawOp::DrawMarkup) {
+                pango_layout_set_markup(layout, op.text.c_str(), op.text.size());
+            } else {
+                pango_layout_set_text(layout, op.text.c_str(), op.text.size());
+            }
+            if (op.attributes) {
+                pango_layout_set_attributes(layout, op.attributes.get());
+            }
+            pango_cairo_show_layout(cr, layout);
+            g_object_unref(layout);
+            break; }
+        }
+    }
+}
+
+// The render thread can't touch xcb surfaces and js may draw into image
+// surfaces while a frame is being rendered, so sources are copied into
+// private image surfaces here on the main thread. Cached PNGs and icons
+// never change and are shared as is.
+static std::shared_ptr<cairo_surface_t> draw_list_source(const Surface* s)
+{
+    if (s->shared) {
+        return std::shared_ptr<cairo_surface_t>(cairo_surface_reference(s->surface), cairo_surface_destroy);
+    }
+    auto copy = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, s->width, s->height);
+    auto cr = cairo_create(copy);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cr, s->surface, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(copy);
+    return std::shared_ptr<cairo_surface_t>(copy, cairo_surface_destroy);
+}
+
+static void draw_list_parse(napi_env env, const Napi::Array& nops, DrawList& list)
+{
+    static const std::unordered_map<std::string, std::pair<DrawOp::Type, uint32_t> > types = {
+        { "save", { DrawOp::Save, 0 } },
+        { "restore", { DrawOp::Restore, 0 } },
+        { "translate", { DrawOp::Translate, 2 } },
+        { "scale", { DrawOp::Scale, 2 } },
+        { "setSourceRGB", { DrawOp::SetSourceRGB, 3 } },
+        { "setSourceRGBA", { DrawOp::SetSourceRGBA, 4 } },
+        { "setSourceSurface", { DrawOp::SetSourceSurface, 0 } },
+        { "pathRectangle", { DrawOp::PathRectangle, 4 } },
+        { "pathMoveTo", { DrawOp::PathMoveTo, 2 } },
+        { "pathLineTo", { DrawOp::PathLineTo, 2 } },
+        { "pathArc", { DrawOp::PathArc, 5 } },
+        { "pathClose", { DrawOp::PathClose, 0 } },
+        { "fill", { DrawOp::Fill, 0 } },
+        { "stroke", { DrawOp::Stroke, 0 } },
+        { "clip", { DrawOp::Clip, 0 } },
+        { "paint", { DrawOp::Paint, 0 } },
+        { "drawText", { DrawOp::DrawText, 0 } },
+        { "drawMarkup", { DrawOp::DrawMarkup, 0 } }
+    };
+
+    const uint32_t len = nops.Length();
+    list.ops.reserve(len);
+    for (uint32_t i = 0; i < len; ++i) {
+        const auto nop = nops.Get(i);
+        if (!nop.IsArray()) {
+            throw Napi::TypeError::New(env, "cairo.renderSubmit ops must be arrays");
+        }
+        const auto arr = nop.As<Napi::Array>();
+        if (!arr.Length() || !arr.Get(0u).IsString()) {
+            throw Napi::TypeError::New(env, "cairo.renderSubmit op needs a name");
+        }
+        const std::string name = arr.Get(0u).As<Napi::String>();
+        const auto type = types.find(name);
+        if (type == types.end()) {
+            throw Napi::TypeError::New(env, "cairo.renderSubmit unknown op " + name);
+        }
+
+        DrawOp op;
+        op.type = type->second.first;
+        std::fill(op.args, op.args + 5, 0.);
+
+        const uint32_t nargs = type->second.second;
+        if (arr.Length() < nargs + 1) {
+            throw Napi::TypeError::New(env, "cairo.renderSubmit op " + name + " takes " + std::to_string(nargs) + " arguments");
+        }
+        for (uint32_t a = 0; a < nargs; ++a) {
+            op.args[a] = arr.Get(a + 1).As<Napi::Number>().DoubleValue();
+        }
+
+        switch (op.type) {
+        case DrawOp::SetSourceSurface:
+            if (arr.Length() < 2 || !arr.Get(1u).IsObject()) {
+                throw Napi::TypeError::New(env, "cairo.renderSubmit setSourceSurface needs a surface");
+            }
+            {
+                auto s = Wrap<std::shared_ptr<Surface> >::unwrap(arr.Get(1u));
+                if (!s->surface) {
+                    throw Napi::TypeError::New(env, "cairo.renderSubmit setSourceSurface surface is destroyed");
+                }
+                op.surface = draw_list_source(s.get());
+            }
+            if (arr.Length() > 2)
+                op.args[0] = arr.Get(2u).As<Napi::Number>().DoubleValue();
+            if (arr.Length() > 3)
+                op.args[1] = arr.Get(3u).As<Napi::Number>().DoubleValue();
+            break;
+        case DrawOp::Stroke:
+            if (arr.Length() > 1)
+                op.args[0] = arr.Get(1u).As<Napi::Number>().DoubleValue();
+            break;
+        case DrawOp::DrawText:
+            if (arr.Length() == 2 && arr.Get(1u).IsObject()) {
+                // a text object, render what it holds right now
+                auto p = Wrap<std::shared_ptr<Pango> >::unwrap(arr.Get(1u));
+                if (!p->layout) {
+                    throw Napi::TypeError::New(env, "cairo.renderSubmit drawText text is destroyed");
+                }
+                op.type = DrawOp::DrawLayout;
+                op.text = pango_layout_get_text(p->layout);
+                if (auto desc = pango_layout_get_font_description(p->layout)) {
+                    auto font = pango_font_description_to_string(desc);
+                    op.font = font;
+                    g_free(font);
+                }
+                if (auto attributes = pango_layout_get_attributes(p->layout)) {
+                    op.attributes.reset(pango_attr_list_copy(attributes), pango_attr_list_unref);
+                }
+                break;
+            }
+            // fall through
+        case DrawOp::DrawMarkup:
+            if (arr.Length() < 3 || !arr.Get(1u).IsString() || !arr.Get(2u).IsString()) {
+                throw Napi::TypeError::New(env, "cairo.renderSubmit " + name + " needs a font and a text");
+            }
+            op.font = arr.Get(1u).As<Napi::String>().Utf8Value();
+            op.text = arr.Get(2u).As<Napi::String>().Utf8Value();
+            break;
+        default:
+            break;
+        }
+
+        list.ops.push_back(std::move(op));
+    }
+}
+
+// Rasterizes drawing lists on a dedicated thread into two image surfaces of
+// its own, js never sees them. Only one frame is queued at a time, submitting
+// a new one replaces whatever hasn't been picked up yet. Once a frame is
+// rendered the main thread puts it to the drawable, unless a newer frame was
+// submitted in the meantime, in which case the stale result is dropped and
+// the newer one takes its place. The next frame goes to the other surface,
+// the server may still be reading the last one, and a surface is only drawn
+// on again once the server has completed its previous put.
+struct Renderer
+{
+    Renderer(const std::shared_ptr<WM>& w, cairo_surface_t* first, cairo_surface_t* second, uint32_t width, uint32_t height,
+             xcb_drawable_t d, xcb_gcontext_t g, int32_t x, int32_t y)
+        : wm(w), buffers { { first, width, height }, { second, width, height } },
+          drawable(d), gc(g), dst_x(x), dst_y(y)
+    {
+        async = new uv_async_t;
+        async->data = this;
+        uv_async_init(uv_default_loop(), async, [](uv_async_t* handle) {
+            if (handle->data) {
+                static_cast<Renderer*>(handle->data)->rendered();
+            }
+        });
+        // don't keep node alive just because a renderer exists
+        uv_unref(reinterpret_cast<uv_handle_t*>(async));
+
+        thread = std::thread(&Renderer::run, this);
+    }
+    ~Renderer()
+    {
+        stop();
+    }
+
+    uint64_t submit(std::unique_ptr<DrawList>&& list)
+    {
+        std::unique_ptr<DrawList> old;
+        uint64_t frame;
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            frame = list->frame = ++submitted;
+            old = std::move(pending);
+            pending = std::move(list);
+            if (old)
+                ++dropped;
+        }
+        cond.notify_one();
+        return frame;
+    }
+
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            stopped = true;
+        }
+        cond.notify_one();
+        thread.join();
+
+        async->data = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(async), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_async_t*>(handle);
+        });
+        async = nullptr;
+
+        pending.reset();
+        done.reset();
+    }
+
+    void run()
+    {
+        cairo_t* crs[2] = { cairo_create(buffers[0].surface), cairo_create(buffers[1].surface) };
+        PangoContext* pango = pango_cairo_create_context(crs[0]);
+
+        std::unique_lock<std::mutex> locker(mutex);
+        for (;;) {
+            cond.wait(locker, [this]() { return stopped || (pending && !busy); });
+            if (stopped)
+                break;
+
+            std::unique_ptr<DrawList> list = std::move(pending);
+            busy = true;
+            cairo_t* cr = crs[back];
+            locker.unlock();
+
+            cairo_save(cr);
+            draw_list_render(cr, pango, *list);
+            cairo_restore(cr);
+            cairo_surface_flush(buffers[back].surface);
+
+            locker.lock();
+            // handed back to the main thread, surfaces in the list are released there
+            done = std::move(list);
+            uv_async_send(async);
+        }
+
+        g_object_unref(pango);
+        cairo_destroy(crs[0]);
+        cairo_destroy(crs[1]);
+    }
+
+    void rendered()
+    {
+        std::unique_ptr<DrawList> list;
+        bool present;
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            if (!done)
+                return;
+            list = std::move(done);
+            // fence, there's no point in showing this if something newer is queued
+            present = !(pending && pending->frame > list->frame);
+            if (present) {
+                presented = list->frame;
+            } else {
+                ++dropped;
+            }
+        }
+
+        // the worker is waiting for busy to clear, back is ours until then
+        auto w = wm.lock();
+        if (present && w && w->conn) {
+            const Surface& rendered = buffers[back];
+            put_image_surface(w, &rendered, drawable, gc, 0, 0, dst_x, dst_y, rendered.width, rendered.height);
+        }
+
+        if (present) {
+            // the worker draws into the other surface next, put two frames ago
+            std::lock_guard<std::mutex> locker(mutex);
+            back ^= 1;
+        }
+        if (w && w->conn) {
+            shm_fence(w, buffers[back].shm());
+        }
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            busy = false;
+        }
+        cond.notify_one();
+
+        if (present && !callback.IsEmpty()) {
+            auto env = callback.Env();
+            Napi::HandleScope scope(env);
+            try {
+                callback.Call({ Napi::Number::New(env, list->frame) });
+            } catch (const Napi::Error& e) {
+                owm::printException(__FUNCTION__, e);
+            }
+        }
+    }
+
+    std::weak_ptr<WM> wm;
+    Surface buffers[2];
+    uint32_t back { 0 };
+    xcb_drawable_t drawable;
+    xcb_gcontext_t gc;
+    int32_t dst_x, dst_y;
+    Napi::FunctionReference callback;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::unique_ptr<DrawList> pending, done;
+    uv_async_t* async;
+    uint64_t submitted { 0 }, presented { 0 }, dropped { 0 };
+    bool busy { false }, stopped { false };
+};
+
+// Scaled down previews of a set of windows, rendered server side with XRender
+// into a pixmap of their own. The windows are redirected (automatically, the
+// server keeps drawing them on screen) so their contents can be named, and
+// each gets a damage object so we know when a preview is out of date. Nothing
+// is rescaled unless something changed, the pixmap is the cache.
+struct Thumbnail
+{
+    struct Source
+    {
+        xcb_window_t window;
+        int32_t x, y;
+        uint32_t width, height;
+        xcb_damage_damage_t damage;
+        // from the visual, which never changes for a window
+        xcb_render_pictformat_t format;
+    };
+
+    ~Thumbnail()
+    {
+        release();
+    }
+
+    void release();
+
+    std::weak_ptr<WM> wm;
+    xcb_pixmap_t pixmap { XCB_NONE };
+    xcb_render_picture_t picture { XCB_NONE };
+    uint32_t width { 0 }, height { 0 };
+    xcb_render_color_t background { 0, 0, 0, 0xffff };
+    std::vector<Source> sources;
+    int32_t srcX { 0 }, srcY { 0 };
+    uint32_t srcWidth { 1 }, srcHeight { 1 };
+    bool dirty { true };
+    std::shared_ptr<Surface> surface;
+    Napi::FunctionReference callback;
+};
+
+static std::unordered_map<xcb_damage_damage_t, Thumbnail*> thumbnailDamage;
+static std::unordered_map<xcb_window_t, uint32_t> thumbnailRedirects;
+static std::unordered_map<xcb_visualid_t, xcb_render_pictformat_t> renderFormats;
+
+static xcb_render_pictformat_t render_format(const std::shared_ptr<WM>& wm, xcb_visualid_t visual)
+{
+    if (renderFormats.empty()) {
+        auto cookie = xcb_render_query_pict_formats(wm->conn);
+        auto reply = xcb_render_query_pict_formats_reply(wm->conn, cookie, nullptr);
+        if (!reply)
+            return 0;
+        auto screens = xcb_render_query_pict_formats_screens_iterator(reply);
+        for (; screens.rem; xcb_render_pictscreen_next(&screens)) {
+            auto depths = xcb_render_pictscreen_depths_iterator(screens.data);
+            for (; depths.rem; xcb_render_pictdepth_next(&depths)) {
+                auto visuals = xcb_render_pictdepth_visuals_iterator(depths.data);
+                for (; visuals.rem; xcb_render_pictvisual_next(&visuals)) {
+                    renderFormats[visuals.data->visual] = visuals.data->format;
+                }
+            }
+        }
+        free(reply);
+    }
+    auto it = renderFormats.find(visual);
+    return it != renderFormats.end() ? it->second : 0;
+}
+
+static void thumbnail_add_source(xcb_connection_t* conn, Thumbnail::Source& source)
+{
+    if (thumbnailRedirects[source.window]++ == 0) {
+        xcb_composite_redirect_window(conn, source.window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    }
+    source.damage = xcb_generate_id(conn);
+    xcb_damage_create(conn, source.damage, source.window, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+}
+
+static void thumbnail_remove_source(xcb_connection_t* conn, const Thumbnail::Source& source)
+{
+    // errors for windows that are already gone are harmless
+    thumbnailDamage.erase(source.damage);
+    xcb_damage_destroy(conn, source.damage);
+
+    auto it = thumbnailRedirects.find(source.window);
+    if (it != thumbnailRedirects.end() && --it->second == 0) {
+        xcb_composite_unredirect_window(conn, source.window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+        thumbnailRedirects.erase(it);
+    }
+}
+
+void Thumbnail::release()
+{
+    auto locked = wm.lock();
+    if (locked && locked->conn) {
+        for (const auto& source : sources) {
+            thumbnail_remove_source(locked->conn, source);
+        }
+        if (picture) {
+            xcb_render_free_picture(locked->conn, picture);
+        }
+        if (pixmap) {
+            xcb_free_pixmap(locked->conn, pixmap);
+        }
+    } else {
+        for (const auto& source : sources) {
+            thumbnailDamage.erase(source.damage);
+        }
+    }
+    sources.clear();
+    picture = XCB_NONE;
+    pixmap = XCB_NONE;
+    surface.reset();
+    callback.Reset();
+}
+
+static inline xcb_render_fixed_t double_to_fixed(double value)
+{
+    return static_cast<xcb_render_fixed_t>(value * 65536.);
+}
+
+static bool thumbnail_update(const std::shared_ptr<WM>& wm, Thumbnail* t)
+{
+    auto conn = wm->conn;
+
+    // the shadow tree knows what's viewable, no need to ask the server
+    std::vector<xcb_render_pictformat_t> formats(t->sources.size(), 0);
+    bool any = false;
+    for (size_t i = 0; i < t->sources.size(); ++i) {
+        const auto& source = t->sources[i];
+        if (source.format && tree::viewable(source.window)) {
+            formats[i] = source.format;
+            any = true;
+        }
+    }
+
+    // rearm the damage notifications whether we draw or not
+    for (const auto& source : t->sources) {
+        xcb_damage_subtract(conn, source.damage, XCB_NONE, XCB_NONE);
+    }
+
+    // none of them are visible, a hidden workspace most likely. unmapped
+    // windows have no contents so keep whatever we had last time
+    if (!any && !t->sources.empty()) {
+        uv_async_send(wm->asyncFlush);
+        return false;
+    }
+
+    const xcb_rectangle_t all = { 0, 0, static_cast<uint16_t>(t->width), static_cast<uint16_t>(t->height) };
+    xcb_render_fill_rectangles(conn, XCB_RENDER_PICT_OP_SRC, t->picture, t->background, 1, &all);
+
+    const double sx = t->width / static_cast<double>(t->srcWidth);
+    const double sy = t->height / static_cast<double>(t->srcHeight);
+    const xcb_render_transform_t transform = {
+        double_to_fixed(1. / sx), 0, 0,
+        0, double_to_fixed(1. / sy), 0,
+        0, 0, double_to_fixed(1.)
+    };
+
+    for (size_t i = 0; i < t->sources.size(); ++i) {
+        if (!formats[i])
+            continue;
+        const auto& source = t->sources[i];
+
+        const xcb_pixmap_t pixmap = xcb_generate_id(conn);
+        xcb_composite_name_window_pixmap(conn, source.window, pixmap);
+        const xcb_render_picture_t picture = xcb_generate_id(conn);
+        xcb_render_create_picture(conn, picture, pixmap, formats[i], 0, nullptr);
+        xcb_render_set_picture_transform(conn, picture, transform);
+        xcb_render_set_picture_filter(conn, picture, 4, "good", 0, nullptr);
+
+        const int16_t dx = static_cast<int16_t>((source.x - t->srcX) * sx);
+        const int16_t dy = static_cast<int16_t>((source.y - t->srcY) * sy);
+        const uint16_t dw = std::max<uint16_t>(1, static_cast<uint16_t>(source.width * sx + .5));
+        const uint16_t dh = std::max<uint16_t>(1, static_cast<uint16_t>(source.height * sy + .5));
+        xcb_render_composite(conn, XCB_RENDER_PICT_OP_OVER, picture, XCB_NONE, t->picture,
+                             0, 0, 0, 0, dx, dy, dw, dh);
+
+        xcb_render_free_picture(conn, picture);
+        xcb_free_pixmap(conn, pixmap);
+    }
+
+    if (t->surface && t->surface->surface) {
+        cairo_surface_mark_dirty(t->surface->surface);
+    }
+
+    t->dirty = false;
+    uv_async_send(wm->asyncFlush);
+    return true;
+}
+
 namespace graphics {
+void invalidateIcon(const std::shared_ptr<owm::WM>& wm, xcb_window_t window, bool prefetch)
+{
+    auto pending = iconCache.pending.find(window);
+    if (pending != iconCache.pending.end()) {
+        xcb_discard_reply(wm->conn, pending->second.sequence);
+        iconCache.pending.erase(pending);
+    }
+    const bool cached = iconCache.windows.erase(window) > 0;
+    // someone is showing this icon, get the new one on its way before they ask
+    if (prefetch && cached) {
+        iconCache.pending[window] = icon_request(wm, window, 0);
+    }
+}
+
+void handleDamage(xcb_generic_event_t* event)
+{
+    auto notify = reinterpret_cast<xcb_damage_notify_event_t*>(event);
+    auto it = thumbnailDamage.find(notify->damage);
+    if (it == thumbnailDamage.end())
+        return;
+    Thumbnail* t = it->second;
+
+    // NON_EMPTY only reports once until the next update subtracts, so this
+    // fires at most once per update no matter how busy the windows are
+    if (t->dirty)
+        return;
+    t->dirty = true;
+
+    if (!t->callback.IsEmpty()) {
+        auto env = t->callback.Env();
+        Napi::HandleScope scope(env);
+        try {
+            t->callback.Call({});
+        } catch (const Napi::Error& e) {
+            owm::printException(__FUNCTION__, e);
+        }
+    }
+}
+
+void handleShmCompletion(xcb_generic_event_t* event)
+{
+    auto completion = reinterpret_cast<xcb_shm_completion_event_t*>(event);
+    auto it = shmSegments.find(completion->shmseg);
+    if (it == shmSegments.end())
+        return;
+    // an older put's completion doesn't free the segment
+    Surface::Shm* shm = it->second;
+    if (shm->busy && shm->sequence == completion->sequence)
+        shm->busy = false;
+}
+
 Napi::Object make(napi_env env)
 {
     Napi::Object graphics = Napi::Object::New(env);
@@ -219,6 +1506,8 @@ Napi::Object make(napi_env env)
             throw Napi::TypeError::New(env, "cairo.createFromSurface invalid cairo");
         }
 
+        s->detach();
+
         auto cairo = cairo_create(s->surface);
         auto c = std::make_shared<Cairo>(cairo_surface_reference(s->surface), cairo, s->width, s->height);
 
@@ -285,148 +1574,339 @@ Napi::Object make(napi_env env)
 
         cairo_append_path(dc->cairo, sc->finalizePath());
 
-        return env.Undefined();
+        return env.Undefined();
+    }));
+
+    graphics.Set("save", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.save takes one argument");
+        }
+
+        auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
+
+        if (!c->cairo) {
+            throw Napi::TypeError::New(env, "cairo.save no cairo?");
+        }
+
+        cairo_save(c->cairo);
+
+        return env.Undefined();
+    }));
+
+    graphics.Set("restore", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.restore takes one argument");
+        }
+
+        auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
+
+        if (!c->cairo) {
+            throw Napi::TypeError::New(env, "cairo.restore no cairo?");
+        }
+
+        cairo_restore(c->cairo);
+
+        return env.Undefined();
+    }));
+
+    graphics.Set("createSurfaceFromContext", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromContext takes two arguments");
+        }
+
+        auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
+
+        if (!c->cairo || !c->surface) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromContext invalid cairo");
+        }
+
+        auto s = std::make_shared<Surface>(cairo_surface_reference(c->surface), c->width, c->height);
+
+        return Wrap<std::shared_ptr<Surface> >::wrap(env, s);
+    }));
+
+    graphics.Set("createSurfaceFromDrawable", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires two arguments");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto arg = info[1].As<Napi::Object>();
+
+        if (!arg.Has("drawable")) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires a drawable");
+        }
+        const auto drawable = arg.Get("drawable").As<Napi::Number>().Uint32Value();
+
+        if (!arg.Has("width")) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires a width");
+        }
+        const auto width = arg.Get("width").As<Napi::Number>().Uint32Value();
+
+        if (!arg.Has("height")) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires a height");
+        }
+        const auto height = arg.Get("height").As<Napi::Number>().Uint32Value();
+
+        auto visual = find_visual(wm->conn, wm->defaultScreen->root_visual);
+        if (!visual) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable couldn't find root visual from id");
+        }
+
+        auto surface = cairo_xcb_surface_create(wm->conn, drawable, visual, width, height);
+        auto s = std::make_shared<Surface>(surface, width, height);
+
+        return Wrap<std::shared_ptr<Surface> >::wrap(env, s);
     }));
 
-    graphics.Set("save", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+    graphics.Set("createSurfaceFromPNG", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
         auto env = info.Env();
 
-        if (info.Length() < 1 || !info[0].IsObject()) {
-            throw Napi::TypeError::New(env, "cairo.save takes one argument");
+        if (info.Length() < 2 || !info[0].IsObject() || (!info[1].IsArrayBuffer() && !info[1].IsTypedArray())) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNG takes two arguments");
         }
 
         auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
 
         if (!c->cairo) {
-            throw Napi::TypeError::New(env, "cairo.save no cairo?");
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNG invalid cairo");
         }
 
-        cairo_save(c->cairo);
+        const uint8_t* data;
+        size_t size;
+        if (!png_data(info[1], &data, &size)) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNG data must be an arraybuffer or typedarray");
+        }
 
-        return env.Undefined();
+        const auto hash = png_hash(data, size);
+        if (auto cached = png_cache_find(hash, data, size)) {
+            return png_wrap(env, cached, hash, true);
+        }
+
+        auto pngs = png_decode(data, size);
+        bool cached = false;
+        if (cairo_surface_status(pngs) == CAIRO_STATUS_SUCCESS) {
+            pngs = png_cache_insert(hash, data, size, pngs, cached);
+        }
+
+        return png_wrap(env, pngs, hash, cached);
     }));
 
-    graphics.Set("restore", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+    graphics.Set("createSurfaceFromPNGAsync", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
         auto env = info.Env();
 
-        if (info.Length() < 1 || !info[0].IsObject()) {
-            throw Napi::TypeError::New(env, "cairo.restore takes one argument");
+        if (info.Length() < 2 || !info[0].IsObject() || (!info[1].IsArrayBuffer() && !info[1].IsTypedArray())) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNGAsync takes two arguments");
         }
 
         auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
 
         if (!c->cairo) {
-            throw Napi::TypeError::New(env, "cairo.restore no cairo?");
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNGAsync invalid cairo");
         }
 
-        cairo_restore(c->cairo);
+        const uint8_t* data;
+        size_t size;
+        if (!png_data(info[1], &data, &size)) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNGAsync data must be an arraybuffer or typedarray");
+        }
 
-        return env.Undefined();
+        auto deferred = Napi::Promise::Deferred::New(env);
+        auto promise = deferred.Promise();
+
+        const auto hash = png_hash(data, size);
+        if (auto cached = png_cache_find(hash, data, size)) {
+            deferred.Resolve(png_wrap(env, cached, hash, true));
+            return promise;
+        }
+
+        // if the same buffer is already being decoded, just wait for that one
+        auto pending = pngCache.pending.find(hash);
+        if (pending != pngCache.pending.end() && pending->second->matches(data, size)) {
+            pending->second->wait(deferred);
+            return promise;
+        }
+
+        // the JS buffer may be modified or collected while we decode, take a copy
+        std::vector<uint8_t> copy(data, data + size);
+        auto worker = new PNGWorker(env, hash, std::move(copy));
+        worker->wait(deferred);
+        if (pending == pngCache.pending.end()) {
+            pngCache.pending[hash] = worker;
+        }
+        worker->Queue();
+
+        return promise;
     }));
 
-    graphics.Set("createSurfaceFromContext", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+    graphics.Set("createSurfaceFromWindowIcon", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
         auto env = info.Env();
 
-        if (info.Length() < 1 || !info[0].IsObject()) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromContext takes two arguments");
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromWindowIcon requires two arguments");
         }
 
-        auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto arg = info[1].As<Napi::Object>();
 
-        if (!c->cairo || !c->surface) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromContext invalid cairo");
+        if (!arg.Has("window")) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromWindowIcon requires a window");
         }
+        const auto window = arg.Get("window").As<Napi::Number>().Uint32Value();
 
-        auto s = std::make_shared<Surface>(cairo_surface_reference(c->surface), c->width, c->height);
+        if (!arg.Has("size")) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromWindowIcon requires a size");
+        }
+        const auto size = arg.Get("size").As<Napi::Number>().Uint32Value();
+        if (!size) {
+            throw Napi::TypeError::New(env, "cairo.createSurfaceFromWindowIcon size must be > 0");
+        }
+
+        auto& entry = iconCache.windows[window];
+        if (!entry) {
+            entry = icon_load(wm, window);
+        }
+
+        auto surface = icon_for_size(entry.get(), size);
+        if (!surface) {
+            return env.Undefined();
+        }
 
+        auto s = std::make_shared<Surface>(cairo_surface_reference(surface),
+                                           cairo_image_surface_get_width(surface),
+                                           cairo_image_surface_get_height(surface));
+        // the cache hands the same surface to everyone asking
+        s->shared = true;
         return Wrap<std::shared_ptr<Surface> >::wrap(env, s);
     }));
 
-    graphics.Set("createSurfaceFromDrawable", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+    graphics.Set("createImageSurface", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
         auto env = info.Env();
 
         if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires two arguments");
+            throw Napi::TypeError::New(env, "cairo.createImageSurface requires two arguments");
         }
 
         auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
         auto arg = info[1].As<Napi::Object>();
 
-        if (!arg.Has("drawable")) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires a drawable");
-        }
-        const auto drawable = arg.Get("drawable").As<Napi::Number>().Uint32Value();
-
         if (!arg.Has("width")) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires a width");
+            throw Napi::TypeError::New(env, "cairo.createImageSurface requires a width");
         }
         const auto width = arg.Get("width").As<Napi::Number>().Uint32Value();
 
         if (!arg.Has("height")) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable requires a height");
+            throw Napi::TypeError::New(env, "cairo.createImageSurface requires a height");
         }
         const auto height = arg.Get("height").As<Napi::Number>().Uint32Value();
 
-        auto visual = find_visual(wm->conn, wm->defaultScreen->root_visual);
-        if (!visual) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromDrawable couldn't find root visual from id");
+        bool useShm = wm->shm.present;
+        if (arg.Has("backend")) {
+            const auto backend = arg.Get("backend").As<Napi::String>().Utf8Value();
+            if (backend == "image") {
+                useShm = false;
+            } else if (backend != "shm") {
+                throw Napi::TypeError::New(env, "cairo.createImageSurface backend must be 'shm' or 'image'");
+            }
         }
 
-        auto surface = cairo_xcb_surface_create(wm->conn, drawable, visual, width, height);
-        auto s = std::make_shared<Surface>(surface, width, height);
+        auto surface = image_surface_create(wm, width, height, useShm);
+        if (!surface) {
+            throw Napi::TypeError::New(env, "cairo.createImageSurface unable to create surface");
+        }
 
+        auto s = std::make_shared<Surface>(surface, width, height);
         return Wrap<std::shared_ptr<Surface> >::wrap(env, s);
     }));
 
-    graphics.Set("createSurfaceFromPNG", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+    graphics.Set("putImageSurface", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
         auto env = info.Env();
 
-        if (info.Length() < 2 || !info[0].IsObject() || (!info[1].IsArrayBuffer() && !info[1].IsTypedArray())) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNG takes two arguments");
+        if (info.Length() < 3 || !info[0].IsObject() || !info[1].IsObject() || !info[2].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.putImageSurface requires three arguments");
         }
 
-        auto c = Wrap<std::shared_ptr<Cairo> >::unwrap(info[0]);
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto s = Wrap<std::shared_ptr<Surface> >::unwrap(info[1]);
+        auto arg = info[2].As<Napi::Object>();
 
-        if (!c->cairo) {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNG invalid cairo");
+        if (!s->surface || cairo_surface_get_type(s->surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+            throw Napi::TypeError::New(env, "cairo.putImageSurface needs an image surface");
         }
 
-        size_t size;
-        size_t offset;
-
-        const auto ndata = info[1];
-        Napi::ArrayBuffer data;
-        if (ndata.IsArrayBuffer()) {
-            data = ndata.As<Napi::ArrayBuffer>();
-            size = data.ByteLength();
-            offset = 0;
-        } else if (ndata.IsTypedArray()) {
-            const auto tdata = ndata.As<Napi::TypedArray>();
-            size = tdata.ByteLength();
-            offset = tdata.ByteOffset();
-            data = tdata.ArrayBuffer();
-        } else {
-            throw Napi::TypeError::New(env, "cairo.createSurfaceFromPNG data must be an arraybuffer or typedarray");
+        if (!arg.Has("drawable")) {
+            throw Napi::TypeError::New(env, "cairo.putImageSurface requires a drawable");
         }
+        const auto drawable = arg.Get("drawable").As<Napi::Number>().Uint32Value();
 
-        Surface::Data surfaceData { reinterpret_cast<uint8_t*>(data.Data()) + offset, 0, size };
-        auto pngs = cairo_image_surface_create_from_png_stream([](void* user, unsigned char* data, unsigned int length) {
-            Surface::Data* d = static_cast<Surface::Data*>(user);
-            if (length > d->rem) {
-                return CAIRO_STATUS_READ_ERROR;
-            }
-            memcpy(data, d->data + d->off, length);
-            d->off += length;
-            d->rem -= length;
-            return CAIRO_STATUS_SUCCESS;
-        }, &surfaceData);
+        if (!arg.Has("gc")) {
+            throw Napi::TypeError::New(env, "cairo.putImageSurface requires a gc");
+        }
+        const auto gc = arg.Get("gc").As<Napi::Number>().Uint32Value();
+
+        int32_t src_x = 0, src_y = 0, dst_x = 0, dst_y = 0;
+        uint32_t width = s->width, height = s->height;
+        if (arg.Has("src_x")) {
+            src_x = arg.Get("src_x").As<Napi::Number>().Int32Value();
+        }
+        if (arg.Has("src_y")) {
+            src_y = arg.Get("src_y").As<Napi::Number>().Int32Value();
+        }
+        if (arg.Has("dst_x")) {
+            dst_x = arg.Get("dst_x").As<Napi::Number>().Int32Value();
+        }
+        if (arg.Has("dst_y")) {
+            dst_y = arg.Get("dst_y").As<Napi::Number>().Int32Value();
+        }
+        if (arg.Has("width")) {
+            width = arg.Get("width").As<Napi::Number>().Uint32Value();
+        }
+        if (arg.Has("height")) {
+            height = arg.Get("height").As<Napi::Number>().Uint32Value();
+        }
 
-        const uint32_t w = cairo_image_surface_get_width(pngs);
-        const uint32_t h = cairo_image_surface_get_height(pngs);
+        if (src_x < 0 || src_y < 0 || src_x + width > s->width || src_y + height > s->height) {
+            throw Napi::TypeError::New(env, "cairo.putImageSurface source rectangle out of bounds");
+        }
+        if (!width || !height) {
+            return env.Undefined();
+        }
 
-        auto s = std::make_shared<Surface>(pngs, w, h);
+        put_image_surface(wm, s.get(), drawable, gc, src_x, src_y, dst_x, dst_y, width, height);
+        // js may draw into the surface as soon as we return
+        shm_fence(wm, s->shm());
 
-        return Wrap<std::shared_ptr<Surface> >::wrap(env, s);
+        return env.Undefined();
+    }));
+
+    graphics.Set("surfaceBackend", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.surfaceBackend takes one argument");
+        }
+
+        auto s = Wrap<std::shared_ptr<Surface> >::unwrap(info[0]);
+
+        if (!s->surface) {
+            throw Napi::TypeError::New(env, "cairo.surfaceBackend no cairo?");
+        }
+
+        if (s->shm()) {
+            return Napi::String::New(env, "shm");
+        }
+        if (cairo_surface_get_type(s->surface) == CAIRO_SURFACE_TYPE_IMAGE) {
+            return Napi::String::New(env, "image");
+        }
+        return Napi::String::New(env, "xcb");
     }));
 
     graphics.Set("destroySurface", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
@@ -438,10 +1918,7 @@ Napi::Object make(napi_env env)
 
         auto c = Wrap<std::shared_ptr<Surface> >::unwrap(info[0]);
 
-        if (c->surface) {
-            cairo_surface_destroy(c->surface);
-            c->surface = nullptr;
-        }
+        c->release();
 
         return env.Undefined();
     }));
@@ -1041,6 +2518,24 @@ Napi::Object make(napi_env env)
         return Wrap<std::shared_ptr<Pango> >::wrap(env, txt);
     }));
 
+    graphics.Set("textCopy", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.textCopy takes one argument");
+        }
+
+        auto p = Wrap<std::shared_ptr<Pango> >::unwrap(info[0]);
+
+        if (!p->layout) {
+            throw Napi::TypeError::New(env, "cairo.textCopy no pango?");
+        }
+
+        auto txt = std::make_shared<Pango>(p);
+
+        return Wrap<std::shared_ptr<Pango> >::wrap(env, txt);
+    }));
+
     graphics.Set("destroyText", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
         auto env = info.Env();
 
@@ -1167,6 +2662,303 @@ Napi::Object make(napi_env env)
         return env.Undefined();
     }));
 
+    graphics.Set("createRenderer", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.createRenderer requires two arguments");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto arg = info[1].As<Napi::Object>();
+
+        if (!arg.Has("width") || !arg.Has("height")) {
+            throw Napi::TypeError::New(env, "cairo.createRenderer requires a width and a height");
+        }
+        const auto width = arg.Get("width").As<Napi::Number>().Uint32Value();
+        const auto height = arg.Get("height").As<Napi::Number>().Uint32Value();
+        if (!width || !height) {
+            throw Napi::TypeError::New(env, "cairo.createRenderer size must be > 0");
+        }
+
+        if (!arg.Has("drawable")) {
+            throw Napi::TypeError::New(env, "cairo.createRenderer requires a drawable");
+        }
+        const auto drawable = arg.Get("drawable").As<Napi::Number>().Uint32Value();
+
+        if (!arg.Has("gc")) {
+            throw Napi::TypeError::New(env, "cairo.createRenderer requires a gc");
+        }
+        const auto gc = arg.Get("gc").As<Napi::Number>().Uint32Value();
+
+        int32_t dst_x = 0, dst_y = 0;
+        if (arg.Has("dst_x")) {
+            dst_x = arg.Get("dst_x").As<Napi::Number>().Int32Value();
+        }
+        if (arg.Has("dst_y")) {
+            dst_y = arg.Get("dst_y").As<Napi::Number>().Int32Value();
+        }
+
+        auto first = image_surface_create(wm, width, height, true);
+        auto second = image_surface_create(wm, width, height, true);
+        if (!first || !second) {
+            if (first)
+                cairo_surface_destroy(first);
+            if (second)
+                cairo_surface_destroy(second);
+            throw Napi::TypeError::New(env, "cairo.createRenderer unable to create surfaces");
+        }
+
+        auto r = std::make_shared<Renderer>(wm, first, second, width, height, drawable, gc, dst_x, dst_y);
+        if (arg.Has("callback") && arg.Get("callback").IsFunction()) {
+            r->callback = Napi::Persistent(arg.Get("callback").As<Napi::Function>());
+        }
+
+        return Wrap<std::shared_ptr<Renderer> >::wrap(env, r);
+    }));
+
+    graphics.Set("renderSubmit", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsArray()) {
+            throw Napi::TypeError::New(env, "cairo.renderSubmit takes two arguments");
+        }
+
+        auto r = Wrap<std::shared_ptr<Renderer> >::unwrap(info[0]);
+        if (!r->thread.joinable()) {
+            throw Napi::TypeError::New(env, "cairo.renderSubmit renderer is destroyed");
+        }
+
+        std::unique_ptr<DrawList> list(new DrawList);
+        draw_list_parse(env, info[1].As<Napi::Array>(), *list);
+
+        return Napi::Number::New(env, r->submit(std::move(list)));
+    }));
+
+    graphics.Set("rendererStats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.rendererStats takes one argument");
+        }
+
+        auto r = Wrap<std::shared_ptr<Renderer> >::unwrap(info[0]);
+
+        std::lock_guard<std::mutex> locker(r->mutex);
+        auto ret = Napi::Object::New(env);
+        ret.Set("submitted", Napi::Number::New(env, r->submitted));
+        ret.Set("presented", Napi::Number::New(env, r->presented));
+        ret.Set("dropped", Napi::Number::New(env, r->dropped));
+        return ret;
+    }));
+
+    graphics.Set("destroyRenderer", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.destroyRenderer takes one argument");
+        }
+
+        auto r = Wrap<std::shared_ptr<Renderer> >::unwrap(info[0]);
+        r->stop();
+        r->callback.Reset();
+
+        return env.Undefined();
+    }));
+
+    graphics.Set("createThumbnail", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.createThumbnail requires two arguments");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto arg = info[1].As<Napi::Object>();
+
+        if (!wm->composite.present) {
+            throw Napi::TypeError::New(env, "cairo.createThumbnail needs the composite, damage and render extensions");
+        }
+
+        if (!arg.Has("width") || !arg.Has("height")) {
+            throw Napi::TypeError::New(env, "cairo.createThumbnail requires a width and a height");
+        }
+        const auto width = arg.Get("width").As<Napi::Number>().Uint32Value();
+        const auto height = arg.Get("height").As<Napi::Number>().Uint32Value();
+        if (!width || !height || width > 0x7fff || height > 0x7fff) {
+            throw Napi::TypeError::New(env, "cairo.createThumbnail invalid size");
+        }
+
+        const auto format = render_format(wm, wm->defaultScreen->root_visual);
+        auto visual = find_visual(wm->conn, wm->defaultScreen->root_visual);
+        if (!format || !visual) {
+            throw Napi::TypeError::New(env, "cairo.createThumbnail couldn't find the root visual");
+        }
+
+        auto t = std::make_shared<Thumbnail>();
+        t->wm = wm;
+        t->width = width;
+        t->height = height;
+        t->srcWidth = width;
+        t->srcHeight = height;
+
+        if (arg.Has("background")) {
+            const uint32_t rgb = arg.Get("background").As<Napi::Number>().Uint32Value();
+            t->background.red = ((rgb >> 16) & 0xff) * 0x101;
+            t->background.green = ((rgb >> 8) & 0xff) * 0x101;
+            t->background.blue = (rgb & 0xff) * 0x101;
+        }
+        if (arg.Has("callback") && arg.Get("callback").IsFunction()) {
+            t->callback = Napi::Persistent(arg.Get("callback").As<Napi::Function>());
+        }
+
+        t->pixmap = xcb_generate_id(wm->conn);
+        xcb_create_pixmap(wm->conn, wm->defaultScreen->root_depth, t->pixmap, wm->defaultScreen->root, width, height);
+        t->picture = xcb_generate_id(wm->conn);
+        xcb_render_create_picture(wm->conn, t->picture, t->pixmap, format, 0, nullptr);
+
+        const xcb_rectangle_t all = { 0, 0, static_cast<uint16_t>(width), static_cast<uint16_t>(height) };
+        xcb_render_fill_rectangles(wm->conn, XCB_RENDER_PICT_OP_SRC, t->picture, t->background, 1, &all);
+
+        t->surface = std::make_shared<Surface>(cairo_xcb_surface_create(wm->conn, t->pixmap, visual, width, height), width, height);
+
+        return Wrap<std::shared_ptr<Thumbnail> >::wrap(env, t);
+    }));
+
+    graphics.Set("thumbnailSetWindows", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 3 || !info[0].IsObject() || !info[1].IsArray() || !info[2].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailSetWindows takes three arguments");
+        }
+
+        auto t = Wrap<std::shared_ptr<Thumbnail> >::unwrap(info[0]);
+        auto windows = info[1].As<Napi::Array>();
+        auto geom = info[2].As<Napi::Object>();
+
+        auto wm = t->wm.lock();
+        if (!wm || !t->picture) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailSetWindows thumbnail is destroyed");
+        }
+
+        t->srcX = geom.Has("x") ? geom.Get("x").As<Napi::Number>().Int32Value() : 0;
+        t->srcY = geom.Has("y") ? geom.Get("y").As<Napi::Number>().Int32Value() : 0;
+        t->srcWidth = std::max<uint32_t>(1, geom.Get("width").As<Napi::Number>().Uint32Value());
+        t->srcHeight = std::max<uint32_t>(1, geom.Get("height").As<Napi::Number>().Uint32Value());
+
+        std::vector<Thumbnail::Source> sources;
+        const uint32_t len = windows.Length();
+        sources.reserve(len);
+        for (uint32_t i = 0; i < len; ++i) {
+            auto w = windows.Get(i).As<Napi::Object>();
+            sources.push_back({
+                    w.Get("window").As<Napi::Number>().Uint32Value(),
+                    w.Get("x").As<Napi::Number>().Int32Value(),
+                    w.Get("y").As<Napi::Number>().Int32Value(),
+                    w.Get("width").As<Napi::Number>().Uint32Value(),
+                    w.Get("height").As<Napi::Number>().Uint32Value(),
+                    XCB_NONE,
+                    0
+                });
+        }
+
+        // keep the redirects, damage objects and formats of windows we
+        // already had, the visuals of new ones are fetched in one go
+        std::vector<std::pair<size_t, xcb_get_window_attributes_cookie_t> > cookies;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            auto& source = sources[i];
+            auto old = std::find_if(t->sources.begin(), t->sources.end(), [&source](const Thumbnail::Source& s) {
+                return s.window == source.window;
+            });
+            if (old != t->sources.end()) {
+                source.damage = old->damage;
+                source.format = old->format;
+                old->damage = XCB_NONE;
+            } else {
+                cookies.push_back(std::make_pair(i, xcb_get_window_attributes_unchecked(wm->conn, source.window)));
+                thumbnail_add_source(wm->conn, source);
+                thumbnailDamage[source.damage] = t.get();
+            }
+        }
+        for (const auto& cookie : cookies) {
+            auto attrib = xcb_get_window_attributes_reply(wm->conn, cookie.second, nullptr);
+            if (attrib) {
+                sources[cookie.first].format = render_format(wm, attrib->visual);
+                free(attrib);
+            }
+        }
+        for (const auto& old : t->sources) {
+            if (old.damage) {
+                thumbnail_remove_source(wm->conn, old);
+            }
+        }
+        t->sources = std::move(sources);
+        t->dirty = true;
+
+        return env.Undefined();
+    }));
+
+    graphics.Set("thumbnailUpdate", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailUpdate takes one argument");
+        }
+
+        auto t = Wrap<std::shared_ptr<Thumbnail> >::unwrap(info[0]);
+        auto wm = t->wm.lock();
+        if (!wm || !t->picture) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailUpdate thumbnail is destroyed");
+        }
+
+        return Napi::Boolean::New(env, thumbnail_update(wm, t.get()));
+    }));
+
+    graphics.Set("thumbnailDirty", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailDirty takes one argument");
+        }
+
+        auto t = Wrap<std::shared_ptr<Thumbnail> >::unwrap(info[0]);
+
+        return Napi::Boolean::New(env, t->dirty);
+    }));
+
+    graphics.Set("thumbnailSurface", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailSurface takes one argument");
+        }
+
+        auto t = Wrap<std::shared_ptr<Thumbnail> >::unwrap(info[0]);
+        if (!t->surface) {
+            throw Napi::TypeError::New(env, "cairo.thumbnailSurface thumbnail is destroyed");
+        }
+
+        return Wrap<std::shared_ptr<Surface> >::wrap(env, t->surface);
+    }));
+
+    graphics.Set("destroyThumbnail", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "cairo.destroyThumbnail takes one argument");
+        }
+
+        auto t = Wrap<std::shared_ptr<Thumbnail> >::unwrap(info[0]);
+        t->release();
+
+        auto wm = t->wm.lock();
+        if (wm) {
+            uv_async_send(wm->asyncFlush);
+        }
+
+        return env.Undefined();
+    }));
+
     return graphics;
 }
 } // namespace graphics
@@ -6,10 +6,20 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <xcb/xcb.h>
+#include <memory>
+
+namespace owm {
+struct WM;
+}
 
 namespace graphics {
 
 Napi::Object make(napi_env env);
+// drops the cached icon, with prefetch the property is requested again
+// right away if the icon was in use
+void invalidateIcon(const std::shared_ptr<owm::WM>& wm, xcb_window_t window, bool prefetch);
+void handleDamage(xcb_generic_event_t* event);
+void handleShmCompletion(xcb_generic_event_t* event);
 
 }
 
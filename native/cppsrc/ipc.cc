@@ -0,0 +1,484 @@
+#include "ipc.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace ipc {
+
+// Read-only state endpoint that lives on its own thread. JS publishes
+// serialized sections (clients, focus, workspaces, monitors) once per event
+// batch and queues events, everything else happens here. Panels and status
+// scripts polling state never get to wait on, or hold up, X event handling.
+//
+// Every frame in either direction is a little endian uint32 length, counting
+// the type byte and the payload, followed by a type byte and the payload.
+// Requests carry a section or event name as payload, replies and events
+// carry the name, a nul byte and the data.
+
+enum Type : uint8_t {
+    Query = 1,
+    Subscribe = 2,
+    Unsubscribe = 3,
+
+    Reply = 0x81,
+    Event = 0x82,
+    Error = 0x83
+};
+
+// requests are just names, anything bigger is garbage
+static constexpr uint32_t MaxRequest = 4096;
+// a client that doesn't read its events gets dropped rather than buffered forever
+static constexpr size_t MaxPending = 4 * 1024 * 1024;
+
+struct Connection
+{
+    int fd { -1 };
+    std::string in;
+    std::string out;
+    size_t written { 0 };
+    std::set<std::string> subscriptions;
+    bool all { false };
+
+    bool subscribed(const std::string& name) const
+    {
+        return all || subscriptions.count(name);
+    }
+};
+
+struct Server
+{
+    int listenFd { -1 };
+    int wakeFds[2] { -1, -1 };
+    std::string path;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<const std::string> > sections;
+    std::vector<std::pair<std::string, std::string> > events;
+    bool stopped { false };
+
+    // only touched by the thread
+    std::vector<std::unique_ptr<Connection> > connections;
+
+    struct {
+        std::atomic<uint64_t> connections { 0 };
+        std::atomic<uint64_t> queries { 0 };
+        std::atomic<uint64_t> events { 0 };
+        std::atomic<uint64_t> dropped { 0 };
+    } stats;
+
+    void run();
+    void wake();
+    void accept();
+    bool read(Connection* conn);
+    bool write(Connection* conn);
+    bool process(Connection* conn);
+};
+
+static std::unique_ptr<Server> server;
+static struct {
+    uint64_t published { 0 };
+    uint64_t emitted { 0 };
+} jsStats;
+
+static void appendFrame(std::string& out, Type type, const std::string& name, const std::string* data)
+{
+    const uint32_t size = 1 + name.size() + (data ? 1 + data->size() : 0);
+    const char header[5] = {
+        static_cast<char>(size & 0xff),
+        static_cast<char>((size >> 8) & 0xff),
+        static_cast<char>((size >> 16) & 0xff),
+        static_cast<char>((size >> 24) & 0xff),
+        static_cast<char>(type)
+    };
+    out.append(header, sizeof(header));
+    out.append(name);
+    if (data) {
+        out.push_back('\0');
+        out.append(*data);
+    }
+}
+
+void Server::wake()
+{
+    // the pipe is non-blocking, if it's full the thread is awake anyway
+    const char c = 'w';
+    ssize_t r;
+    do {
+        r = ::write(wakeFds[1], &c, 1);
+    } while (r == -1 && errno == EINTR);
+}
+
+void Server::accept()
+{
+    for (;;) {
+        const int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        connections.push_back(std::move(conn));
+        ++stats.connections;
+    }
+}
+
+bool Server::read(Connection* conn)
+{
+    char buf[4096];
+    for (;;) {
+        const ssize_t r = ::read(conn->fd, buf, sizeof(buf));
+        if (r > 0) {
+            conn->in.append(buf, r);
+            continue;
+        }
+        if (r == 0)
+            return false;
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool Server::write(Connection* conn)
+{
+    while (conn->written < conn->out.size()) {
+        const ssize_t w = ::send(conn->fd, conn->out.data() + conn->written,
+                                 conn->out.size() - conn->written, MSG_NOSIGNAL);
+        if (w > 0) {
+            conn->written += w;
+            continue;
+        }
+        if (w == -1 && errno == EINTR)
+            continue;
+        if (w == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+    if (conn->written == conn->out.size()) {
+        conn->out.clear();
+        conn->written = 0;
+    } else if (conn->written > 65536) {
+        conn->out.erase(0, conn->written);
+        conn->written = 0;
+    }
+    return true;
+}
+
+bool Server::process(Connection* conn)
+{
+    size_t offset = 0;
+    while (conn->in.size() - offset >= 5) {
+        const auto p = reinterpret_cast<const uint8_t*>(conn->in.data() + offset);
+        const uint32_t size = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        if (!size || size > MaxRequest)
+            return false;
+        if (conn->in.size() - offset < 4 + size)
+            break;
+        const uint8_t type = p[4];
+        const std::string name(conn->in.data() + offset + 5, size - 1);
+        offset += 4 + size;
+
+        switch (type) {
+        case Query: {
+            ++stats.queries;
+            std::shared_ptr<const std::string> data;
+            {
+                std::lock_guard<std::mutex> locker(mutex);
+                auto it = sections.find(name);
+                if (it != sections.end())
+                    data = it->second;
+            }
+            if (data) {
+                appendFrame(conn->out, Reply, name, data.get());
+            } else {
+                const std::string error = "unknown section";
+                appendFrame(conn->out, Error, name, &error);
+            }
+            break; }
+        case Subscribe:
+            if (name == "*") {
+                conn->all = true;
+            } else {
+                conn->subscriptions.insert(name);
+            }
+            break;
+        case Unsubscribe:
+            if (name == "*") {
+                conn->all = false;
+                conn->subscriptions.clear();
+            } else {
+                conn->subscriptions.erase(name);
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    conn->in.erase(0, offset);
+    return true;
+}
+
+void Server::run()
+{
+    std::vector<pollfd> fds;
+    std::vector<std::pair<std::string, std::string> > pendingEvents;
+    for (;;) {
+        fds.clear();
+        fds.push_back({ wakeFds[0], POLLIN, 0 });
+        fds.push_back({ listenFd, POLLIN, 0 });
+        for (const auto& conn : connections) {
+            fds.push_back({ conn->fd, static_cast<short>(POLLIN | (conn->out.empty() ? 0 : POLLOUT)), 0 });
+        }
+
+        const int r = ::poll(fds.data(), fds.size(), -1);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char buf[256];
+            while (::read(wakeFds[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            if (stopped)
+                break;
+            pendingEvents.swap(events);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            accept();
+        }
+
+        // fds past the listener line up with connections as they were
+        // before accepting, new ones get polled next time around
+        std::vector<bool> dead(connections.size(), false);
+        for (size_t i = 2; i < fds.size(); ++i) {
+            Connection* conn = connections[i - 2].get();
+            const short revents = fds[i].revents;
+            if (revents & (POLLERR | POLLNVAL)) {
+                dead[i - 2] = true;
+                continue;
+            }
+            if (revents & (POLLIN | POLLHUP)) {
+                if (!read(conn) || !process(conn)) {
+                    dead[i - 2] = true;
+                    continue;
+                }
+            }
+        }
+
+        for (const auto& event : pendingEvents) {
+            for (size_t i = 0; i < connections.size(); ++i) {
+                Connection* conn = connections[i].get();
+                if (i < dead.size() && dead[i])
+                    continue;
+                if (conn->subscribed(event.first)) {
+                    appendFrame(conn->out, Event, event.first, &event.second);
+                    ++stats.events;
+                }
+            }
+        }
+        pendingEvents.clear();
+
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection* conn = connections[i].get();
+            if (i < dead.size() && dead[i])
+                continue;
+            if (!conn->out.empty() && !write(conn)) {
+                dead.resize(connections.size(), false);
+                dead[i] = true;
+            } else if (conn->out.size() - conn->written > MaxPending) {
+                ++stats.dropped;
+                dead.resize(connections.size(), false);
+                dead[i] = true;
+            }
+        }
+
+        size_t idx = 0;
+        for (auto it = connections.begin(); it != connections.end(); ++idx) {
+            if (idx < dead.size() && dead[idx]) {
+                ::close((*it)->fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (const auto& conn : connections) {
+        ::close(conn->fd);
+    }
+    connections.clear();
+}
+
+static void listen(const Napi::Env& env, const std::string& path)
+{
+    if (server) {
+        throw Napi::Error::New(env, "ipc.listen already listening");
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw Napi::Error::New(env, "ipc.listen path too long");
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    auto s = std::make_unique<Server>();
+    s->path = path;
+    if (::pipe2(s->wakeFds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        throw Napi::Error::New(env, std::string("ipc.listen unable to create pipe: ") + strerror(errno));
+    }
+    s->listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->listenFd == -1) {
+        const std::string error = strerror(errno);
+        ::close(s->wakeFds[0]);
+        ::close(s->wakeFds[1]);
+        throw Napi::Error::New(env, "ipc.listen unable to create socket: " + error);
+    }
+    // same as the websocket endpoint, a stale socket can only be from an old instance
+    ::unlink(path.c_str());
+    if (::bind(s->listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1
+        || ::listen(s->listenFd, 16) == -1) {
+        const std::string error = strerror(errno);
+        ::close(s->listenFd);
+        ::close(s->wakeFds[0]);
+        ::close(s->wakeFds[1]);
+        throw Napi::Error::New(env, "ipc.listen unable to listen on " + path + ": " + error);
+    }
+
+    server = std::move(s);
+    server->thread = std::thread(&Server::run, server.get());
+}
+
+void stop()
+{
+    if (!server)
+        return;
+    {
+        std::lock_guard<std::mutex> locker(server->mutex);
+        server->stopped = true;
+    }
+    server->wake();
+    server->thread.join();
+
+    ::close(server->listenFd);
+    ::close(server->wakeFds[0]);
+    ::close(server->wakeFds[1]);
+    ::unlink(server->path.c_str());
+    server.reset();
+}
+
+static std::string toString(const Napi::Env& env, const Napi::Value& value, const char* fn, const char* what)
+{
+    if (value.IsString())
+        return value.As<Napi::String>().Utf8Value();
+    if (value.IsBuffer()) {
+        auto buffer = value.As<Napi::Buffer<char> >();
+        return std::string(buffer.Data(), buffer.Length());
+    }
+    throw Napi::TypeError::New(env, std::string("ipc.") + fn + " requires a " + what);
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object ipc = Napi::Object::New(env);
+
+    ipc.Set("listen", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsString()) {
+            throw Napi::TypeError::New(env, "ipc.listen requires a path");
+        }
+
+        listen(env, info[0].As<Napi::String>().Utf8Value());
+
+        return env.Undefined();
+    }));
+
+    ipc.Set("close", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        stop();
+        return info.Env().Undefined();
+    }));
+
+    ipc.Set("publish", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2) {
+            throw Napi::TypeError::New(env, "ipc.publish requires two arguments");
+        }
+
+        const std::string name = toString(env, info[0], "publish", "section name");
+        auto data = std::make_shared<const std::string>(toString(env, info[1], "publish", "string or buffer"));
+        ++jsStats.published;
+        if (!server)
+            return env.Undefined();
+
+        // readers hold on to the old value for as long as they're sending it
+        std::lock_guard<std::mutex> locker(server->mutex);
+        server->sections[name] = std::move(data);
+
+        return env.Undefined();
+    }));
+
+    ipc.Set("emit", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2) {
+            throw Napi::TypeError::New(env, "ipc.emit requires two arguments");
+        }
+
+        std::string name = toString(env, info[0], "emit", "event name");
+        std::string data = toString(env, info[1], "emit", "string or buffer");
+        ++jsStats.emitted;
+        if (!server)
+            return env.Undefined();
+
+        {
+            std::lock_guard<std::mutex> locker(server->mutex);
+            server->events.emplace_back(std::move(name), std::move(data));
+        }
+        server->wake();
+
+        return env.Undefined();
+    }));
+
+    ipc.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("listening", Napi::Boolean::New(env, !!server));
+        ret.Set("published", Napi::Number::New(env, jsStats.published));
+        ret.Set("emitted", Napi::Number::New(env, jsStats.emitted));
+        ret.Set("connections", Napi::Number::New(env, server ? server->stats.connections.load() : 0));
+        ret.Set("queries", Napi::Number::New(env, server ? server->stats.queries.load() : 0));
+        ret.Set("events", Napi::Number::New(env, server ? server->stats.events.load() : 0));
+        ret.Set("dropped", Napi::Number::New(env, server ? server->stats.dropped.load() : 0));
+        return ret;
+    }));
+
+    return ipc;
+}
+
+} // namespace ipc
@@ -0,0 +1,13 @@
+#ifndef OWM_IPC_H
+#define OWM_IPC_H
+
+#include <napi.h>
+
+namespace ipc {
+
+Napi::Object make(napi_env env);
+void stop();
+
+}
+
+#endif
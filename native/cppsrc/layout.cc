@@ -0,0 +1,955 @@
+#include "layout.h"
+#include "owm.h"
+#include "spatial.h"
+#include "tree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+template<typename T>
+using Wrap = owm::Wrap<T>;
+using WM = owm::WM;
+
+namespace layout {
+
+// Items are handed over as a flat Int32Array, HintStride entries per item,
+// and the results come back as an Int32Array of ResultStride entries per
+// item. Going through typed arrays keeps a relayout down to a single call
+// regardless of how many clients are tiled.
+
+enum Hint {
+    HintBorder,
+    HintItemFlags,
+    HintFlags,
+    HintBaseWidth,
+    HintBaseHeight,
+    HintMinWidth,
+    HintMinHeight,
+    HintMaxWidth,
+    HintMaxHeight,
+    HintWidthInc,
+    HintHeightInc,
+    HintMinAspectNum,
+    HintMinAspectDen,
+    HintMaxAspectNum,
+    HintMaxAspectDen,
+    HintStride = 16
+};
+
+enum ItemFlag {
+    ItemTiled = 0x1,
+    ItemDock = 0x2,
+    // containers and anything else without size hints or a border
+    ItemPlain = 0x4
+};
+
+enum Result {
+    ResultFrameX,
+    ResultFrameY,
+    ResultFrameWidth,
+    ResultFrameHeight,
+    ResultX,
+    ResultY,
+    ResultWidth,
+    ResultHeight,
+    ResultStride
+};
+
+// same rules as Client._enforceSize
+static void enforce_size(const int32_t* hints, double& width, double& height, bool keepHeight)
+{
+    const int32_t flags = hints[HintFlags];
+
+    double baseWidth = 0, baseHeight = 0;
+    if (flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+        baseWidth = hints[HintBaseWidth];
+        baseHeight = hints[HintBaseHeight];
+    } else if (flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+        baseWidth = hints[HintMinWidth];
+        baseHeight = hints[HintMinHeight];
+    }
+
+    if (!(hints[HintItemFlags] & ItemTiled)) {
+        double minWidth = 0, minHeight = 0;
+        double maxWidth = 0, maxHeight = 0;
+
+        if (flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+            minWidth = hints[HintMinWidth];
+            minHeight = hints[HintMinHeight];
+        } else if (flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+            minWidth = hints[HintBaseWidth];
+            minHeight = hints[HintBaseHeight];
+        }
+        if (flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE) {
+            maxWidth = hints[HintMaxWidth];
+            maxHeight = hints[HintMaxHeight];
+        }
+
+        if (width < minWidth)
+            width = minWidth;
+        if (maxWidth > 0 && width > maxWidth)
+            width = maxWidth;
+        if (height < minHeight)
+            height = minHeight;
+        if (maxHeight > 0 && height > maxHeight)
+            height = maxHeight;
+
+        const bool haveMinAspect = hints[HintMinAspectNum] > 0 && hints[HintMinAspectDen] > 0;
+        const bool haveMaxAspect = hints[HintMaxAspectNum] > 0 && hints[HintMaxAspectDen] > 0;
+        const double dw = width - baseWidth;
+        const double dh = height - baseHeight;
+        if ((flags & XCB_ICCCM_SIZE_HINT_P_ASPECT) && dw > 0 && dh > 0 && (haveMinAspect || haveMaxAspect)) {
+            const double minAspect = haveMinAspect ? hints[HintMinAspectNum] / static_cast<double>(hints[HintMinAspectDen]) : 0;
+            const double maxAspect = haveMaxAspect ? hints[HintMaxAspectNum] / static_cast<double>(hints[HintMaxAspectDen]) : 0;
+            double ar = dw / dh;
+            if (haveMinAspect && ar < minAspect) {
+                ar = minAspect;
+            } else if (haveMaxAspect && ar > maxAspect) {
+                ar = maxAspect;
+            }
+
+            double nw, nh;
+            if (keepHeight) {
+                nw = std::round(dh * ar);
+                nh = std::round(nw / ar);
+            } else {
+                nh = std::round(dw / ar);
+                nw = std::round(nh * ar);
+            }
+
+            width = nw + baseWidth;
+            height = nh + baseHeight;
+        }
+    }
+
+    if (flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC) {
+        const int32_t widthInc = hints[HintWidthInc];
+        const int32_t heightInc = hints[HintHeightInc];
+        if (widthInc > 0 && width >= baseWidth) {
+            width = baseWidth + (width - baseWidth) - std::fmod(width - baseWidth, widthInc);
+        }
+        if (heightInc > 0 && height >= baseHeight) {
+            height = baseHeight + (height - baseHeight) - std::fmod(height - baseHeight, heightInc);
+        }
+    }
+}
+
+// equivalent of item.move(x, y) followed by item.resize(width, height)
+static void place(const int32_t* hints, int32_t* result, double x, double y, double width, double height)
+{
+    const int32_t itemFlags = hints[HintItemFlags];
+    const int32_t border = (itemFlags & ItemPlain) ? 0 : hints[HintBorder];
+
+    double cw = width - (border * 2);
+    double ch = height - (border * 2);
+    if (!(itemFlags & (ItemDock | ItemPlain))) {
+        enforce_size(hints, cw, ch, false);
+    }
+
+    // configure_window truncates, do the same up front so that what we
+    // report back is what the server ends up with
+    result[ResultFrameX] = static_cast<int32_t>(x);
+    result[ResultFrameY] = static_cast<int32_t>(y);
+    result[ResultX] = result[ResultFrameX] + border;
+    result[ResultY] = result[ResultFrameY] + border;
+    result[ResultWidth] = static_cast<int32_t>(cw);
+    result[ResultHeight] = static_cast<int32_t>(ch);
+    result[ResultFrameWidth] = result[ResultWidth] + (border * 2);
+    result[ResultFrameHeight] = result[ResultHeight] + (border * 2);
+}
+
+static double ratio(const std::vector<double>& ratios, uint32_t idx)
+{
+    if (idx < ratios.size() && std::isfinite(ratios[idx]))
+        return ratios[idx];
+    return 1.;
+}
+
+static std::vector<double> read_ratios(const Napi::Object& args, const char* key)
+{
+    std::vector<double> ratios;
+    if (!args.Has(key))
+        return ratios;
+    const auto value = args.Get(key);
+    if (value.IsTypedArray() && value.As<Napi::TypedArray>().TypedArrayType() == napi_float64_array) {
+        const auto array = value.As<Napi::Float64Array>();
+        ratios.assign(array.Data(), array.Data() + array.ElementLength());
+    } else if (value.IsArray()) {
+        const auto array = value.As<Napi::Array>();
+        ratios.reserve(array.Length());
+        for (uint32_t i = 0; i < array.Length(); ++i) {
+            const auto v = array.Get(i);
+            ratios.push_back(v.IsNumber() ? v.As<Napi::Number>().DoubleValue() : 1.);
+        }
+    }
+    return ratios;
+}
+
+static double number(const Napi::Object& args, const char* key, double def = 0)
+{
+    if (!args.Has(key))
+        return def;
+    const auto value = args.Get(key);
+    if (!value.IsNumber())
+        return def;
+    return value.As<Napi::Number>().DoubleValue();
+}
+
+// Everything that configures a window goes through send(), which remembers
+// what was last sent per window and leaves out whatever wouldn't change.
+// A relayout that ends up where it started, or a ConfigureRequest that asks
+// for the current geometry, then costs nothing, not even a ConfigureNotify
+// and the repaint that tends to follow it.
+
+struct Sent
+{
+    // x, y, width, height, border in XCB_CONFIG_WINDOW_* bit order
+    uint32_t values[5];
+    uint8_t known { 0 };
+    xcb_window_t sibling { XCB_NONE };
+    uint32_t stackMode { 0 };
+    // a restack is only a repeat if nothing else was restacked since
+    uint64_t stackGeneration { 0 };
+};
+
+static std::unordered_map<xcb_window_t, Sent> sent;
+static uint64_t stackGeneration = 0;
+
+static struct {
+    uint64_t requested { 0 };
+    uint64_t sent { 0 };
+    uint64_t suppressed { 0 };
+    uint64_t fieldsDropped { 0 };
+} configureStats;
+
+// ConfigureRequests for windows js has given a policy are answered right
+// here, games and video players can send hundreds of them a second. js only
+// hears about the outcome, once per window per batch, before whatever event
+// it gets to see next.
+
+enum Policy {
+    // hand the request to js
+    PolicyJs,
+    // forward it as is, for windows nobody manages
+    PolicyPassThrough,
+    // move and resize the client and its frame, within its size hints
+    PolicyFloating,
+    // the layout decides, answer with the current geometry
+    PolicyIgnore
+};
+
+struct Managed
+{
+    Policy policy { PolicyJs };
+    xcb_window_t frame { XCB_WINDOW_NONE };
+    // see Client.packLayoutHints
+    int32_t hints[HintStride] {};
+    // client geometry in root coordinates
+    int32_t x { 0 }, y { 0 }, width { 0 }, height { 0 };
+};
+
+struct Pending
+{
+    int32_t x { 0 }, y { 0 }, width { 0 }, height { 0 };
+    uint16_t requestedMask { 0 };
+    int32_t requested[4] {};
+};
+
+static std::unordered_map<xcb_window_t, Managed> managed;
+static Policy defaultPolicy = PolicyJs;
+static std::unordered_map<xcb_window_t, Pending> pending;
+static std::vector<xcb_window_t> pendingOrder;
+
+static struct {
+    uint64_t handled { 0 };
+    uint64_t forwarded { 0 };
+    uint64_t clamped { 0 };
+    uint64_t reported { 0 };
+} requestStats;
+
+// Frames on hidden workspaces can be parked offscreen instead of unmapped,
+// see xcb.set_states. Anything that moves them in the meantime only updates
+// where they'll go once they're back.
+static constexpr int32_t ParkedX = -32000;
+
+struct Parked
+{
+    int32_t x, y;
+};
+
+static std::unordered_map<xcb_window_t, Parked> parked;
+
+// Moving, mapping or restacking windows under a pointer that stays put makes
+// the server send crossing events, focus follows mouse would take those for
+// the user's doing. The requests we issue are remembered as ranges of
+// sequence numbers, EnterNotify events the server generated while working
+// through one of them are dropped. Each range is closed with a no-op at
+// flush time so that real pointer motion afterwards is never in one, and a
+// range never spans requests made by anyone else, one of those might have
+// been a round trip the pointer moved during.
+
+struct Range
+{
+    uint32_t first, last;
+};
+
+// past this the oldest two ranges are merged, the list stays bounded even
+// if nothing is read for a while and at worst a few more crossings get
+// dropped
+static constexpr size_t MaxRanges = 256;
+
+static struct {
+    bool enabled { false };
+    // the last range still grows until the next flush
+    bool open { false };
+    std::deque<Range> ranges;
+    // of the last event read, the server is done with everything before
+    uint32_t seen { 0 };
+    uint64_t suppressed { 0 };
+} crossings;
+
+// ranges behind sequence are done
+static void prune(uint32_t sequence)
+{
+    while (!crossings.ranges.empty() && static_cast<int32_t>(sequence - crossings.ranges.front().last) > 0) {
+        crossings.ranges.pop_front();
+        if (crossings.ranges.empty())
+            crossings.open = false;
+    }
+}
+
+void issued(uint32_t sequence)
+{
+    if (!crossings.enabled)
+        return;
+    if (crossings.open && crossings.ranges.back().last + 1 == sequence) {
+        crossings.ranges.back().last = sequence;
+        return;
+    }
+    if (crossings.ranges.size() >= MaxRanges) {
+        crossings.ranges[1].first = crossings.ranges[0].first;
+        crossings.ranges.pop_front();
+    }
+    crossings.ranges.push_back({ sequence, sequence });
+    crossings.open = true;
+}
+
+void settle(const std::shared_ptr<WM>& wm)
+{
+    prune(crossings.seen);
+    if (!crossings.open)
+        return;
+    xcb_no_operation(wm->conn);
+    crossings.open = false;
+}
+
+bool crossing(const xcb_generic_event_t* event)
+{
+    // events are read in sequence order
+    crossings.seen = event->full_sequence;
+    if (!crossings.enabled)
+        return false;
+    prune(event->full_sequence);
+
+    if ((event->response_type & ~0x80) != XCB_ENTER_NOTIFY
+        || reinterpret_cast<const xcb_enter_notify_event_t*>(event)->mode != XCB_NOTIFY_MODE_NORMAL)
+        return false;
+    if (crossings.ranges.empty() || static_cast<int32_t>(event->full_sequence - crossings.ranges.front().first) < 0)
+        return false;
+
+    ++crossings.suppressed;
+    return true;
+}
+
+bool send(const std::shared_ptr<WM>& wm, xcb_window_t window, uint16_t mask, const uint32_t* values)
+{
+    ++configureStats.requested;
+
+    uint32_t adjusted[7];
+    if ((mask & (XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y)) && !parked.empty()) {
+        auto it = parked.find(window);
+        if (it != parked.end()) {
+            memcpy(adjusted, values, sizeof(uint32_t) * __builtin_popcount(mask & 0x7f));
+            if (mask & XCB_CONFIG_WINDOW_X) {
+                it->second.x = static_cast<int32_t>(values[0]);
+                adjusted[0] = static_cast<uint32_t>(ParkedX);
+            }
+            if (mask & XCB_CONFIG_WINDOW_Y) {
+                it->second.y = static_cast<int32_t>(values[(mask & XCB_CONFIG_WINDOW_X) ? 1 : 0]);
+            }
+            values = adjusted;
+        }
+    }
+
+    Sent& last = sent[window];
+    uint32_t out[7];
+    uint16_t outMask = 0;
+    uint32_t in = 0, off = 0;
+
+    for (uint32_t field = 0; field < 5; ++field) {
+        const uint16_t bit = 1 << field;
+        if (!(mask & bit))
+            continue;
+        const uint32_t value = values[in++];
+        if ((last.known & bit) && last.values[field] == value) {
+            ++configureStats.fieldsDropped;
+            continue;
+        }
+        last.values[field] = value;
+        last.known |= bit;
+        outMask |= bit;
+        out[off++] = value;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+        const xcb_window_t sibling = (mask & XCB_CONFIG_WINDOW_SIBLING) ? values[in++] : XCB_NONE;
+        const uint32_t stackMode = values[in++];
+        if (last.stackGeneration && last.stackGeneration == stackGeneration
+            && last.sibling == sibling && last.stackMode == stackMode) {
+            ++configureStats.fieldsDropped;
+        } else {
+            if (mask & XCB_CONFIG_WINDOW_SIBLING) {
+                outMask |= XCB_CONFIG_WINDOW_SIBLING;
+                out[off++] = sibling;
+            }
+            outMask |= XCB_CONFIG_WINDOW_STACK_MODE;
+            out[off++] = stackMode;
+            last.sibling = sibling;
+            last.stackMode = stackMode;
+            last.stackGeneration = ++stackGeneration;
+        }
+    } else if (mask & XCB_CONFIG_WINDOW_SIBLING) {
+        // not valid without a stack mode, let the server say so
+        outMask |= XCB_CONFIG_WINDOW_SIBLING;
+        out[off++] = values[in++];
+    }
+
+    if (!outMask) {
+        ++configureStats.suppressed;
+        return false;
+    }
+
+    issued(xcb_configure_window(wm->conn, window, outMask, out).sequence);
+    spatial::configure(window, outMask, out);
+    ++configureStats.sent;
+    return true;
+}
+
+void restacked()
+{
+    ++stackGeneration;
+}
+
+void configured(xcb_window_t window, int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t border)
+{
+    auto it = sent.find(window);
+    if (it == sent.end()) {
+        // someone else restacked, repeats of ours might not be no-ops anymore
+        restacked();
+        return;
+    }
+    // notifies can trail requests sent after them, only ever forget here,
+    // the next request for a field that disagrees will go out again
+    Sent& last = it->second;
+    const uint32_t values[] = {
+        static_cast<uint32_t>(static_cast<int32_t>(x)),
+        static_cast<uint32_t>(static_cast<int32_t>(y)),
+        width, height, border
+    };
+    for (uint32_t field = 0; field < 5; ++field) {
+        if (last.values[field] != values[field])
+            last.known &= ~(1 << field);
+    }
+}
+
+void forget(xcb_window_t window)
+{
+    sent.erase(window);
+    managed.erase(window);
+    parked.erase(window);
+}
+
+void park(const std::shared_ptr<WM>& wm, xcb_window_t frame, int32_t x, int32_t y)
+{
+    if (parked.count(frame))
+        return;
+    const uint32_t values[] = { static_cast<uint32_t>(ParkedX) };
+    send(wm, frame, XCB_CONFIG_WINDOW_X, values);
+    parked[frame] = { x, y };
+}
+
+void unpark(const std::shared_ptr<WM>& wm, xcb_window_t frame)
+{
+    auto it = parked.find(frame);
+    if (it == parked.end())
+        return;
+    const uint32_t values[] = {
+        static_cast<uint32_t>(it->second.x),
+        static_cast<uint32_t>(it->second.y)
+    };
+    parked.erase(it);
+    send(wm, frame, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+}
+
+static void notify(const std::shared_ptr<WM>& wm, xcb_window_t window, int32_t x, int32_t y,
+                   int32_t width, int32_t height, uint16_t border)
+{
+    xcb_configure_notify_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.response_type = XCB_CONFIGURE_NOTIFY;
+    event.event = event.window = window;
+    event.above_sibling = XCB_NONE;
+    event.override_redirect = false;
+    event.x = x;
+    event.y = y;
+    event.width = width;
+    event.height = height;
+    event.border_width = border;
+    xcb_send_event(wm->conn, false, window, XCB_EVENT_MASK_STRUCTURE_NOTIFY, reinterpret_cast<char *>(&event));
+}
+
+static void forward(const std::shared_ptr<WM>& wm, const xcb_configure_request_event_t* event)
+{
+    uint32_t values[7];
+    uint32_t off = 0;
+    const uint16_t mask = event->value_mask;
+    if (mask & XCB_CONFIG_WINDOW_X)
+        values[off++] = static_cast<uint32_t>(static_cast<int32_t>(event->x));
+    if (mask & XCB_CONFIG_WINDOW_Y)
+        values[off++] = static_cast<uint32_t>(static_cast<int32_t>(event->y));
+    if (mask & XCB_CONFIG_WINDOW_WIDTH)
+        values[off++] = event->width;
+    if (mask & XCB_CONFIG_WINDOW_HEIGHT)
+        values[off++] = event->height;
+    if (mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+        values[off++] = event->border_width;
+    if (mask & XCB_CONFIG_WINDOW_SIBLING)
+        values[off++] = event->sibling;
+    if (mask & XCB_CONFIG_WINDOW_STACK_MODE)
+        values[off++] = event->stack_mode;
+
+    if (send(wm, event->window, mask, values))
+        return;
+
+    // nothing changed so the server won't say anything, the client may
+    // well be waiting to hear back though
+    int16_t x, y;
+    uint16_t width, height, border;
+    if (tree::geometry(event->window, x, y, width, height, border)) {
+        notify(wm, event->window, x, y, width, height, border);
+    }
+}
+
+static void report(const Managed& m, xcb_window_t window, const xcb_configure_request_event_t* event)
+{
+    auto it = pending.find(window);
+    if (it == pending.end()) {
+        it = pending.emplace(window, Pending()).first;
+        pendingOrder.push_back(window);
+    }
+    Pending& p = it->second;
+    p.x = m.x;
+    p.y = m.y;
+    p.width = m.width;
+    p.height = m.height;
+    const uint16_t mask = event->value_mask;
+    if (mask & XCB_CONFIG_WINDOW_X)
+        p.requested[0] = event->x;
+    if (mask & XCB_CONFIG_WINDOW_Y)
+        p.requested[1] = event->y;
+    if (mask & XCB_CONFIG_WINDOW_WIDTH)
+        p.requested[2] = event->width;
+    if (mask & XCB_CONFIG_WINDOW_HEIGHT)
+        p.requested[3] = event->height;
+    p.requestedMask |= mask & (XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT);
+}
+
+bool request(const std::shared_ptr<WM>& wm, const xcb_configure_request_event_t* event)
+{
+    auto it = managed.find(event->window);
+    const Policy policy = it == managed.end() ? defaultPolicy : it->second.policy;
+
+    switch (policy) {
+    case PolicyJs:
+        return false;
+    case PolicyPassThrough:
+        ++requestStats.forwarded;
+        forward(wm, event);
+        return true;
+    case PolicyFloating: {
+        // same as Client.configure for floating clients
+        Managed& m = it->second;
+        const uint16_t mask = event->value_mask;
+        double width = (mask & XCB_CONFIG_WINDOW_WIDTH) ? event->width : m.width;
+        double height = (mask & XCB_CONFIG_WINDOW_HEIGHT) ? event->height : m.height;
+        if (!(m.hints[HintItemFlags] & ItemDock)) {
+            const double w = width, h = height;
+            enforce_size(m.hints, width, height, false);
+            if (w != width || h != height)
+                ++requestStats.clamped;
+        }
+        if (mask & XCB_CONFIG_WINDOW_X)
+            m.x = event->x;
+        if (mask & XCB_CONFIG_WINDOW_Y)
+            m.y = event->y;
+        m.width = static_cast<int32_t>(width);
+        m.height = static_cast<int32_t>(height);
+
+        const int32_t border = m.hints[HintBorder];
+        const uint32_t clientValues[] = {
+            static_cast<uint32_t>(m.width),
+            static_cast<uint32_t>(m.height)
+        };
+        send(wm, event->window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, clientValues);
+        if (m.frame != XCB_WINDOW_NONE) {
+            const uint32_t frameValues[] = {
+                static_cast<uint32_t>(m.x - border),
+                static_cast<uint32_t>(m.y - border),
+                static_cast<uint32_t>(m.width + (border * 2)),
+                static_cast<uint32_t>(m.height + (border * 2))
+            };
+            const uint16_t frameMask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
+            send(wm, m.frame, frameMask, frameValues);
+        }
+        break; }
+    case PolicyIgnore:
+        // the layout decides, the client gets told where it still is
+        break;
+    }
+
+    ++requestStats.handled;
+    const Managed& m = it->second;
+    if (m.width > 0 && m.height > 0)
+        notify(wm, event->window, m.x, m.y, m.width, m.height, 0);
+    report(m, event->window, event);
+    return true;
+}
+
+void flush(const Napi::FunctionReference& fn)
+{
+    if (pendingOrder.empty())
+        return;
+
+    // js may well configure things from in here, start a new batch first
+    std::vector<xcb_window_t> order;
+    std::unordered_map<xcb_window_t, Pending> reports;
+    std::swap(order, pendingOrder);
+    std::swap(reports, pending);
+
+    auto env = fn.Env();
+    Napi::HandleScope scope(env);
+
+    auto configured = Napi::Array::New(env, order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const Pending& p = reports[order[i]];
+        auto entry = Napi::Object::New(env);
+        entry.Set("window", Napi::Number::New(env, order[i]));
+        entry.Set("x", Napi::Number::New(env, p.x));
+        entry.Set("y", Napi::Number::New(env, p.y));
+        entry.Set("width", Napi::Number::New(env, p.width));
+        entry.Set("height", Napi::Number::New(env, p.height));
+        auto requested = Napi::Object::New(env);
+        if (p.requestedMask & XCB_CONFIG_WINDOW_X)
+            requested.Set("x", Napi::Number::New(env, p.requested[0]));
+        if (p.requestedMask & XCB_CONFIG_WINDOW_Y)
+            requested.Set("y", Napi::Number::New(env, p.requested[1]));
+        if (p.requestedMask & XCB_CONFIG_WINDOW_WIDTH)
+            requested.Set("width", Napi::Number::New(env, p.requested[2]));
+        if (p.requestedMask & XCB_CONFIG_WINDOW_HEIGHT)
+            requested.Set("height", Napi::Number::New(env, p.requested[3]));
+        entry.Set("requested", requested);
+        configured.Set(i, entry);
+    }
+    requestStats.reported += order.size();
+
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("type", "configured");
+    obj.Set("configured", configured);
+
+    try {
+        napi_value nvalue = obj;
+        fn.Call({ nvalue });
+    } catch (const Napi::Error &e) {
+        owm::printException(__FUNCTION__, e);
+    }
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object layout = Napi::Object::New(env);
+
+    Napi::Object hint = Napi::Object::New(env);
+    hint.Set("Border", Napi::Number::New(env, HintBorder));
+    hint.Set("ItemFlags", Napi::Number::New(env, HintItemFlags));
+    hint.Set("Flags", Napi::Number::New(env, HintFlags));
+    hint.Set("BaseWidth", Napi::Number::New(env, HintBaseWidth));
+    hint.Set("BaseHeight", Napi::Number::New(env, HintBaseHeight));
+    hint.Set("MinWidth", Napi::Number::New(env, HintMinWidth));
+    hint.Set("MinHeight", Napi::Number::New(env, HintMinHeight));
+    hint.Set("MaxWidth", Napi::Number::New(env, HintMaxWidth));
+    hint.Set("MaxHeight", Napi::Number::New(env, HintMaxHeight));
+    hint.Set("WidthInc", Napi::Number::New(env, HintWidthInc));
+    hint.Set("HeightInc", Napi::Number::New(env, HintHeightInc));
+    hint.Set("MinAspectNum", Napi::Number::New(env, HintMinAspectNum));
+    hint.Set("MinAspectDen", Napi::Number::New(env, HintMinAspectDen));
+    hint.Set("MaxAspectNum", Napi::Number::New(env, HintMaxAspectNum));
+    hint.Set("MaxAspectDen", Napi::Number::New(env, HintMaxAspectDen));
+    hint.Set("Stride", Napi::Number::New(env, HintStride));
+    layout.Set("hint", hint);
+
+    Napi::Object itemFlag = Napi::Object::New(env);
+    itemFlag.Set("Tiled", Napi::Number::New(env, ItemTiled));
+    itemFlag.Set("Dock", Napi::Number::New(env, ItemDock));
+    itemFlag.Set("Plain", Napi::Number::New(env, ItemPlain));
+    layout.Set("itemFlag", itemFlag);
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("FrameX", Napi::Number::New(env, ResultFrameX));
+    result.Set("FrameY", Napi::Number::New(env, ResultFrameY));
+    result.Set("FrameWidth", Napi::Number::New(env, ResultFrameWidth));
+    result.Set("FrameHeight", Napi::Number::New(env, ResultFrameHeight));
+    result.Set("X", Napi::Number::New(env, ResultX));
+    result.Set("Y", Napi::Number::New(env, ResultY));
+    result.Set("Width", Napi::Number::New(env, ResultWidth));
+    result.Set("Height", Napi::Number::New(env, ResultHeight));
+    result.Set("Stride", Napi::Number::New(env, ResultStride));
+    layout.Set("result", result);
+
+    Napi::Object policy = Napi::Object::New(env);
+    policy.Set("Js", Napi::Number::New(env, PolicyJs));
+    policy.Set("PassThrough", Napi::Number::New(env, PolicyPassThrough));
+    policy.Set("Floating", Napi::Number::New(env, PolicyFloating));
+    policy.Set("Ignore", Napi::Number::New(env, PolicyIgnore));
+    layout.Set("policy", policy);
+
+    layout.Set("tile", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "layout.tile requires an argument");
+        }
+
+        const auto args = info[0].As<Napi::Object>();
+        if (!args.Has("hints") || !args.Get("hints").IsTypedArray()
+            || args.Get("hints").As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+            throw Napi::TypeError::New(env, "layout.tile requires an Int32Array of hints");
+        }
+        const auto hints = args.Get("hints").As<Napi::Int32Array>();
+
+        const uint32_t count = static_cast<uint32_t>(number(args, "count", hints.ElementLength() / HintStride));
+        if (count * HintStride > hints.ElementLength()) {
+            throw Napi::TypeError::New(env, "layout.tile hints too short for count");
+        }
+
+        const double x = number(args, "x");
+        const double y = number(args, "y");
+        const double width = number(args, "width");
+        const double height = number(args, "height");
+        const uint32_t cfgRows = static_cast<uint32_t>(number(args, "rows"));
+        const uint32_t cfgColumns = static_cast<uint32_t>(number(args, "columns"));
+        const auto rowRatios = read_ratios(args, "rowRatios");
+        const auto columnRatios = read_ratios(args, "columnRatios");
+
+        auto out = Napi::Int32Array::New(env, count * ResultStride);
+        if (!count)
+            return out;
+
+        uint32_t rows, columns;
+        if (cfgRows) {
+            rows = cfgRows;
+            columns = cfgColumns ? cfgColumns : (count + rows - 1) / rows;
+        } else if (cfgColumns) {
+            columns = cfgColumns;
+            rows = (count + columns - 1) / columns;
+        } else {
+            rows = 1;
+            columns = count;
+        }
+
+        const double wper = width / columns;
+        const double hper = height / rows;
+
+        const int32_t* in = hints.Data();
+        int32_t* res = out.Data();
+        uint32_t itemno = 0;
+
+        // mirrors the grid walk TilingLayoutPolicy used to do in JS,
+        // including how the last row/column takes up the remaining space
+        double cy = y;
+        double h = hper;
+        for (uint32_t row = 0; row < rows && itemno < count; ++row) {
+            if (row == rows - 1) {
+                h = (y + height) - cy;
+            }
+            const double rr = ratio(rowRatios, row);
+            double cx = x;
+            double w = wper;
+            for (uint32_t column = 0; column < columns && itemno < count; ++column) {
+                if (column == columns - 1) {
+                    w = (x + width) - cx;
+                }
+                const double cr = ratio(columnRatios, column);
+                place(in + (itemno * HintStride), res + (itemno * ResultStride), cx, cy, w * cr, h * rr);
+                ++itemno;
+                cx += w * cr;
+            }
+            cy += h * rr;
+        }
+
+        return out;
+    }));
+
+    layout.Set("configure", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 3 || !info[0].IsObject() || !info[1].IsTypedArray() || !info[2].IsTypedArray()) {
+            throw Napi::TypeError::New(env, "layout.configure requires three arguments");
+        }
+        if (info[1].As<Napi::TypedArray>().TypedArrayType() != napi_uint32_array
+            || info[2].As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+            throw Napi::TypeError::New(env, "layout.configure requires an Uint32Array of windows and an Int32Array of results");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        const auto windows = info[1].As<Napi::Uint32Array>();
+        const auto results = info[2].As<Napi::Int32Array>();
+
+        // windows holds a frame, client pair per result
+        const size_t count = std::min(windows.ElementLength() / 2, results.ElementLength() / ResultStride);
+        const uint32_t* win = windows.Data();
+        const int32_t* res = results.Data();
+
+        for (size_t i = 0; i < count; ++i, win += 2, res += ResultStride) {
+            const xcb_window_t frame = win[0];
+            const xcb_window_t client = win[1];
+            if (frame == XCB_WINDOW_NONE || client == XCB_WINDOW_NONE)
+                continue;
+
+            const uint32_t clientValues[] = {
+                static_cast<uint32_t>(res[ResultWidth]),
+                static_cast<uint32_t>(res[ResultHeight])
+            };
+            send(wm, client, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, clientValues);
+
+            const uint32_t frameValues[] = {
+                static_cast<uint32_t>(res[ResultFrameX]),
+                static_cast<uint32_t>(res[ResultFrameY]),
+                static_cast<uint32_t>(res[ResultFrameWidth]),
+                static_cast<uint32_t>(res[ResultFrameHeight])
+            };
+            const uint16_t frameMask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
+            send(wm, frame, frameMask, frameValues);
+
+            auto it = managed.find(client);
+            if (it != managed.end()) {
+                it->second.x = res[ResultX];
+                it->second.y = res[ResultY];
+                it->second.width = res[ResultWidth];
+                it->second.height = res[ResultHeight];
+            }
+
+            if (res[ResultWidth] <= 0 || res[ResultHeight] <= 0)
+                continue;
+
+            notify(wm, client, res[ResultX], res[ResultY], res[ResultWidth], res[ResultHeight], 0);
+        }
+
+        if (count) {
+            uv_async_send(wm->asyncFlush);
+        }
+
+        return env.Undefined();
+    }));
+
+    layout.Set("setPolicy", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "layout.setPolicy requires an argument");
+        }
+
+        const auto args = info[0].As<Napi::Object>();
+        const xcb_window_t window = static_cast<xcb_window_t>(number(args, "window"));
+        const auto policy = static_cast<Policy>(number(args, "policy", PolicyJs));
+        if (window == XCB_WINDOW_NONE || policy < PolicyJs || policy > PolicyIgnore) {
+            throw Napi::TypeError::New(env, "layout.setPolicy requires a window and a policy");
+        }
+
+        if (policy == PolicyJs) {
+            managed.erase(window);
+            return env.Undefined();
+        }
+
+        Managed& m = managed[window];
+        m.policy = policy;
+        m.frame = static_cast<xcb_window_t>(number(args, "frame", m.frame));
+        m.x = static_cast<int32_t>(number(args, "x", m.x));
+        m.y = static_cast<int32_t>(number(args, "y", m.y));
+        m.width = static_cast<int32_t>(number(args, "width", m.width));
+        m.height = static_cast<int32_t>(number(args, "height", m.height));
+        if (args.Has("hints")) {
+            const auto value = args.Get("hints");
+            if (!value.IsTypedArray() || value.As<Napi::TypedArray>().TypedArrayType() != napi_int32_array
+                || value.As<Napi::Int32Array>().ElementLength() < HintStride) {
+                throw Napi::TypeError::New(env, "layout.setPolicy requires hints to be an Int32Array");
+            }
+            memcpy(m.hints, value.As<Napi::Int32Array>().Data(), sizeof(m.hints));
+        }
+
+        return env.Undefined();
+    }));
+
+    layout.Set("setDefaultPolicy", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "layout.setDefaultPolicy requires a policy");
+        }
+        const auto policy = static_cast<Policy>(info[0].As<Napi::Number>().Int32Value());
+        if (policy != PolicyJs && policy != PolicyPassThrough) {
+            throw Napi::TypeError::New(env, "layout.setDefaultPolicy only takes Js or PassThrough");
+        }
+        defaultPolicy = policy;
+
+        return env.Undefined();
+    }));
+
+    layout.Set("setCrossingFilter", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsBoolean()) {
+            throw Napi::TypeError::New(env, "layout.setCrossingFilter requires a boolean");
+        }
+
+        crossings.enabled = info[0].As<Napi::Boolean>().Value();
+        if (!crossings.enabled) {
+            crossings.ranges.clear();
+            crossings.open = false;
+        }
+
+        return env.Undefined();
+    }));
+
+    layout.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("requested", Napi::Number::New(env, configureStats.requested));
+        ret.Set("sent", Napi::Number::New(env, configureStats.sent));
+        ret.Set("suppressed", Napi::Number::New(env, configureStats.suppressed));
+        ret.Set("fieldsDropped", Napi::Number::New(env, configureStats.fieldsDropped));
+        ret.Set("requestsHandled", Napi::Number::New(env, requestStats.handled));
+        ret.Set("requestsForwarded", Napi::Number::New(env, requestStats.forwarded));
+        ret.Set("requestsClamped", Napi::Number::New(env, requestStats.clamped));
+        ret.Set("requestsReported", Napi::Number::New(env, requestStats.reported));
+        ret.Set("crossingsSuppressed", Napi::Number::New(env, crossings.suppressed));
+        return ret;
+    }));
+
+    return layout;
+}
+
+} // namespace layout
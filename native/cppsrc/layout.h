@@ -0,0 +1,45 @@
+#ifndef OWM_LAYOUT_H
+#define OWM_LAYOUT_H
+
+#include <napi.h>
+#include <xcb/xcb.h>
+#include <memory>
+
+namespace owm {
+struct WM;
+}
+
+namespace layout {
+
+Napi::Object make(napi_env env);
+
+// configure_window that skips whatever was already sent for the window,
+// returns false if that was everything
+bool send(const std::shared_ptr<owm::WM>& wm, xcb_window_t window, uint16_t mask, const uint32_t* values);
+// a real ConfigureNotify, forgets whatever it disagrees with
+void configured(xcb_window_t window, int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t border);
+void forget(xcb_window_t window);
+// something else changed the stacking order, a new, mapped or reparented
+// window. Restacks we sent before aren't necessarily no-ops anymore
+void restacked();
+// keep a frame mapped but out of sight, x/y is where it goes back to
+void park(const std::shared_ptr<owm::WM>& wm, xcb_window_t frame, int32_t x, int32_t y);
+void unpark(const std::shared_ptr<owm::WM>& wm, xcb_window_t frame);
+
+// a request that moves, maps, unmaps or restacks something, see
+// setCrossingFilter. settle() closes the current batch before a flush
+void issued(uint32_t sequence);
+void settle(const std::shared_ptr<owm::WM>& wm);
+// every event as it's read off the connection, in order. true for an
+// EnterNotify caused by our own requests, not the pointer
+bool crossing(const xcb_generic_event_t* event);
+
+// answers the request if js gave the window a policy that allows it,
+// returns false if js has to see it
+bool request(const std::shared_ptr<owm::WM>& wm, const xcb_configure_request_event_t* event);
+// tells js how the requests handled since the last call turned out
+void flush(const Napi::FunctionReference& fn);
+
+}
+
+#endif
@@ -1,6 +1,16 @@
 #include "owm.h"
 #include "graphics.h"
+#include "compositor.h"
+#include "layout.h"
+#include "spatial.h"
+#include "stacking.h"
+#include "property.h"
+#include "ipc.h"
+#include "snapshot.h"
+#include "tree.h"
 #include <atomic>
+#include <deque>
+#include <unordered_map>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/epoll.h>
@@ -12,11 +22,300 @@ struct Data
     xcb_window_t ewmhWindow;
     uv_async_t asyncFlush;
     uv_poll_t pollXcb;
+    uv_idle_t pumpIdle;
     Napi::FunctionReference callback;
 };
 
 static Data data;
 
+// Events are pulled off the connection as soon as they arrive but handed to
+// js in priority order, input first, then structural changes, then property
+// changes and exposes. A pass only delivers so many, whatever is left goes
+// out on the next loop iteration so timers and ipc get to run in between.
+//
+// Two exceptions keep that from going wrong. A window's PropertyNotify moves
+// ahead with the first structural event queued for the same window after
+// it, clients set WM_NORMAL_HINTS and then ask to be configured and policies
+// need to see the hints first. And a queue whose oldest event has waited
+// PumpMaxWait goes before anything else, pointer motion alone can keep the
+// input queue busy indefinitely.
+enum EventPriority {
+    PriorityInput,
+    PriorityStructure,
+    PriorityProperty,
+    PriorityCount
+};
+
+static constexpr size_t PumpBudget = 64;
+static constexpr uint64_t PumpMaxWait = 50;
+
+struct QueuedEvent
+{
+    xcb_generic_event_t* event;
+    // loop time when it was queued
+    uint64_t queued;
+};
+
+static struct {
+    std::deque<QueuedEvent> queues[PriorityCount];
+    size_t queued { 0 };
+    // PropertyNotify events waiting per window
+    std::unordered_map<xcb_window_t, uint32_t> properties;
+} pump;
+
+static EventPriority eventPriority(const std::shared_ptr<owm::WM>& wm, const xcb_generic_event_t* event)
+{
+    if (event->response_type == wm->xkb.event)
+        return PriorityInput;
+
+    switch (event->response_type & ~0x80) {
+    case XCB_KEY_PRESS:
+    case XCB_KEY_RELEASE:
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+    case XCB_MOTION_NOTIFY:
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+    case XCB_FOCUS_IN:
+    case XCB_FOCUS_OUT:
+    case XCB_MAPPING_NOTIFY:
+        return PriorityInput;
+    case XCB_PROPERTY_NOTIFY:
+    case XCB_EXPOSE:
+    case XCB_GRAPHICS_EXPOSURE:
+    case XCB_NO_EXPOSURE:
+    case XCB_VISIBILITY_NOTIFY:
+    case XCB_COLORMAP_NOTIFY:
+        return PriorityProperty;
+    default:
+        // errors, window lifetime and geometry, client messages, randr
+        return PriorityStructure;
+    }
+}
+
+// the window a structural event is about, XCB_NONE if it isn't about one
+static xcb_window_t structureWindow(const xcb_generic_event_t* event)
+{
+    switch (event->response_type & ~0x80) {
+    case XCB_CONFIGURE_REQUEST:
+        return reinterpret_cast<const xcb_configure_request_event_t*>(event)->window;
+    case XCB_MAP_REQUEST:
+        return reinterpret_cast<const xcb_map_request_event_t*>(event)->window;
+    case XCB_CIRCULATE_REQUEST:
+        return reinterpret_cast<const xcb_circulate_request_event_t*>(event)->window;
+    case XCB_CLIENT_MESSAGE:
+        return reinterpret_cast<const xcb_client_message_event_t*>(event)->window;
+    case XCB_CONFIGURE_NOTIFY:
+        return reinterpret_cast<const xcb_configure_notify_event_t*>(event)->window;
+    case XCB_MAP_NOTIFY:
+        return reinterpret_cast<const xcb_map_notify_event_t*>(event)->window;
+    case XCB_UNMAP_NOTIFY:
+        return reinterpret_cast<const xcb_unmap_notify_event_t*>(event)->window;
+    case XCB_DESTROY_NOTIFY:
+        return reinterpret_cast<const xcb_destroy_notify_event_t*>(event)->window;
+    case XCB_REPARENT_NOTIFY:
+        return reinterpret_cast<const xcb_reparent_notify_event_t*>(event)->window;
+    default:
+        return XCB_NONE;
+    }
+}
+
+static inline bool isPropertyNotify(const xcb_generic_event_t* event)
+{
+    return (event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY;
+}
+
+static void queueEvent(xcb_generic_event_t* event, EventPriority priority)
+{
+    const uint64_t now = uv_now(uv_default_loop());
+    if (priority == PriorityStructure && !pump.properties.empty()) {
+        const xcb_window_t window = structureWindow(event);
+        auto it = window != XCB_NONE ? pump.properties.find(window) : pump.properties.end();
+        if (it != pump.properties.end()) {
+            auto& properties = pump.queues[PriorityProperty];
+            auto& structure = pump.queues[PriorityStructure];
+            for (auto q = properties.begin(); q != properties.end();) {
+                if (isPropertyNotify(q->event)
+                    && reinterpret_cast<const xcb_property_notify_event_t*>(q->event)->window == window) {
+                    structure.push_back(*q);
+                    q = properties.erase(q);
+                } else {
+                    ++q;
+                }
+            }
+            pump.properties.erase(it);
+        }
+    } else if (priority == PriorityProperty && isPropertyNotify(event)) {
+        ++pump.properties[reinterpret_cast<const xcb_property_notify_event_t*>(event)->window];
+    }
+    pump.queues[priority].push_back({ event, now });
+    ++pump.queued;
+}
+
+// moves whatever xcb has to the queues. Only reads from the socket when
+// asked to, events that came in while js was running are already queued
+// in xcb and picking them up is cheap
+static bool drainEvents(const std::shared_ptr<owm::WM>& wm, bool read)
+{
+    const auto damageevent = wm->composite.present ? wm->composite.damageEvent + XCB_DAMAGE_NOTIFY : -1;
+    const auto shmevent = wm->shm.present ? wm->shm.event + XCB_SHM_COMPLETION : -1;
+
+    for (;;) {
+        if (xcb_connection_has_error(wm->conn)) {
+            // more badness
+            printf("bad conn\n");
+            return false;
+        }
+        xcb_generic_event_t *event = read ? xcb_poll_for_event(wm->conn) : xcb_poll_for_queued_event(wm->conn);
+        if (!event)
+            break;
+        if ((event->response_type & ~0x80) == damageevent) {
+            // never goes to js, no point in holding it back
+            graphics::handleDamage(event);
+            free(event);
+            continue;
+        }
+        if ((event->response_type & ~0x80) == shmevent) {
+            // same, only tells us a segment can be drawn on again
+            graphics::handleShmCompletion(event);
+            free(event);
+            continue;
+        }
+        if (layout::crossing(event)) {
+            // caused by our own requests, has to be decided in sequence order
+            free(event);
+            continue;
+        }
+        if ((event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY) {
+            auto property = reinterpret_cast<xcb_property_notify_event_t*>(event);
+            if (property->atom == wm->ewmh->_NET_WM_ICON) {
+                // the cache has to know even if js doesn't
+                graphics::invalidateIcon(wm, property->window, true);
+            }
+            if (!property::notify(property)) {
+                free(event);
+                continue;
+            }
+        }
+        queueEvent(event, eventPriority(wm, event));
+    }
+    return true;
+}
+
+static xcb_generic_event_t* nextEvent()
+{
+    const uint64_t now = uv_now(uv_default_loop());
+    int pick = -1;
+    for (int p = PriorityInput + 1; p < PriorityCount; ++p) {
+        const auto& queue = pump.queues[p];
+        if (!queue.empty() && now - queue.front().queued >= PumpMaxWait) {
+            pick = p;
+            break;
+        }
+    }
+    for (int p = 0; pick == -1 && p < PriorityCount; ++p) {
+        if (!pump.queues[p].empty())
+            pick = p;
+    }
+    if (pick == -1)
+        return nullptr;
+
+    auto& queue = pump.queues[pick];
+    xcb_generic_event_t* event = queue.front().event;
+    queue.pop_front();
+    --pump.queued;
+    if (pick == PriorityProperty && isPropertyNotify(event)) {
+        auto it = pump.properties.find(reinterpret_cast<const xcb_property_notify_event_t*>(event)->window);
+        if (it != pump.properties.end() && --it->second == 0)
+            pump.properties.erase(it);
+    }
+    return event;
+}
+
+static void deliverEvent(const std::shared_ptr<owm::WM>& wm, xcb_generic_event_t* event)
+{
+    const auto xkbevent = wm->xkb.event;
+    const auto randrevent = wm->randr.event;
+
+    if (event->response_type == xkbevent) {
+        owm::handleXkb(data.wm, data.callback, reinterpret_cast<owm::_xkb_event*>(event));
+    } else if (event->response_type == randrevent + XCB_RANDR_NOTIFY) {
+        // handle this?
+        free(event);
+    } else if (event->response_type == randrevent + XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE) {
+        free(event);
+        // type xcb_randr_screen_change_notify_event_t
+        owm::queryScreens(wm);
+        layout::flush(data.callback);
+        auto env = data.callback.Env();
+        Napi::HandleScope scope(env);
+        try {
+            napi_value nvalue = owm::makeScreens(env, wm);
+            data.callback.Call({ nvalue });
+        } catch (const Napi::Error& e) {
+            owm::printException(__FUNCTION__, e);
+        }
+    } else {
+        owm::handleXcb(wm, data.callback, event);
+    }
+}
+
+static void pumpEvents();
+
+static void schedulePump()
+{
+    // come back after the loop had a chance to run timers and io
+    if (!uv_is_active(reinterpret_cast<uv_handle_t*>(&data.pumpIdle))) {
+        uv_idle_start(&data.pumpIdle, [](uv_idle_t*) { pumpEvents(); });
+    }
+}
+
+// coalesced property notifies whose delay is up
+static void deliverHeld(xcb_generic_event_t* event)
+{
+    queueEvent(event, PriorityProperty);
+    schedulePump();
+}
+
+static void pumpEvents()
+{
+    auto wm = data.wm;
+    if (!wm) {
+        // uuuh, bad!
+        return;
+    }
+
+    if (!drainEvents(wm, true))
+        return;
+
+    size_t budget = PumpBudget;
+    while (budget > 0 && pump.queued > 0) {
+        deliverEvent(wm, nextEvent());
+        --budget;
+        if (!data.wm) {
+            // stopped from js
+            return;
+        }
+        // anything more urgent that came in meanwhile goes first
+        if (!drainEvents(wm, false))
+            return;
+    }
+    if (!pump.queued) {
+        // js may have done round trips that read events off the socket,
+        // the fd won't be readable for those
+        if (!drainEvents(wm, true))
+            return;
+    }
+
+    layout::flush(data.callback);
+
+    if (pump.queued > 0) {
+        schedulePump();
+    } else {
+        uv_idle_stop(&data.pumpIdle);
+    }
+}
+
 static inline void initAtoms(std::shared_ptr<owm::WM>& wm)
 {
     auto& atoms = wm->atoms;
@@ -236,6 +535,8 @@ Napi::Value Start(const Napi::CallbackInfo& info)
 
     auto flush = [](uv_async_t* async) {
         if (data.wm) {
+            property::flush(data.wm);
+            layout::settle(data.wm);
             xcb_flush(data.wm->conn);
         }
     };
@@ -253,6 +554,7 @@ Napi::Value Start(const Napi::CallbackInfo& info)
     }
 
     wm->asyncFlush = &data.asyncFlush;
+    wm->display = display;
 
     wm->defaultScreenNo = defaultScreen;
     wm->defaultScreen = xcb_aux_get_screen(wm->conn, wm->defaultScreenNo);
@@ -266,6 +568,10 @@ Napi::Value Start(const Napi::CallbackInfo& info)
     // prefetch extensions
     xcb_prefetch_extension_data(wm->conn, &xcb_xkb_id);
     xcb_prefetch_extension_data(wm->conn, &xcb_randr_id);
+    xcb_prefetch_extension_data(wm->conn, &xcb_shm_id);
+    xcb_prefetch_extension_data(wm->conn, &xcb_composite_id);
+    xcb_prefetch_extension_data(wm->conn, &xcb_damage_id);
+    xcb_prefetch_extension_data(wm->conn, &xcb_render_id);
 
     std::unique_ptr<xcb_generic_error_t> err;
 
@@ -372,12 +678,13 @@ Napi::Value Start(const Napi::CallbackInfo& info)
 
         for (unsigned int i = 0; i < tree->children_len; ++i) {
             xcb_get_window_attributes_reply_t* attrib = xcb_get_window_attributes_reply(conn, attribCookies[i], nullptr);
+            xcb_get_geometry_reply_t* geom = xcb_get_geometry_reply(conn, geomCookies[i], nullptr);
+            tree::add(wins[i], root, geom, attrib);
             if (attrib->map_state == XCB_MAP_STATE_UNMAPPED) {
-                xcb_discard_reply(conn, geomCookies[i].sequence);
                 free(attrib);
+                free(geom);
                 continue;
             }
-            xcb_get_geometry_reply_t* geom = xcb_get_geometry_reply(conn, geomCookies[i], nullptr);
             if (geom->width < 1 || geom->height < 1) {
                 free(attrib);
                 free(geom);
@@ -515,7 +822,9 @@ Napi::Value Start(const Napi::CallbackInfo& info)
     };
 
     {
+        // SubstructureNotify is only for the shadow tree, see tree.cc
         const uint32_t values[] = { XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
+                                    | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY
                                     | XCB_EVENT_MASK_ENTER_WINDOW
                                     | XCB_EVENT_MASK_LEAVE_WINDOW
                                     | XCB_EVENT_MASK_STRUCTURE_NOTIFY
@@ -525,6 +834,7 @@ Napi::Value Start(const Napi::CallbackInfo& info)
                                     | XCB_EVENT_MASK_PROPERTY_CHANGE };
         const auto root = wm->defaultScreen->root;
         xcb_void_cookie_t cookie = xcb_change_window_attributes_checked(wm->conn, root, XCB_CW_EVENT_MASK, values);
+        tree::reset(root);
         queryWindows(wm->conn, wm->ewmh, wm->atoms, root);
         err.reset(xcb_request_check(wm->conn, cookie));
         if (err) {
@@ -599,7 +909,17 @@ Napi::Value Start(const Napi::CallbackInfo& info)
             throw Napi::TypeError::New(env, "Unable get select xkb events");
         }
 
-        wm->xkb = { reply->first_event, ctx, xcb_key_symbols_alloc(wm->conn), keymap, state, deviceId };
+        // held keys send a press per repeat and a single release at the end,
+        // lets owm tell repeats apart from the key being pressed again
+        auto flagsCookie = xcb_xkb_per_client_flags(wm->conn, XCB_XKB_ID_USE_CORE_KBD,
+                                                    XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT,
+                                                    XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT,
+                                                    0, 0, 0);
+        auto flagsReply = xcb_xkb_per_client_flags_reply(wm->conn, flagsCookie, nullptr);
+        const bool detectableRepeat = flagsReply && (flagsReply->value & XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT);
+        free(flagsReply);
+
+        wm->xkb = { reply->first_event, ctx, xcb_key_symbols_alloc(wm->conn), keymap, state, deviceId, detectableRepeat };
     }
 
     {
@@ -630,6 +950,42 @@ Napi::Value Start(const Napi::CallbackInfo& info)
         }
     }
 
+    {
+        // MIT-SHM is optional, image surfaces fall back to put_image without it
+        auto reply = xcb_get_extension_data(wm->conn, &xcb_shm_id);
+        if (reply && reply->present) {
+            auto versionCookie = xcb_shm_query_version(wm->conn);
+            auto versionReply = xcb_shm_query_version_reply(wm->conn, versionCookie, nullptr);
+            if (versionReply) {
+                wm->shm.present = true;
+                wm->shm.event = reply->first_event;
+                free(versionReply);
+            }
+        }
+    }
+
+    {
+        // composite, damage and render are optional too, only thumbnails need them
+        auto composite = xcb_get_extension_data(wm->conn, &xcb_composite_id);
+        auto damage = xcb_get_extension_data(wm->conn, &xcb_damage_id);
+        auto render = xcb_get_extension_data(wm->conn, &xcb_render_id);
+        if (composite && composite->present && damage && damage->present && render && render->present) {
+            auto compositeCookie = xcb_composite_query_version(wm->conn, XCB_COMPOSITE_MAJOR_VERSION, XCB_COMPOSITE_MINOR_VERSION);
+            auto damageCookie = xcb_damage_query_version(wm->conn, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+            auto renderCookie = xcb_render_query_version(wm->conn, XCB_RENDER_MAJOR_VERSION, XCB_RENDER_MINOR_VERSION);
+            auto compositeReply = xcb_composite_query_version_reply(wm->conn, compositeCookie, nullptr);
+            auto damageReply = xcb_damage_query_version_reply(wm->conn, damageCookie, nullptr);
+            auto renderReply = xcb_render_query_version_reply(wm->conn, renderCookie, nullptr);
+            if (compositeReply && damageReply && renderReply) {
+                wm->composite.present = true;
+                wm->composite.damageEvent = damage->first_event;
+            }
+            free(compositeReply);
+            free(damageReply);
+            free(renderReply);
+        }
+    }
+
     // make our supporting window
     data.ewmhWindow = xcb_generate_id(wm->conn);
     xcb_create_window(wm->conn, XCB_COPY_FROM_PARENT, data.ewmhWindow, wm->defaultScreen->root, -1, -1, 1, 1, 0,
@@ -645,6 +1001,14 @@ Napi::Value Start(const Napi::CallbackInfo& info)
     obj.Set("xcb", owm::makeXcb(env, wm));
     obj.Set("xkb", owm::makeXkb(env, wm));
     obj.Set("graphics", graphics::make(env));
+    obj.Set("compositor", compositor::make(env));
+    obj.Set("layout", layout::make(env));
+    obj.Set("spatial", spatial::make(env));
+    obj.Set("stacking", stacking::make(env));
+    obj.Set("property", property::make(env));
+    obj.Set("ipc", ipc::make(env));
+    obj.Set("snapshot", snapshot::make(env));
+    obj.Set("tree", tree::make(env));
     obj.Set("wm", owm::Wrap<std::shared_ptr<owm::WM> >::wrap(env, wm));
     obj.Set("ewmh", Napi::Number::New(env, data.ewmhWindow));
 
@@ -660,45 +1024,12 @@ Napi::Value Start(const Napi::CallbackInfo& info)
     xcb_flush(wm->conn);
 
     auto handleXcbEvent = [](uv_poll_t* handle, int status, int events) -> void {
-        auto wm = data.wm;
-        if (!wm) {
-            // uuuh, bad!
-            return;
-        }
-
-        const auto xkbevent = wm->xkb.event;
-        const auto randrevent = wm->randr.event;
-
-        for (;;) {
-            if (xcb_connection_has_error(wm->conn)) {
-                // more badness
-                printf("bad conn\n");
-                return;
-            }
-            xcb_generic_event_t *event = xcb_poll_for_event(wm->conn);
-            if (!event)
-                break;
-            if (event->response_type == xkbevent) {
-                owm::handleXkb(wm, data.callback, reinterpret_cast<owm::_xkb_event*>(event));
-            } else if (event->response_type == randrevent + XCB_RANDR_NOTIFY) {
-                // handle this?
-            } else if (event->response_type == randrevent + XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE) {
-                // type xcb_randr_screen_change_notify_event_t
-                owm::queryScreens(wm);
-                auto env = data.callback.Env();
-                Napi::HandleScope scope(env);
-                try {
-                    napi_value nvalue = owm::makeScreens(env, wm);
-                    data.callback.Call({ nvalue });
-                } catch (const Napi::Error& e) {
-                    owm::printException(__FUNCTION__, e);
-                }
-            } else {
-                owm::handleXcb(wm, data.callback, event);
-            }
-        }
+        pumpEvents();
     };
 
+    uv_idle_init(loop, &data.pumpIdle);
+    property::init(loop, deliverHeld);
+
     const int xcbfd = xcb_get_file_descriptor(wm->conn);
     uv_poll_init(loop, &data.pollXcb, xcbfd);
     uv_poll_start(&data.pollXcb, UV_READABLE, handleXcbEvent);
@@ -715,15 +1046,31 @@ void Stop(const Napi::CallbackInfo& info)
     }
     data.started = false;
 
+    compositor::stop();
+    ipc::stop();
+    snapshot::stop();
+    property::stop();
+
     xcb_ewmh_connection_wipe(data.wm->ewmh);
     xcb_destroy_window(data.wm->conn, data.ewmhWindow);
     free(data.wm->ewmh);
     xcb_disconnect(data.wm->conn);
 
     uv_poll_stop(&data.pollXcb);
+    uv_idle_stop(&data.pumpIdle);
+
+    for (auto& queue : pump.queues) {
+        for (const auto& queued : queue) {
+            free(queued.event);
+        }
+        queue.clear();
+    }
+    pump.queued = 0;
+    pump.properties.clear();
 
     uv_close(reinterpret_cast<uv_handle_t*>(&data.asyncFlush), nullptr);
     uv_close(reinterpret_cast<uv_handle_t*>(&data.pollXcb), nullptr);
+    uv_close(reinterpret_cast<uv_handle_t*>(&data.pumpIdle), nullptr);
 
     data.callback.Reset();
     data.wm.reset();
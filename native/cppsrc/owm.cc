@@ -1,5 +1,14 @@
 #include "owm.h"
+#include "graphics.h"
+#include "spatial.h"
+#include "tree.h"
+#include "layout.h"
+#include "stacking.h"
+#include "property.h"
 #include <stdlib.h>
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <xcb/xcb_errors.h>
 
 namespace owm
@@ -70,7 +79,7 @@ static Napi::Value makeMotionNotify(napi_env env, xcb_motion_notify_event_t *eve
     return obj;
 }
 
-static Napi::Value makeKeyPress(napi_env env, xcb_key_press_event_t *event, const std::shared_ptr<WM> &wm)
+static Napi::Value makeKeyPress(napi_env env, xcb_key_press_event_t *event, const std::shared_ptr<WM> &wm, bool repeat)
 {
     Napi::Object obj = Napi::Object::New(env);
 
@@ -80,6 +89,7 @@ static Napi::Value makeKeyPress(napi_env env, xcb_key_press_event_t *event, cons
         const auto sym = xcb_key_press_lookup_keysym(wm->xkb.syms, event, col);
         obj.Set("sym", sym);
         obj.Set("is_modifier", xcb_is_modifier_key(sym));
+        obj.Set("repeat", repeat);
     }
 
     obj.Set("type", type);
@@ -330,6 +340,160 @@ static Napi::Value makeClientMessage(napi_env env, xcb_client_message_event_t *e
     return obj;
 }
 
+// Click to focus without waiting for js. The plain button 1 grab on the root
+// window is synchronous, the pointer stays frozen until it's released. For
+// frames js has told us how to focus, see xcb.set_click_focus, the click is
+// replayed and the client focused right here, js only catches up after.
+// Only while the js focus policy focuses on click, see
+// xcb.set_click_focus_enabled.
+
+enum ClickFocusMode {
+    ClickFocusNone,
+    ClickFocusInput,
+    ClickFocusTakeFocus
+};
+
+struct ClickFocus
+{
+    xcb_window_t window;
+    ClickFocusMode mode;
+};
+
+static std::unordered_map<xcb_window_t, ClickFocus> clickFocus;
+static xcb_window_t focusedFrame = XCB_WINDOW_NONE;
+static bool clickFocusEnabled = false;
+
+// returns the window that got focus, or none if js has to handle the click
+static xcb_window_t handleClickFocus(const std::shared_ptr<WM> &wm, const xcb_button_press_event_t *press)
+{
+    // modified clicks belong to the move/resize grab, CapsLock and NumLock
+    // (Lock and Mod2) are latched and don't make a click a modified one
+    const uint16_t modifiers = XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_CONTROL | XCB_MOD_MASK_1
+        | XCB_MOD_MASK_3 | XCB_MOD_MASK_4 | XCB_MOD_MASK_5;
+    if (!clickFocusEnabled || press->detail != 1 || (press->state & modifiers) || press->event != wm->defaultScreen->root)
+        return XCB_WINDOW_NONE;
+    if (press->child == XCB_WINDOW_NONE || press->child == focusedFrame)
+        return XCB_WINDOW_NONE;
+
+    auto it = clickFocus.find(press->child);
+    if (it == clickFocus.end() || it->second.mode == ClickFocusNone)
+        return XCB_WINDOW_NONE;
+
+    xcb_allow_events(wm->conn, XCB_ALLOW_REPLAY_POINTER, press->time);
+
+    const ClickFocus &target = it->second;
+    if (target.mode == ClickFocusTakeFocus) {
+        xcb_client_message_event_t event;
+        memset(&event, 0, sizeof(event));
+        event.response_type = XCB_CLIENT_MESSAGE;
+        event.format = 32;
+        event.window = target.window;
+        event.type = wm->ewmh->WM_PROTOCOLS;
+        event.data.data32[0] = wm->atoms.at("WM_TAKE_FOCUS");
+        event.data.data32[1] = press->time;
+        xcb_send_event(wm->conn, false, target.window, XCB_EVENT_MASK_STRUCTURE_NOTIFY, reinterpret_cast<char *>(&event));
+    } else {
+        xcb_set_input_focus(wm->conn, XCB_INPUT_FOCUS_PARENT, target.window, press->time);
+    }
+
+    // the whole point, don't wait for js to be done
+    xcb_flush(wm->conn);
+
+    focusedFrame = press->child;
+    return target.window;
+}
+
+// Key auto-repeat. With detectable auto-repeat, see Start, a held key sends a
+// press per repeat and one release when it's let go, so a press for a key
+// that's already down is a repeat. Servers without it send a release and a
+// press with the same timestamp per repeat instead. Repeats of bindings js
+// registered with xcb.set_key_repeat are rate limited or dropped right here,
+// they never make it into js.
+
+enum KeyRepeatMode {
+    KeyRepeatEvery,
+    KeyRepeatThrottle,
+    KeyRepeatFirst
+};
+
+struct KeyRepeat
+{
+    KeyRepeatMode mode;
+    uint32_t interval;
+    bool sync;
+    xcb_timestamp_t last;
+};
+
+static struct {
+    std::bitset<256> down;
+    std::array<xcb_timestamp_t, 256> released {};
+    // keycode << 16 | modifiers, XCB_MOD_MASK_ANY for bindings in modes
+    // that don't match modifiers
+    std::unordered_map<uint32_t, KeyRepeat> bindings;
+    uint64_t delivered { 0 };
+    uint64_t dropped { 0 };
+} keyRepeat;
+
+static inline uint32_t keyRepeatKey(xcb_keycode_t key, uint16_t modifiers)
+{
+    return (static_cast<uint32_t>(key) << 16) | modifiers;
+}
+
+// returns false if js shouldn't see the event
+static bool handleKeyRepeat(const std::shared_ptr<WM> &wm, const xcb_key_press_event_t *event, bool &repeat)
+{
+    repeat = false;
+    if ((event->response_type & ~0x80) == XCB_KEY_RELEASE) {
+        keyRepeat.down.reset(event->detail);
+        keyRepeat.released[event->detail] = event->time;
+        return true;
+    }
+
+    if (wm->xkb.detectableRepeat) {
+        repeat = keyRepeat.down.test(event->detail);
+    } else {
+        repeat = keyRepeat.released[event->detail] == event->time;
+    }
+    keyRepeat.down.set(event->detail);
+
+    auto it = keyRepeat.bindings.find(keyRepeatKey(event->detail, event->state));
+    if (it == keyRepeat.bindings.end())
+        it = keyRepeat.bindings.find(keyRepeatKey(event->detail, XCB_MOD_MASK_ANY));
+    if (it == keyRepeat.bindings.end())
+        return true;
+
+    KeyRepeat &binding = it->second;
+    if (!repeat) {
+        binding.last = event->time;
+        return true;
+    }
+
+    bool deliver = false;
+    switch (binding.mode) {
+    case KeyRepeatEvery:
+        deliver = true;
+        break;
+    case KeyRepeatThrottle:
+        // unsigned, server time wrapping around is fine
+        deliver = event->time - binding.last >= binding.interval;
+        break;
+    case KeyRepeatFirst:
+        break;
+    }
+
+    if (deliver) {
+        binding.last = event->time;
+        ++keyRepeat.delivered;
+        return true;
+    }
+
+    ++keyRepeat.dropped;
+    // js would have let the keyboard go for a synchronous grab
+    if (binding.sync)
+        xcb_allow_events(wm->conn, XCB_ALLOW_ASYNC_KEYBOARD, event->time);
+    return false;
+}
+
 void handleXcb(const std::shared_ptr<WM> &wm, const Napi::FunctionReference &fn, xcb_generic_event_t *xcb)
 {
     struct Data {
@@ -343,13 +507,34 @@ void handleXcb(const std::shared_ptr<WM> &wm, const Napi::FunctionReference &fn,
 
     bool log = true;
 
+    if (tree::update(xcb)) {
+        free(xcb);
+        return;
+    }
+    if (type == XCB_CONFIGURE_REQUEST
+        && layout::request(wm, reinterpret_cast<xcb_configure_request_event_t *>(xcb))) {
+        free(xcb);
+        return;
+    }
+    bool repeat = false;
+    if ((type == XCB_KEY_PRESS || type == XCB_KEY_RELEASE)
+        && !handleKeyRepeat(wm, reinterpret_cast<xcb_key_press_event_t *>(xcb), repeat)) {
+        free(xcb);
+        return;
+    }
+
     auto env = fn.Env();
     Napi::HandleScope scope(env);
 
     switch (type) {
     case XCB_BUTTON_PRESS:
     case XCB_BUTTON_RELEASE: {
-        value = makeButtonPress(env, reinterpret_cast<xcb_button_press_event_t *>(xcb));
+        auto press = reinterpret_cast<xcb_button_press_event_t *>(xcb);
+        const xcb_window_t focused = type == XCB_BUTTON_PRESS ? handleClickFocus(wm, press) : XCB_WINDOW_NONE;
+        value = makeButtonPress(env, press);
+        if (focused != XCB_WINDOW_NONE) {
+            value.As<Napi::Object>().Set("focused", focused);
+        }
         break;
     }
     case XCB_MOTION_NOTIFY: {
@@ -358,7 +543,7 @@ void handleXcb(const std::shared_ptr<WM> &wm, const Napi::FunctionReference &fn,
     }
     case XCB_KEY_PRESS:
     case XCB_KEY_RELEASE: {
-        value = makeKeyPress(env, reinterpret_cast<xcb_key_press_event_t *>(xcb), wm);
+        value = makeKeyPress(env, reinterpret_cast<xcb_key_press_event_t *>(xcb), wm, repeat);
         break;
     }
     case XCB_ENTER_NOTIFY:
@@ -384,7 +569,9 @@ void handleXcb(const std::shared_ptr<WM> &wm, const Napi::FunctionReference &fn,
         break;
     }
     case XCB_DESTROY_NOTIFY: {
-        value = makeDestroyNotify(env, reinterpret_cast<xcb_destroy_notify_event_t *>(xcb));
+        auto destroy = reinterpret_cast<xcb_destroy_notify_event_t *>(xcb);
+        graphics::invalidateIcon(wm, destroy->window, false);
+        value = makeDestroyNotify(env, destroy);
         break;
     }
     case XCB_MAP_REQUEST: {
@@ -421,6 +608,7 @@ void handleXcb(const std::shared_ptr<WM> &wm, const Napi::FunctionReference &fn,
         break;
     }
     case XCB_PROPERTY_NOTIFY: {
+        // the icon cache has already been told, see main.cc
         value = makePropertyNotify(env, reinterpret_cast<xcb_property_notify_event_t *>(xcb));
         break;
     }
@@ -444,6 +632,9 @@ void handleXcb(const std::shared_ptr<WM> &wm, const Napi::FunctionReference &fn,
         return;
     }
 
+    // js gets to see this one, make sure it's caught up first
+    layout::flush(fn);
+
     Napi::Object obj = Napi::Object::New(env);
     obj.Set("type", "xcb");
     obj.Set("xcb", value);
@@ -476,6 +667,8 @@ void handleXkb(std::shared_ptr<owm::WM> &wm, const Napi::FunctionReference &fn,
             xcb_key_symbols_free(wm->xkb.syms);
             wm->xkb.syms = xcb_key_symbols_alloc(wm->conn);
 
+            layout::flush(fn);
+
             Napi::Object obj = Napi::Object::New(env);
             obj.Set("type", "xkb");
             obj.Set("xkb", Napi::String::New(env, "recreate"));
@@ -943,6 +1136,195 @@ static Napi::Object initSetModes(napi_env env, const std::shared_ptr<WM> &wm)
     return modes;
 }
 
+// Showing and hiding clients, see xcb.set_states. A workspace switch hands
+// over every client that changes in one call. Hidden clients can either be
+// unmapped, which is what ICCCM has in mind for iconic windows, or parked
+// offscreen while staying mapped. Parked clients don't get unmap/map/expose
+// churn and don't have to repaint when they come back.
+
+enum ClientStateEntry {
+    EntryWindow,
+    EntryFrame,
+    EntryState,
+    EntryFlags,
+    // frame position, where a parked frame goes back to
+    EntryX,
+    EntryY,
+    EntryStride
+};
+
+enum ClientStateFlag {
+    // Client.hide, a normal client that stays out of sight
+    FlagHidden = 0x1
+};
+
+enum HideStrategy {
+    HideUnmap,
+    HideOffscreen
+};
+
+enum class FrameState : uint8_t {
+    Unmapped,
+    Shown,
+    Parked
+};
+
+static std::unordered_map<xcb_window_t, FrameState> frameStates;
+
+static void setNetWmHidden(const std::shared_ptr<WM> &wm, const std::vector<std::pair<xcb_window_t, bool> > &changes)
+{
+    if (changes.empty())
+        return;
+
+    const xcb_atom_t atom = wm->ewmh->_NET_WM_STATE;
+    const xcb_atom_t hidden = wm->ewmh->_NET_WM_STATE_HIDDEN;
+
+    // one round trip for the lot, the grab keeps clients from changing
+    // _NET_WM_STATE between the read and the write
+    xcb_grab_server(wm->conn);
+
+    std::vector<xcb_get_property_cookie_t> cookies;
+    cookies.reserve(changes.size());
+    for (const auto &change : changes) {
+        cookies.push_back(xcb_get_property(wm->conn, 0, change.first, atom, XCB_ATOM_ATOM, 0, 1024));
+    }
+    for (size_t i = 0; i < changes.size(); ++i) {
+        auto reply = xcb_get_property_reply(wm->conn, cookies[i], nullptr);
+        std::vector<xcb_atom_t> atoms;
+        bool had = false;
+        if (reply) {
+            const auto data = static_cast<const xcb_atom_t *>(xcb_get_property_value(reply));
+            const int len = xcb_get_property_value_length(reply) / sizeof(xcb_atom_t);
+            for (int a = 0; a < len; ++a) {
+                if (data[a] == hidden) {
+                    had = true;
+                } else {
+                    atoms.push_back(data[a]);
+                }
+            }
+            free(reply);
+        }
+        if (had == changes[i].second)
+            continue;
+        if (changes[i].second)
+            atoms.push_back(hidden);
+        xcb_change_property(wm->conn, XCB_PROP_MODE_REPLACE, changes[i].first, atom, XCB_ATOM_ATOM, 32,
+                            atoms.size(), atoms.data());
+    }
+
+    xcb_ungrab_server(wm->conn);
+}
+
+// same as Client._setState used to do one client at a time
+static void applyStates(const std::shared_ptr<WM> &wm, const int32_t *entries, size_t count, HideStrategy strategy)
+{
+    const uint32_t frameShownMask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW
+        | XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_POINTER_MOTION
+        | XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+    // the tree still has to see the client go, js never gets these
+    const uint32_t frameHiddenMask = XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+    const uint32_t windowShownMask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_FOCUS_CHANGE;
+    const uint32_t windowHiddenMask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+    const uint32_t noEvents = 0;
+
+    const xcb_atom_t wmStateAtom = wm->atoms.at("WM_STATE");
+
+    std::vector<std::pair<xcb_window_t, bool> > hiddenChanges;
+
+    for (size_t i = 0; i < count; ++i, entries += EntryStride) {
+        const xcb_window_t window = entries[EntryWindow];
+        const xcb_window_t frame = entries[EntryFrame];
+        const uint32_t state = entries[EntryState];
+        const uint32_t flags = entries[EntryFlags];
+
+        auto it = frameStates.find(frame);
+        if (it == frameStates.end())
+            it = frameStates.emplace(frame, FrameState::Unmapped).first;
+        FrameState &current = it->second;
+
+        // a parked client is still viewable as far as ICCCM is concerned.
+        // Clients hidden on purpose are unmapped regardless and js owns
+        // their _NET_WM_STATE_HIDDEN
+        const bool hidden = flags & FlagHidden;
+        const bool park = state != XCB_ICCCM_WM_STATE_NORMAL && strategy == HideOffscreen
+            && !hidden && current != FrameState::Unmapped;
+
+        const uint32_t wmState[] = { park ? static_cast<uint32_t>(XCB_ICCCM_WM_STATE_NORMAL) : state, XCB_NONE };
+        xcb_change_property(wm->conn, XCB_PROP_MODE_REPLACE, window, wmStateAtom, wmStateAtom, 32, 2, wmState);
+
+        if (state == XCB_ICCCM_WM_STATE_NORMAL) {
+            if (hidden)
+                continue;
+            if (current == FrameState::Parked) {
+                layout::unpark(wm, frame);
+                spatial::map(frame, true);
+                hiddenChanges.push_back(std::make_pair(window, false));
+            } else if (current == FrameState::Unmapped) {
+                xcb_change_window_attributes(wm->conn, window, XCB_CW_EVENT_MASK, &windowShownMask);
+                xcb_change_window_attributes(wm->conn, frame, XCB_CW_EVENT_MASK, &frameShownMask);
+                xcb_map_window(wm->conn, window);
+                layout::issued(xcb_map_window(wm->conn, frame).sequence);
+                spatial::map(frame, true);
+            }
+            current = FrameState::Shown;
+        } else if (park) {
+            if (current == FrameState::Shown) {
+                layout::park(wm, frame, entries[EntryX], entries[EntryY]);
+                // nothing to find under the pointer while it's away
+                spatial::map(frame, false);
+                hiddenChanges.push_back(std::make_pair(window, true));
+            }
+            current = FrameState::Parked;
+        } else {
+            // make sure we don't get an unmap notify
+            xcb_change_window_attributes(wm->conn, window, XCB_CW_EVENT_MASK, &noEvents);
+            xcb_change_window_attributes(wm->conn, frame, XCB_CW_EVENT_MASK, &frameHiddenMask);
+
+            layout::issued(xcb_unmap_window(wm->conn, frame).sequence);
+            spatial::map(frame, false);
+            xcb_unmap_window(wm->conn, window);
+
+            xcb_change_window_attributes(wm->conn, window, XCB_CW_EVENT_MASK, &windowHiddenMask);
+
+            if (current == FrameState::Parked) {
+                // out of sight already, it can go back now
+                layout::unpark(wm, frame);
+                if (!hidden)
+                    hiddenChanges.push_back(std::make_pair(window, false));
+            }
+            current = FrameState::Unmapped;
+        }
+    }
+
+    setNetWmHidden(wm, hiddenChanges);
+}
+
+static Napi::Object initClientStates(napi_env env, const std::shared_ptr<WM> &wm)
+{
+    Napi::Object states = Napi::Object::New(env);
+
+    Napi::Object entry = Napi::Object::New(env);
+    entry.Set("Window", Napi::Number::New(env, EntryWindow));
+    entry.Set("Frame", Napi::Number::New(env, EntryFrame));
+    entry.Set("State", Napi::Number::New(env, EntryState));
+    entry.Set("Flags", Napi::Number::New(env, EntryFlags));
+    entry.Set("X", Napi::Number::New(env, EntryX));
+    entry.Set("Y", Napi::Number::New(env, EntryY));
+    entry.Set("Stride", Napi::Number::New(env, EntryStride));
+    states.Set("entry", entry);
+
+    Napi::Object flag = Napi::Object::New(env);
+    flag.Set("Hidden", Napi::Number::New(env, FlagHidden));
+    states.Set("flag", flag);
+
+    Napi::Object hide = Napi::Object::New(env);
+    hide.Set("Unmap", Napi::Number::New(env, HideUnmap));
+    hide.Set("Offscreen", Napi::Number::New(env, HideOffscreen));
+    states.Set("hide", hide);
+
+    return states;
+}
+
 static Napi::Object initIcccm(napi_env env, const std::shared_ptr<WM> &wm)
 {
     Napi::Object icccm = Napi::Object::New(env);
@@ -1088,11 +1470,12 @@ Napi::Value makeXcb(napi_env env, const std::shared_ptr<WM> &wm)
                     values[off++] = arg.Get("stack_mode").As<Napi::Number>().Uint32Value();
                 }
 
+                bool sent = false;
                 if (off) {
-                    xcb_configure_window(wm->conn, window, mask, values);
+                    sent = layout::send(wm, window, mask, values);
                 }
 
-                return env.Undefined();
+                return Napi::Boolean::New(env, sent);
             }));
 
     xcb.Set("change_window_attributes", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
@@ -1846,7 +2229,8 @@ Napi::Value makeXcb(napi_env env, const std::shared_ptr<WM> &wm)
 
                 const auto window = info[1].As<Napi::Number>().Uint32Value();
 
-                xcb_map_window(wm->conn, window);
+                layout::issued(xcb_map_window(wm->conn, window).sequence);
+                spatial::map(window, true);
 
                 return env.Undefined();
             }));
@@ -1864,7 +2248,8 @@ Napi::Value makeXcb(napi_env env, const std::shared_ptr<WM> &wm)
 
                 const auto window = info[1].As<Napi::Number>().Uint32Value();
 
-                xcb_unmap_window(wm->conn, window);
+                layout::issued(xcb_unmap_window(wm->conn, window).sequence);
+                spatial::map(window, false);
 
                 return env.Undefined();
             }));
@@ -1883,6 +2268,7 @@ Napi::Value makeXcb(napi_env env, const std::shared_ptr<WM> &wm)
                 const auto window = info[1].As<Napi::Number>().Uint32Value();
 
                 xcb_destroy_window(wm->conn, window);
+                spatial::destroy(window);
 
                 return env.Undefined();
             }));
@@ -1952,6 +2338,284 @@ Napi::Value makeXcb(napi_env env, const std::shared_ptr<WM> &wm)
                 return env.Undefined();
             }));
 
+    // Adopting a client, everything up to it being mapped, in one go. The
+    // requests are only written to the connection, nothing here waits for a
+    // reply, so the grab keeps the client from doing anything in between at
+    // no real cost.
+    xcb.Set("manage", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+                    throw Napi::TypeError::New(env, "manage requires two arguments");
+                }
+
+                auto wm = Wrap<std::shared_ptr<WM>>::unwrap(info[0]);
+                auto arg = info[1].As<Napi::Object>();
+
+                uv_async_send(wm->asyncFlush);
+
+                if (!arg.Has("window")) {
+                    throw Napi::TypeError::New(env, "manage requires a window");
+                }
+                const uint32_t window = arg.Get("window").As<Napi::Number>().Uint32Value();
+
+                if (!arg.Has("width") || !arg.Has("height")) {
+                    throw Napi::TypeError::New(env, "manage needs a width and a height");
+                }
+                const uint32_t width = arg.Get("width").As<Napi::Number>().Uint32Value();
+                const uint32_t height = arg.Get("height").As<Napi::Number>().Uint32Value();
+
+                int32_t x = 0, y = 0;
+                uint32_t border = 0;
+                uint32_t parent = wm->defaultScreen->root;
+                bool grab = true;
+
+                if (arg.Has("x")) {
+                    x = arg.Get("x").As<Napi::Number>().Int32Value();
+                }
+                if (arg.Has("y")) {
+                    y = arg.Get("y").As<Napi::Number>().Int32Value();
+                }
+                if (arg.Has("border")) {
+                    border = arg.Get("border").As<Napi::Number>().Uint32Value();
+                }
+                if (arg.Has("parent")) {
+                    parent = arg.Get("parent").As<Napi::Number>().Uint32Value();
+                }
+                if (arg.Has("grab")) {
+                    grab = arg.Get("grab").As<Napi::Boolean>().Value();
+                }
+
+                const uint32_t frameWidth = width + (border * 2);
+                const uint32_t frameHeight = height + (border * 2);
+
+                if (grab) {
+                    xcb_grab_server(wm->conn);
+                }
+
+                const auto frame = xcb_generate_id(wm->conn);
+                // SubstructureNotify from the start, the shadow tree follows the reparent below
+                const uint32_t frameValues[] = { 0, 1, XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY };
+                xcb_create_window(wm->conn, XCB_COPY_FROM_PARENT, frame, parent, x, y, frameWidth, frameHeight, 0,
+                                  XCB_WINDOW_CLASS_INPUT_OUTPUT, wm->defaultScreen->root_visual,
+                                  XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK, frameValues);
+                stacking::add(frame, window);
+                spatial::track(frame, x, y, frameWidth, frameHeight, 0, false);
+
+                // make sure we don't get an unparent notify for this window when we reparent
+                const uint32_t noEvents = 0;
+                xcb_change_window_attributes(wm->conn, window, XCB_CW_EVENT_MASK, &noEvents);
+                xcb_reparent_window(wm->conn, window, frame, border, border);
+                xcb_change_save_set(wm->conn, XCB_SET_MODE_INSERT, window);
+
+                const uint32_t extents[] = { border, border, border, border };
+                property::set(wm, window, wm->ewmh->_NET_FRAME_EXTENTS, XCB_ATOM_CARDINAL, 32, extents, 4);
+
+                if (grab) {
+                    xcb_ungrab_server(wm->conn);
+                }
+
+                return Napi::Number::New(env, frame);
+            }));
+
+    // The way back, for a client that was unmapped or destroyed. Everything
+    // we remember about the window and its frame is dropped as well.
+    xcb.Set("unmanage", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+                    throw Napi::TypeError::New(env, "unmanage requires two arguments");
+                }
+
+                auto wm = Wrap<std::shared_ptr<WM>>::unwrap(info[0]);
+                auto arg = info[1].As<Napi::Object>();
+
+                uv_async_send(wm->asyncFlush);
+
+                if (!arg.Has("window") || !arg.Has("frame")) {
+                    throw Napi::TypeError::New(env, "unmanage requires a window and a frame");
+                }
+                const uint32_t window = arg.Get("window").As<Napi::Number>().Uint32Value();
+                const uint32_t frame = arg.Get("frame").As<Napi::Number>().Uint32Value();
+
+                uint32_t parent = wm->defaultScreen->root;
+                uint32_t gc = XCB_NONE;
+                bool destroyed = false;
+                bool grab = true;
+
+                if (arg.Has("parent")) {
+                    parent = arg.Get("parent").As<Napi::Number>().Uint32Value();
+                }
+                if (arg.Has("gc") && arg.Get("gc").IsNumber()) {
+                    gc = arg.Get("gc").As<Napi::Number>().Uint32Value();
+                }
+                if (arg.Has("destroyed")) {
+                    destroyed = arg.Get("destroyed").As<Napi::Boolean>().Value();
+                }
+                if (arg.Has("grab")) {
+                    grab = arg.Get("grab").As<Napi::Boolean>().Value();
+                }
+
+                spatial::destroy(frame);
+                stacking::remove(frame);
+                property::forget(wm, window, destroyed);
+                layout::forget(window);
+                layout::forget(frame);
+                frameStates.erase(frame);
+                clickFocus.erase(frame);
+                if (focusedFrame == frame)
+                    focusedFrame = XCB_WINDOW_NONE;
+
+                if (grab) {
+                    xcb_grab_server(wm->conn);
+                }
+
+                // a destroyed window has nothing left to give back
+                if (!destroyed) {
+                    const uint32_t noEvents = 0;
+                    xcb_change_window_attributes(wm->conn, window, XCB_CW_EVENT_MASK, &noEvents);
+                }
+                xcb_unmap_window(wm->conn, frame);
+                if (!destroyed) {
+                    xcb_reparent_window(wm->conn, window, parent, 0, 0);
+                    xcb_change_save_set(wm->conn, XCB_SET_MODE_DELETE, window);
+                }
+                if (gc != XCB_NONE) {
+                    xcb_free_gc(wm->conn, gc);
+                }
+                xcb_destroy_window(wm->conn, frame);
+
+                if (grab) {
+                    xcb_ungrab_server(wm->conn);
+                }
+
+                return env.Undefined();
+            }));
+
+    xcb.Set("set_states", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 3 || !info[0].IsObject() || !info[1].IsTypedArray() || !info[2].IsNumber()) {
+                    throw Napi::TypeError::New(env, "set_states requires three arguments");
+                }
+                if (info[1].As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+                    throw Napi::TypeError::New(env, "set_states requires an Int32Array of entries");
+                }
+
+                auto wm = Wrap<std::shared_ptr<WM>>::unwrap(info[0]);
+                const auto entries = info[1].As<Napi::Int32Array>();
+                const auto strategy = static_cast<HideStrategy>(info[2].As<Napi::Number>().Int32Value());
+
+                size_t count = entries.ElementLength() / EntryStride;
+                if (info.Length() > 3 && info[3].IsNumber()) {
+                    count = std::min<size_t>(count, info[3].As<Napi::Number>().Uint32Value());
+                }
+
+                uv_async_send(wm->asyncFlush);
+
+                applyStates(wm, entries.Data(), count, strategy);
+
+                return env.Undefined();
+            }));
+
+    xcb.Set("set_click_focus", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+                    throw Napi::TypeError::New(env, "set_click_focus requires two arguments");
+                }
+
+                auto arg = info[1].As<Napi::Object>();
+                if (!arg.Get("frame").IsNumber() || !arg.Get("window").IsNumber() || !arg.Get("mode").IsNumber()) {
+                    throw Napi::TypeError::New(env, "set_click_focus requires a frame, window and mode");
+                }
+
+                const xcb_window_t frame = arg.Get("frame").As<Napi::Number>().Uint32Value();
+                const uint32_t mode = arg.Get("mode").As<Napi::Number>().Uint32Value();
+                if (mode == ClickFocusNone) {
+                    clickFocus.erase(frame);
+                } else if (mode <= ClickFocusTakeFocus) {
+                    clickFocus[frame] = { arg.Get("window").As<Napi::Number>().Uint32Value(), static_cast<ClickFocusMode>(mode) };
+                } else {
+                    throw Napi::TypeError::New(env, "set_click_focus invalid mode");
+                }
+
+                return env.Undefined();
+            }));
+
+    xcb.Set("set_click_focus_enabled", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsBoolean()) {
+                    throw Napi::TypeError::New(env, "set_click_focus_enabled requires two arguments");
+                }
+
+                clickFocusEnabled = info[1].As<Napi::Boolean>().Value();
+
+                return env.Undefined();
+            }));
+
+    xcb.Set("set_focused_frame", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsNumber()) {
+                    throw Napi::TypeError::New(env, "set_focused_frame requires two arguments");
+                }
+
+                focusedFrame = info[1].As<Napi::Number>().Uint32Value();
+
+                return env.Undefined();
+            }));
+
+    xcb.Set("set_key_repeat", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+                    throw Napi::TypeError::New(env, "set_key_repeat requires two arguments");
+                }
+
+                auto arg = info[1].As<Napi::Object>();
+                if (!arg.Get("key").IsNumber() || !arg.Get("modifiers").IsNumber() || !arg.Get("mode").IsNumber()) {
+                    throw Napi::TypeError::New(env, "set_key_repeat requires a key, modifiers and mode");
+                }
+
+                const uint32_t key = keyRepeatKey(arg.Get("key").As<Napi::Number>().Uint32Value(),
+                                                  arg.Get("modifiers").As<Napi::Number>().Uint32Value());
+                const uint32_t mode = arg.Get("mode").As<Napi::Number>().Uint32Value();
+                if (mode == KeyRepeatEvery) {
+                    keyRepeat.bindings.erase(key);
+                } else if (mode <= KeyRepeatFirst) {
+                    uint32_t interval = 0;
+                    if (arg.Has("interval"))
+                        interval = arg.Get("interval").As<Napi::Number>().Uint32Value();
+                    bool sync = false;
+                    if (arg.Has("sync"))
+                        sync = arg.Get("sync").As<Napi::Boolean>().Value();
+                    keyRepeat.bindings[key] = { static_cast<KeyRepeatMode>(mode), interval, sync, XCB_TIME_CURRENT_TIME };
+                } else {
+                    throw Napi::TypeError::New(env, "set_key_repeat invalid mode");
+                }
+
+                return env.Undefined();
+            }));
+
+    xcb.Set("key_repeat_stats", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto env = info.Env();
+
+                if (info.Length() < 1 || !info[0].IsObject()) {
+                    throw Napi::TypeError::New(env, "key_repeat_stats requires one argument");
+                }
+
+                auto wm = Wrap<std::shared_ptr<WM>>::unwrap(info[0]);
+
+                auto ret = Napi::Object::New(env);
+                ret.Set("detectable", Napi::Boolean::New(env, wm->xkb.detectableRepeat));
+                ret.Set("bindings", Napi::Number::New(env, keyRepeat.bindings.size()));
+                ret.Set("delivered", Napi::Number::New(env, keyRepeat.delivered));
+                ret.Set("dropped", Napi::Number::New(env, keyRepeat.dropped));
+                return ret;
+            }));
+
     xcb.Set("query_pointer", Napi::Function::New(env, [](const Napi::CallbackInfo &info) -> Napi::Value {
                 auto env = info.Env();
 
@@ -2967,6 +3631,19 @@ Napi::Value makeXcb(napi_env env, const std::shared_ptr<WM> &wm)
     xcb.Set("stackMode", initStackModes(env, wm));
     xcb.Set("setMode", initSetModes(env, wm));
     xcb.Set("icccm", initIcccm(env, wm));
+    xcb.Set("clientState", initClientStates(env, wm));
+
+    Napi::Object clickFocusModes = Napi::Object::New(env);
+    clickFocusModes.Set("None", Napi::Number::New(env, ClickFocusNone));
+    clickFocusModes.Set("Input", Napi::Number::New(env, ClickFocusInput));
+    clickFocusModes.Set("TakeFocus", Napi::Number::New(env, ClickFocusTakeFocus));
+    xcb.Set("clickFocus", clickFocusModes);
+
+    Napi::Object keyRepeatModes = Napi::Object::New(env);
+    keyRepeatModes.Set("Every", Napi::Number::New(env, KeyRepeatEvery));
+    keyRepeatModes.Set("Throttle", Napi::Number::New(env, KeyRepeatThrottle));
+    keyRepeatModes.Set("First", Napi::Number::New(env, KeyRepeatFirst));
+    xcb.Set("keyRepeat", keyRepeatModes);
     xcb.Set("ewmh", initEwmh(env, wm));
     xcb.Set("currentTime", Napi::Number::New(env, XCB_TIME_CURRENT_TIME));
     xcb.Set("grabAny", Napi::Number::New(env, XCB_GRAB_ANY));
@@ -17,6 +17,10 @@
 #include <xcb/xkb.h>
 #undef explicit
 #include <xcb/randr.h>
+#include <xcb/shm.h>
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include <xcb/render.h>
 #include <assert.h>
 #include <array>
 #include <vector>
@@ -144,6 +148,7 @@ struct Wrap
 struct WM
 {
     xcb_connection_t* conn { nullptr };
+    std::string display;
     xcb_ewmh_connection_t* ewmh { nullptr };
     std::vector<Screen> screens;
     int defaultScreenNo { 0 };
@@ -159,12 +164,25 @@ struct WM
         xkb_keymap* keymap { nullptr };
         xkb_state* state { nullptr };
         int32_t device { 0 };
+        bool detectableRepeat { false };
     } xkb;
 
     struct Randr
     {
         uint8_t event { 0 };
     } randr;
+
+    struct Shm
+    {
+        bool present { false };
+        uint8_t event { 0 };
+    } shm;
+
+    struct Composite
+    {
+        bool present { false };
+        uint8_t damageEvent { 0 };
+    } composite;
 };
 
 void handleXcb(const std::shared_ptr<WM>& wm, const Napi::FunctionReference& fn, xcb_generic_event_t* event);
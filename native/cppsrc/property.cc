@@ -0,0 +1,469 @@
+#include "property.h"
+#include "owm.h"
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+template<typename T>
+using Wrap = owm::Wrap<T>;
+using WM = owm::WM;
+
+namespace property {
+
+// Pagers, panels and taskbars all listen for PropertyNotify on the root
+// window, every write wakes every one of them. Writes made through here are
+// held until the connection is about to be flushed, at which point only the
+// last value for each property goes out, and only if it differs from what
+// was written before. A value that just grew gets appended instead.
+//
+// Some of these live on client windows that the client may rewrite itself,
+// _NET_WM_DESKTOP for one. Each write remembers its request sequence, the
+// PropertyNotify it causes carries the same one. Any other notify for the
+// property means someone else changed it and what we remember is void.
+
+struct Value
+{
+    xcb_atom_t type { XCB_ATOM_NONE };
+    uint8_t format { 0 };
+    bool deleted { false };
+    std::vector<uint8_t> data;
+    // of the request that wrote it, and whether its notify came back
+    uint16_t sequence { 0 };
+    bool confirmed { false };
+
+    uint32_t elems() const { return format ? data.size() / (format / 8) : 0; }
+};
+
+typedef std::pair<xcb_window_t, xcb_atom_t> Key;
+
+static std::map<Key, Value> written, pending;
+
+static struct {
+    uint64_t requested { 0 };
+    uint64_t skipped { 0 };
+    uint64_t appended { 0 };
+    uint64_t replaced { 0 };
+    uint64_t deleted { 0 };
+} stats;
+
+// Some properties change all the time, _NET_WM_USER_TIME on every key
+// press, terminal titles on every prompt. js says per atom, optionally per
+// window, whether it wants to see those right away, at most once per delay
+// with the latest state, or not at all.
+
+enum NotifyPolicy {
+    NotifyDeliver,
+    NotifyAbsorb,
+    NotifyCoalesce
+};
+
+struct Rule
+{
+    NotifyPolicy policy { NotifyDeliver };
+    uint32_t delay { 0 };
+};
+
+struct Held
+{
+    xcb_property_notify_event_t event;
+    uint64_t due;
+};
+
+struct AtomStats
+{
+    uint64_t received { 0 };
+    uint64_t delivered { 0 };
+    uint64_t absorbed { 0 };
+    uint64_t coalesced { 0 };
+};
+
+// window 0 is the rule for every window
+static std::map<Key, Rule> rules;
+static Rule defaultRule;
+static std::map<Key, Held> held;
+static std::unordered_map<xcb_atom_t, AtomStats> atomStats;
+
+static struct {
+    uv_loop_t* loop { nullptr };
+    uv_timer_t timer;
+    // when the timer fires, 0 if it isn't running
+    uint64_t due { 0 };
+    void (*deliver)(xcb_generic_event_t* event) { nullptr };
+} notifier;
+
+void set(const std::shared_ptr<WM>& wm, xcb_window_t window, xcb_atom_t property,
+         xcb_atom_t type, uint8_t format, const void* data, uint32_t elems)
+{
+    ++stats.requested;
+    Value& value = pending[std::make_pair(window, property)];
+    value.type = type;
+    value.format = format;
+    value.deleted = false;
+    const auto bytes = reinterpret_cast<const uint8_t*>(data);
+    value.data.assign(bytes, bytes + (elems * (format / 8)));
+    uv_async_send(wm->asyncFlush);
+}
+
+void remove(const std::shared_ptr<WM>& wm, xcb_window_t window, xcb_atom_t property)
+{
+    ++stats.requested;
+    Value& value = pending[std::make_pair(window, property)];
+    value = Value();
+    value.deleted = true;
+    uv_async_send(wm->asyncFlush);
+}
+
+// returns false if the server already has this value
+static bool write(const std::shared_ptr<WM>& wm, const Key& key, Value& value)
+{
+    xcb_void_cookie_t cookie;
+    auto it = written.find(key);
+    if (value.deleted) {
+        if (it != written.end() && it->second.deleted) {
+            ++stats.skipped;
+            return false;
+        }
+        cookie = xcb_delete_property(wm->conn, key.first, key.second);
+        ++stats.deleted;
+    } else if (it != written.end() && !it->second.deleted
+               && it->second.type == value.type && it->second.format == value.format) {
+        const Value& old = it->second;
+        if (old.data == value.data) {
+            ++stats.skipped;
+            return false;
+        }
+        if (value.data.size() > old.data.size() && !memcmp(old.data.data(), value.data.data(), old.data.size())) {
+            const uint32_t tail = value.elems() - old.elems();
+            cookie = xcb_change_property(wm->conn, XCB_PROP_MODE_APPEND, key.first, key.second, value.type,
+                                         value.format, tail, value.data.data() + old.data.size());
+            ++stats.appended;
+        } else {
+            cookie = xcb_change_property(wm->conn, XCB_PROP_MODE_REPLACE, key.first, key.second, value.type,
+                                         value.format, value.elems(), value.data.data());
+            ++stats.replaced;
+        }
+    } else {
+        cookie = xcb_change_property(wm->conn, XCB_PROP_MODE_REPLACE, key.first, key.second, value.type, value.format,
+                                     value.elems(), value.data.data());
+        ++stats.replaced;
+    }
+    value.sequence = static_cast<uint16_t>(cookie.sequence);
+    value.confirmed = false;
+    return true;
+}
+
+void forget(const std::shared_ptr<WM>& wm, xcb_window_t window, bool destroyed)
+{
+    // queued writes still go out, a withdrawn client is owed its deletes.
+    // Only what was written before is dropped
+    auto pit = pending.lower_bound(std::make_pair(window, static_cast<xcb_atom_t>(0)));
+    while (pit != pending.end() && pit->first.first == window) {
+        if (!destroyed) {
+            write(wm, pit->first, pit->second);
+        }
+        pit = pending.erase(pit);
+    }
+    auto wit = written.lower_bound(std::make_pair(window, static_cast<xcb_atom_t>(0)));
+    while (wit != written.end() && wit->first.first == window) {
+        wit = written.erase(wit);
+    }
+
+    auto it = rules.lower_bound(std::make_pair(window, static_cast<xcb_atom_t>(0)));
+    while (it != rules.end() && it->first.first == window) {
+        it = rules.erase(it);
+    }
+    auto hit = held.lower_bound(std::make_pair(window, static_cast<xcb_atom_t>(0)));
+    while (hit != held.end() && hit->first.first == window) {
+        hit = held.erase(hit);
+    }
+}
+
+void flush(const std::shared_ptr<WM>& wm)
+{
+    for (auto& p : pending) {
+        if (write(wm, p.first, p.second)) {
+            written[p.first] = std::move(p.second);
+        }
+    }
+    pending.clear();
+}
+
+static const Rule& rule(xcb_window_t window, xcb_atom_t atom)
+{
+    auto it = rules.find(std::make_pair(window, atom));
+    if (it != rules.end())
+        return it->second;
+    it = rules.find(std::make_pair(static_cast<xcb_window_t>(0), atom));
+    if (it != rules.end())
+        return it->second;
+    return defaultRule;
+}
+
+static void schedule();
+
+static void release(uv_timer_t*)
+{
+    notifier.due = 0;
+
+    // js may forget windows while these are delivered, take them out first
+    std::vector<xcb_property_notify_event_t> due;
+    const uint64_t now = uv_now(notifier.loop);
+    auto it = held.begin();
+    while (it != held.end()) {
+        if (it->second.due > now) {
+            ++it;
+            continue;
+        }
+        due.push_back(it->second.event);
+        ++atomStats[it->second.event.atom].delivered;
+        it = held.erase(it);
+    }
+
+    static_assert(sizeof(xcb_property_notify_event_t) <= sizeof(xcb_generic_event_t), "property notify doesn't fit");
+    for (const auto& d : due) {
+        auto event = static_cast<xcb_generic_event_t*>(calloc(1, sizeof(xcb_generic_event_t)));
+        memcpy(event, &d, sizeof(xcb_property_notify_event_t));
+        notifier.deliver(event);
+    }
+
+    schedule();
+}
+
+static void schedule()
+{
+    if (held.empty() || !notifier.loop)
+        return;
+    uint64_t due = UINT64_MAX;
+    for (const auto& h : held) {
+        if (h.second.due < due)
+            due = h.second.due;
+    }
+    if (notifier.due && notifier.due <= due)
+        return;
+    const uint64_t now = uv_now(notifier.loop);
+    notifier.due = due;
+    uv_timer_start(&notifier.timer, release, due > now ? due - now : 0, 0);
+}
+
+void init(uv_loop_t* loop, void (*deliver)(xcb_generic_event_t* event))
+{
+    notifier.loop = loop;
+    notifier.deliver = deliver;
+    notifier.due = 0;
+    uv_timer_init(loop, &notifier.timer);
+}
+
+bool notify(const xcb_property_notify_event_t* event)
+{
+    AtomStats& stats = atomStats[event->atom];
+    ++stats.received;
+
+    auto wit = written.find(std::make_pair(event->window, event->atom));
+    if (wit != written.end()) {
+        if (!wit->second.confirmed && wit->second.sequence == event->sequence) {
+            wit->second.confirmed = true;
+        } else {
+            // not ours, the next write has to go out whatever we think is there
+            written.erase(wit);
+        }
+    }
+
+    const Rule& r = rule(event->window, event->atom);
+    switch (r.policy) {
+    case NotifyAbsorb:
+        ++stats.absorbed;
+        return false;
+    case NotifyCoalesce: {
+        if (!notifier.loop)
+            break;
+        const Key key = std::make_pair(event->window, event->atom);
+        auto it = held.find(key);
+        if (it != held.end()) {
+            // latest wins, keep the deadline of the first one
+            it->second.event = *event;
+            ++stats.coalesced;
+            return false;
+        }
+        held[key] = { *event, uv_now(notifier.loop) + r.delay };
+        schedule();
+        return false; }
+    case NotifyDeliver:
+        break;
+    }
+    ++stats.delivered;
+    return true;
+}
+
+void stop()
+{
+    if (!notifier.loop)
+        return;
+    uv_timer_stop(&notifier.timer);
+    uv_close(reinterpret_cast<uv_handle_t*>(&notifier.timer), nullptr);
+    notifier.loop = nullptr;
+    notifier.due = 0;
+    held.clear();
+}
+
+static uint32_t number(const Napi::Env& env, const Napi::Object& arg, const char* fn, const char* key)
+{
+    if (!arg.Has(key)) {
+        throw Napi::TypeError::New(env, std::string("property.") + fn + " requires a " + key);
+    }
+    return arg.Get(key).As<Napi::Number>().Uint32Value();
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object property = Napi::Object::New(env);
+
+    property.Set("set", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+            throw Napi::TypeError::New(env, "property.set requires two arguments");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto arg = info[1].As<Napi::Object>();
+
+        const uint32_t window = number(env, arg, "set", "window");
+        const uint32_t prop = number(env, arg, "set", "property");
+        const uint32_t type = number(env, arg, "set", "type");
+        const uint32_t format = number(env, arg, "set", "format");
+        if (format != 8 && format != 16 && format != 32) {
+            throw Napi::TypeError::New(env, "property.set format needs to be 8/16/32");
+        }
+
+        const auto ndata = arg.Get("data");
+        const uint8_t* data;
+        size_t size;
+        if (ndata.IsArrayBuffer()) {
+            auto buffer = ndata.As<Napi::ArrayBuffer>();
+            data = reinterpret_cast<const uint8_t*>(buffer.Data());
+            size = buffer.ByteLength();
+        } else if (ndata.IsTypedArray()) {
+            const auto tdata = ndata.As<Napi::TypedArray>();
+            data = reinterpret_cast<const uint8_t*>(tdata.ArrayBuffer().Data()) + tdata.ByteOffset();
+            size = tdata.ByteLength();
+        } else {
+            throw Napi::TypeError::New(env, "property.set data must be an arraybuffer, typedarray or node buffer");
+        }
+
+        const uint32_t bpe = format / 8;
+        if (size % bpe) {
+            throw Napi::TypeError::New(env, "property.set data must be divisible by format/8");
+        }
+
+        set(wm, window, prop, type, format, data, size / bpe);
+
+        return env.Undefined();
+    }));
+
+    property.Set("remove", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsObject()) {
+            throw Napi::TypeError::New(env, "property.remove requires two arguments");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        auto arg = info[1].As<Napi::Object>();
+
+        remove(wm, number(env, arg, "remove", "window"), number(env, arg, "remove", "property"));
+
+        return env.Undefined();
+    }));
+
+    property.Set("forget", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsNumber()) {
+            throw Napi::TypeError::New(env, "property.forget requires two arguments");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        const bool destroyed = info.Length() > 2 && info[2].ToBoolean();
+        forget(wm, info[1].As<Napi::Number>().Uint32Value(), destroyed);
+
+        return env.Undefined();
+    }));
+
+    Napi::Object notifyPolicy = Napi::Object::New(env);
+    notifyPolicy.Set("Deliver", Napi::Number::New(env, NotifyDeliver));
+    notifyPolicy.Set("Absorb", Napi::Number::New(env, NotifyAbsorb));
+    notifyPolicy.Set("Coalesce", Napi::Number::New(env, NotifyCoalesce));
+    property.Set("notifyPolicy", notifyPolicy);
+
+    property.Set("setNotifyPolicy", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "property.setNotifyPolicy requires an object");
+        }
+
+        auto arg = info[0].As<Napi::Object>();
+        const uint32_t atom = number(env, arg, "setNotifyPolicy", "atom");
+        const uint32_t policy = number(env, arg, "setNotifyPolicy", "policy");
+        if (policy > NotifyCoalesce) {
+            throw Napi::TypeError::New(env, "property.setNotifyPolicy invalid policy");
+        }
+        const uint32_t window = arg.Get("window").IsNumber() ? arg.Get("window").As<Napi::Number>().Uint32Value() : 0;
+
+        Rule& r = rules[std::make_pair(window, atom)];
+        r.policy = static_cast<NotifyPolicy>(policy);
+        r.delay = arg.Get("delay").IsNumber() ? arg.Get("delay").As<Napi::Number>().Uint32Value() : 0;
+
+        return env.Undefined();
+    }));
+
+    property.Set("setDefaultNotifyPolicy", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "property.setDefaultNotifyPolicy requires a policy");
+        }
+        const uint32_t policy = info[0].As<Napi::Number>().Uint32Value();
+        if (policy > NotifyCoalesce) {
+            throw Napi::TypeError::New(env, "property.setDefaultNotifyPolicy invalid policy");
+        }
+
+        defaultRule.policy = static_cast<NotifyPolicy>(policy);
+        defaultRule.delay = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Uint32Value() : 0;
+
+        return env.Undefined();
+    }));
+
+    property.Set("notifyStats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Array::New(env, atomStats.size());
+        uint32_t idx = 0;
+        for (const auto& s : atomStats) {
+            auto entry = Napi::Object::New(env);
+            entry.Set("atom", Napi::Number::New(env, s.first));
+            entry.Set("received", Napi::Number::New(env, s.second.received));
+            entry.Set("delivered", Napi::Number::New(env, s.second.delivered));
+            entry.Set("absorbed", Napi::Number::New(env, s.second.absorbed));
+            entry.Set("coalesced", Napi::Number::New(env, s.second.coalesced));
+            ret.Set(idx++, entry);
+        }
+        return ret;
+    }));
+
+    property.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("requested", Napi::Number::New(env, stats.requested));
+        ret.Set("skipped", Napi::Number::New(env, stats.skipped));
+        ret.Set("appended", Napi::Number::New(env, stats.appended));
+        ret.Set("replaced", Napi::Number::New(env, stats.replaced));
+        ret.Set("deleted", Napi::Number::New(env, stats.deleted));
+        return ret;
+    }));
+
+    return property;
+}
+
+} // namespace property
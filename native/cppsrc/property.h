@@ -0,0 +1,36 @@
+#ifndef OWM_PROPERTY_H
+#define OWM_PROPERTY_H
+
+#include <napi.h>
+#include <xcb/xcb.h>
+#include <uv.h>
+#include <memory>
+
+namespace owm {
+struct WM;
+}
+
+namespace property {
+
+Napi::Object make(napi_env env);
+
+// queue a write, the last one per window/property wins at flush time
+void set(const std::shared_ptr<owm::WM>& wm, xcb_window_t window, xcb_atom_t property,
+         xcb_atom_t type, uint8_t format, const void* data, uint32_t elems);
+void remove(const std::shared_ptr<owm::WM>& wm, xcb_window_t window, xcb_atom_t property);
+// window ids get reused, drop everything remembered about this one.
+// Writes still queued for it are sent unless it's destroyed
+void forget(const std::shared_ptr<owm::WM>& wm, xcb_window_t window, bool destroyed);
+// write out everything queued, called right before the connection is flushed
+void flush(const std::shared_ptr<owm::WM>& wm);
+
+// PropertyNotify filtering, see setNotifyPolicy. Returns false for events
+// js isn't supposed to see now, either absorbed or held back to coalesce.
+// Held events are handed to deliver once their delay is up
+void init(uv_loop_t* loop, void (*deliver)(xcb_generic_event_t* event));
+bool notify(const xcb_property_notify_event_t* event);
+void stop();
+
+}
+
+#endif
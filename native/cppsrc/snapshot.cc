@@ -0,0 +1,364 @@
+#include "snapshot.h"
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace snapshot {
+
+// long titles are cut, nobody is going to show 64k of window title
+static constexpr size_t MaxString = 1024;
+// mapped lazily by the kernel, only the pages actually written take up memory
+static constexpr uint32_t Capacity = 4 * 1024 * 1024;
+
+static struct {
+    int fd { -1 };
+    uint8_t* map { nullptr };
+    std::string name;
+    // everything after the header as last written, unchanged state
+    // doesn't bump the sequence or wake anyone
+    std::vector<uint8_t> last;
+    Header lastHeader;
+} region;
+
+static struct {
+    uint64_t published { 0 };
+    uint64_t unchanged { 0 };
+    uint64_t truncated { 0 };
+} stats;
+
+struct Image
+{
+    Header header;
+    std::vector<uint8_t> body;
+};
+
+static uint32_t number(const Napi::Object& obj, const char* key, uint32_t def = 0)
+{
+    const auto value = obj.Get(key);
+    if (!value.IsNumber())
+        return def;
+    return value.As<Napi::Number>().Uint32Value();
+}
+
+static int32_t integer(const Napi::Object& obj, const char* key, int32_t def = 0)
+{
+    const auto value = obj.Get(key);
+    if (!value.IsNumber())
+        return def;
+    return value.As<Napi::Number>().Int32Value();
+}
+
+static bool boolean(const Napi::Object& obj, const char* key)
+{
+    const auto value = obj.Get(key);
+    return value.IsBoolean() && value.As<Napi::Boolean>().Value();
+}
+
+static void string(const Napi::Object& obj, const char* key, std::string& strings,
+                   uint32_t& offset, uint32_t& length)
+{
+    const auto value = obj.Get(key);
+    offset = length = 0;
+    if (!value.IsString())
+        return;
+    std::string str = value.As<Napi::String>().Utf8Value();
+    if (str.size() > MaxString) {
+        // don't leave half a utf8 sequence at the end
+        size_t len = MaxString;
+        while (len > 0 && (static_cast<uint8_t>(str[len]) & 0xc0) == 0x80)
+            --len;
+        str.resize(len);
+    }
+    offset = strings.size();
+    length = str.size();
+    strings.append(str);
+}
+
+static void build(Image& image, const Napi::Object& state, uint32_t maxClients)
+{
+    Header& header = image.header;
+    memset(&header, 0, sizeof(Header));
+
+    std::vector<Workspace> workspaces;
+    std::vector<Client> clients;
+    std::string strings;
+
+    header.focused = number(state, "focused");
+
+    const auto nworkspaces = state.Get("workspaces");
+    if (nworkspaces.IsArray()) {
+        const auto array = nworkspaces.As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); ++i) {
+            const auto nws = array.Get(i);
+            if (!nws.IsObject())
+                continue;
+            const auto ws = nws.As<Napi::Object>();
+            Workspace entry;
+            entry.id = integer(ws, "id");
+            entry.flags = 0;
+            if (boolean(ws, "active"))
+                entry.flags |= WorkspaceActive;
+            string(ws, "name", strings, entry.nameOffset, entry.nameLength);
+            string(ws, "monitor", strings, entry.monitorOffset, entry.monitorLength);
+            workspaces.push_back(entry);
+        }
+    }
+
+    const auto nclients = state.Get("clients");
+    if (nclients.IsArray()) {
+        const auto array = nclients.As<Napi::Array>();
+        const uint32_t count = array.Length();
+        if (count > maxClients)
+            header.flags |= Truncated;
+        for (uint32_t i = 0; i < count && i < maxClients; ++i) {
+            const auto nclient = array.Get(i);
+            if (!nclient.IsObject())
+                continue;
+            const auto client = nclient.As<Napi::Object>();
+            Client entry;
+            entry.window = number(client, "window");
+            entry.frame = number(client, "frame");
+            entry.workspace = integer(client, "workspace", -1);
+            entry.flags = 0;
+            if (entry.window && entry.window == header.focused)
+                entry.flags |= ClientFocused;
+            if (boolean(client, "visible"))
+                entry.flags |= ClientVisible;
+            if (boolean(client, "floating"))
+                entry.flags |= ClientFloating;
+            if (boolean(client, "fullscreen"))
+                entry.flags |= ClientFullscreen;
+            if (boolean(client, "staysOnTop"))
+                entry.flags |= ClientStaysOnTop;
+            entry.x = integer(client, "x");
+            entry.y = integer(client, "y");
+            entry.width = number(client, "width");
+            entry.height = number(client, "height");
+            string(client, "name", strings, entry.nameOffset, entry.nameLength);
+            string(client, "class", strings, entry.classOffset, entry.classLength);
+            string(client, "instance", strings, entry.instanceOffset, entry.instanceLength);
+            clients.push_back(entry);
+        }
+    }
+
+    const uint32_t workspaceBytes = workspaces.size() * sizeof(Workspace);
+    const uint32_t clientBytes = clients.size() * sizeof(Client);
+    const uint32_t stringBase = sizeof(Header) + workspaceBytes + clientBytes;
+
+    // string offsets so far are relative to the string area
+    for (auto& ws : workspaces) {
+        ws.nameOffset += stringBase;
+        ws.monitorOffset += stringBase;
+    }
+    for (auto& client : clients) {
+        client.nameOffset += stringBase;
+        client.classOffset += stringBase;
+        client.instanceOffset += stringBase;
+    }
+
+    header.workspaceCount = workspaces.size();
+    header.workspaceOffset = sizeof(Header);
+    header.workspaceSize = sizeof(Workspace);
+    header.clientCount = clients.size();
+    header.clientOffset = sizeof(Header) + workspaceBytes;
+    header.clientSize = sizeof(Client);
+    header.size = stringBase + strings.size();
+
+    image.body.resize(header.size - sizeof(Header));
+    uint8_t* out = image.body.data();
+    memcpy(out, workspaces.data(), workspaceBytes);
+    memcpy(out + workspaceBytes, clients.data(), clientBytes);
+    memcpy(out + workspaceBytes + clientBytes, strings.data(), strings.size());
+}
+
+static void write(const Image& image)
+{
+    Header* header = reinterpret_cast<Header*>(region.map);
+
+    const uint32_t seq = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sequence, seq + 1, __ATOMIC_RELAXED);
+    // the odd sequence has to be visible before any of the data changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    header->size = image.header.size;
+    header->flags = image.header.flags;
+    header->focused = image.header.focused;
+    header->workspaceCount = image.header.workspaceCount;
+    header->workspaceOffset = image.header.workspaceOffset;
+    header->workspaceSize = image.header.workspaceSize;
+    header->clientCount = image.header.clientCount;
+    header->clientOffset = image.header.clientOffset;
+    header->clientSize = image.header.clientSize;
+    memcpy(region.map + sizeof(Header), image.body.data(), image.body.size());
+
+    __atomic_store_n(&header->sequence, seq + 2, __ATOMIC_RELEASE);
+
+    syscall(SYS_futex, &header->sequence, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Tell whoever still has a region left behind by an old instance that it's
+// dead. Its size is left alone, shrinking it would fault their mappings
+static void retire(const std::string& shmName)
+{
+    const int fd = shm_open(shmName.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header))) {
+        void* map = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            Header* header = static_cast<Header*>(map);
+            if (header->magic == Magic) {
+                const uint32_t seq = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED) & ~1u;
+                __atomic_store_n(&header->sequence, seq + 1, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+                header->flags |= Stale;
+                __atomic_store_n(&header->sequence, seq + 2, __ATOMIC_RELEASE);
+                syscall(SYS_futex, &header->sequence, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+            }
+            munmap(map, sizeof(Header));
+        }
+    }
+    ::close(fd);
+    shm_unlink(shmName.c_str());
+}
+
+static void open(const Napi::Env& env, const std::string& name)
+{
+    if (region.map) {
+        throw Napi::Error::New(env, "snapshot.open already open");
+    }
+
+    const std::string shmName = "/" + name;
+    retire(shmName);
+    // exclusive, if someone recreated it in between we'd rather fail than
+    // share a region with them. Only ours to read, titles can be private
+    const int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        throw Napi::Error::New(env, "snapshot.open unable to open " + shmName + ": " + strerror(errno));
+    }
+    if (ftruncate(fd, Capacity) == -1) {
+        const std::string error = strerror(errno);
+        ::close(fd);
+        shm_unlink(shmName.c_str());
+        throw Napi::Error::New(env, "snapshot.open unable to size " + shmName + ": " + error);
+    }
+    void* map = mmap(nullptr, Capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        const std::string error = strerror(errno);
+        ::close(fd);
+        shm_unlink(shmName.c_str());
+        throw Napi::Error::New(env, "snapshot.open unable to map " + shmName + ": " + error);
+    }
+
+    region.fd = fd;
+    region.map = static_cast<uint8_t*>(map);
+    region.name = shmName;
+    region.last.clear();
+    memset(&region.lastHeader, 0, sizeof(Header));
+
+    Header* header = reinterpret_cast<Header*>(region.map);
+    header->version = Version;
+    header->capacity = Capacity;
+    header->size = sizeof(Header);
+    header->workspaceOffset = header->clientOffset = sizeof(Header);
+    header->workspaceSize = sizeof(Workspace);
+    header->clientSize = sizeof(Client);
+    // magic last, a reader that sees it sees a valid empty snapshot
+    __atomic_store_n(&header->magic, Magic, __ATOMIC_RELEASE);
+}
+
+void stop()
+{
+    if (!region.map)
+        return;
+    munmap(region.map, Capacity);
+    ::close(region.fd);
+    shm_unlink(region.name.c_str());
+    region.map = nullptr;
+    region.fd = -1;
+    region.last.clear();
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object snapshot = Napi::Object::New(env);
+
+    snapshot.Set("open", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsString()) {
+            throw Napi::TypeError::New(env, "snapshot.open requires a name");
+        }
+
+        open(env, info[0].As<Napi::String>().Utf8Value());
+
+        return env.Undefined();
+    }));
+
+    snapshot.Set("close", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        stop();
+        return info.Env().Undefined();
+    }));
+
+    snapshot.Set("publish", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "snapshot.publish requires an object");
+        }
+        if (!region.map)
+            return env.Undefined();
+
+        const auto state = info[0].As<Napi::Object>();
+
+        Image image;
+        uint32_t maxClients = UINT32_MAX;
+        build(image, state, maxClients);
+        while (image.header.size > Capacity && image.header.clientCount > 0) {
+            maxClients = image.header.clientCount / 2;
+            build(image, state, maxClients);
+        }
+        if (image.header.size > Capacity) {
+            // not even the workspaces fit, leave the old snapshot alone
+            ++stats.truncated;
+            return env.Undefined();
+        }
+        if (image.header.flags & Truncated)
+            ++stats.truncated;
+
+        if (image.body == region.last && !memcmp(&image.header, &region.lastHeader, sizeof(Header))) {
+            ++stats.unchanged;
+            return env.Undefined();
+        }
+
+        write(image);
+        ++stats.published;
+
+        region.last = std::move(image.body);
+        region.lastHeader = image.header;
+
+        return env.Undefined();
+    }));
+
+    snapshot.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("published", Napi::Number::New(env, stats.published));
+        ret.Set("unchanged", Napi::Number::New(env, stats.unchanged));
+        ret.Set("truncated", Napi::Number::New(env, stats.truncated));
+        return ret;
+    }));
+
+    return snapshot;
+}
+
+} // namespace snapshot
@@ -0,0 +1,98 @@
+#ifndef OWM_SNAPSHOT_H
+#define OWM_SNAPSHOT_H
+
+#include <napi.h>
+#include <cstdint>
+
+namespace snapshot {
+
+// State published to /dev/shm/owm.<display> for bars, pagers and other
+// tools that would rather not poll. The region is only ever written by owm,
+// readers map it read-only:
+//
+//   do {
+//       seq = header->sequence;            // acquire
+//       if (seq & 1) continue;             // write in progress
+//       ... copy what you need ...
+//   } while (header->sequence != seq);     // acquire fence before the load
+//
+// To wait for changes, FUTEX_WAIT (not the private variant) on sequence with
+// the last even value seen. owm wakes all waiters after every update.
+//
+// All integers are native endian, offsets are from the start of the region
+// and strings are utf8 and not nul terminated. Readers should check magic and
+// version and ignore bytes past each entry's size, entries may grow at the end.
+//
+// A restarted owm never resizes a region someone may have mapped, it unlinks
+// it and creates a new one. The old one gets Stale set and a last wake, a
+// reader seeing that should map the region again by name.
+
+struct Header
+{
+    uint32_t magic;          // Magic
+    uint32_t version;        // Version
+    uint32_t sequence;       // odd while an update is being written
+    uint32_t capacity;       // size of the mapping
+    uint32_t size;           // bytes in use
+    uint32_t flags;          // HeaderFlags
+    uint32_t focused;        // client window, 0 if nothing has focus
+    uint32_t workspaceCount;
+    uint32_t workspaceOffset;
+    uint32_t workspaceSize;  // sizeof(Workspace)
+    uint32_t clientCount;
+    uint32_t clientOffset;
+    uint32_t clientSize;     // sizeof(Client)
+    uint32_t reserved[3];
+};
+
+struct Workspace
+{
+    int32_t id;
+    uint32_t flags;          // WorkspaceFlags
+    uint32_t nameOffset, nameLength;
+    uint32_t monitorOffset, monitorLength;
+};
+
+struct Client
+{
+    uint32_t window;
+    uint32_t frame;
+    int32_t workspace;       // -1 if not on any workspace
+    uint32_t flags;          // ClientFlags
+    int32_t x, y;            // frame geometry
+    uint32_t width, height;
+    uint32_t nameOffset, nameLength;
+    uint32_t classOffset, classLength;
+    uint32_t instanceOffset, instanceLength;
+};
+
+static constexpr uint32_t Magic = 0x534d574f; // "OWMS"
+static constexpr uint32_t Version = 1;
+
+enum HeaderFlags : uint32_t {
+    Truncated = 0x1,         // didn't fit, some clients are missing
+    Stale = 0x2              // replaced by a new region, reopen
+};
+
+enum WorkspaceFlags : uint32_t {
+    WorkspaceActive = 0x1
+};
+
+enum ClientFlags : uint32_t {
+    ClientFocused = 0x1,
+    ClientVisible = 0x2,
+    ClientFloating = 0x4,
+    ClientFullscreen = 0x8,
+    ClientStaysOnTop = 0x10
+};
+
+static_assert(sizeof(Header) == 64, "snapshot header layout changed");
+static_assert(sizeof(Workspace) == 24, "snapshot workspace layout changed");
+static_assert(sizeof(Client) == 56, "snapshot client layout changed");
+
+Napi::Object make(napi_env env);
+void stop();
+
+}
+
+#endif
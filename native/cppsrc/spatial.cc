@@ -0,0 +1,294 @@
+#include "spatial.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace spatial {
+
+// Index of the client frames for hit testing. Frames are only ever moved,
+// mapped and restacked by us, so rather than listening for notifications
+// the index is updated from the requests as they are sent.
+//
+// Frames are bucketed into a uniform grid; a lookup only looks at the
+// frames overlapping the bucket the point falls into and picks the
+// topmost one of those.
+
+static constexpr int32_t CellShift = 8; // 256x256 cells
+
+struct Frame
+{
+    int32_t x { 0 }, y { 0 };
+    uint32_t width { 0 }, height { 0 }, border { 0 };
+    bool mapped { false };
+    uint32_t stackPos { 0 };
+    // cells this frame is currently bucketed into
+    int32_t cx0 { 0 }, cy0 { 0 }, cx1 { -1 }, cy1 { -1 };
+
+    bool contains(int32_t px, int32_t py) const
+    {
+        return px >= x && py >= y
+            && px < x + static_cast<int32_t>(width + (border * 2))
+            && py < y + static_cast<int32_t>(height + (border * 2));
+    }
+};
+
+struct Index
+{
+    std::unordered_map<xcb_window_t, Frame> frames;
+    // bottom to top
+    std::vector<xcb_window_t> stack;
+    std::unordered_map<uint64_t, std::vector<xcb_window_t> > cells;
+
+    struct {
+        uint64_t lookups { 0 };
+        uint64_t candidates { 0 };
+    } stats;
+
+    static uint64_t key(int32_t cx, int32_t cy)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+    }
+
+    void unbucket(xcb_window_t window, Frame& frame);
+    void bucket(xcb_window_t window, Frame& frame);
+    void restack();
+};
+
+static Index index;
+
+void Index::unbucket(xcb_window_t window, Frame& frame)
+{
+    for (int32_t cy = frame.cy0; cy <= frame.cy1; ++cy) {
+        for (int32_t cx = frame.cx0; cx <= frame.cx1; ++cx) {
+            auto it = cells.find(key(cx, cy));
+            if (it == cells.end())
+                continue;
+            auto& list = it->second;
+            list.erase(std::remove(list.begin(), list.end(), window), list.end());
+            if (list.empty())
+                cells.erase(it);
+        }
+    }
+    frame.cx0 = frame.cy0 = 0;
+    frame.cx1 = frame.cy1 = -1;
+}
+
+void Index::bucket(xcb_window_t window, Frame& frame)
+{
+    // only mapped frames can be hit, keep the others out of the grid
+    if (!frame.mapped || !frame.width || !frame.height)
+        return;
+    const int32_t right = frame.x + static_cast<int32_t>(frame.width + (frame.border * 2)) - 1;
+    const int32_t bottom = frame.y + static_cast<int32_t>(frame.height + (frame.border * 2)) - 1;
+    frame.cx0 = frame.x >> CellShift;
+    frame.cy0 = frame.y >> CellShift;
+    frame.cx1 = right >> CellShift;
+    frame.cy1 = bottom >> CellShift;
+    for (int32_t cy = frame.cy0; cy <= frame.cy1; ++cy) {
+        for (int32_t cx = frame.cx0; cx <= frame.cx1; ++cx) {
+            cells[key(cx, cy)].push_back(window);
+        }
+    }
+}
+
+void Index::restack()
+{
+    const uint32_t n = static_cast<uint32_t>(stack.size());
+    for (uint32_t i = 0; i < n; ++i) {
+        frames[stack[i]].stackPos = i;
+    }
+}
+
+static void update(xcb_window_t window, Frame& frame, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t border, bool mapped)
+{
+    index.unbucket(window, frame);
+    frame.x = x;
+    frame.y = y;
+    frame.width = width;
+    frame.height = height;
+    frame.border = border;
+    frame.mapped = mapped;
+    index.bucket(window, frame);
+}
+
+void track(xcb_window_t window, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t border, bool mapped)
+{
+    auto it = index.frames.find(window);
+    if (it == index.frames.end()) {
+        // new windows go on top of their siblings
+        it = index.frames.insert(std::make_pair(window, Frame())).first;
+        it->second.stackPos = static_cast<uint32_t>(index.stack.size());
+        index.stack.push_back(window);
+    }
+    update(window, it->second, x, y, width, height, border, mapped);
+}
+
+void configure(xcb_window_t window, uint16_t mask, const uint32_t* values)
+{
+    auto it = index.frames.find(window);
+    if (it == index.frames.end())
+        return;
+    Frame& frame = it->second;
+
+    int32_t x = frame.x, y = frame.y;
+    uint32_t width = frame.width, height = frame.height, border = frame.border;
+    xcb_window_t sibling = XCB_NONE;
+    uint32_t off = 0;
+    if (mask & XCB_CONFIG_WINDOW_X)
+        x = static_cast<int32_t>(values[off++]);
+    if (mask & XCB_CONFIG_WINDOW_Y)
+        y = static_cast<int32_t>(values[off++]);
+    if (mask & XCB_CONFIG_WINDOW_WIDTH)
+        width = values[off++];
+    if (mask & XCB_CONFIG_WINDOW_HEIGHT)
+        height = values[off++];
+    if (mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+        border = values[off++];
+    if (mask & XCB_CONFIG_WINDOW_SIBLING)
+        sibling = values[off++];
+
+    if (mask & (XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH
+                | XCB_CONFIG_WINDOW_HEIGHT | XCB_CONFIG_WINDOW_BORDER_WIDTH)) {
+        update(window, frame, x, y, width, height, border, frame.mapped);
+    }
+
+    if (!(mask & XCB_CONFIG_WINDOW_STACK_MODE))
+        return;
+
+    const uint32_t mode = values[off];
+    auto& stack = index.stack;
+    auto sit = index.frames.end();
+    if (sibling != XCB_NONE) {
+        sit = index.frames.find(sibling);
+        if (sit == index.frames.end()) {
+            // relative to something we don't track, can't tell where that
+            // puts us among the frames
+            return;
+        }
+    }
+
+    stack.erase(std::remove(stack.begin(), stack.end(), window), stack.end());
+    if (sibling == XCB_NONE) {
+        if (mode == XCB_STACK_MODE_ABOVE || mode == XCB_STACK_MODE_TOP_IF) {
+            stack.push_back(window);
+        } else {
+            stack.insert(stack.begin(), window);
+        }
+    } else {
+        auto pos = std::find(stack.begin(), stack.end(), sibling);
+        if (mode == XCB_STACK_MODE_ABOVE || mode == XCB_STACK_MODE_TOP_IF) {
+            ++pos;
+        }
+        stack.insert(pos, window);
+    }
+    index.restack();
+}
+
+void map(xcb_window_t window, bool mapped)
+{
+    auto it = index.frames.find(window);
+    if (it == index.frames.end())
+        return;
+    Frame& frame = it->second;
+    if (frame.mapped == mapped)
+        return;
+    update(window, frame, frame.x, frame.y, frame.width, frame.height, frame.border, mapped);
+}
+
+void destroy(xcb_window_t window)
+{
+    auto it = index.frames.find(window);
+    if (it == index.frames.end())
+        return;
+    index.unbucket(window, it->second);
+    index.frames.erase(it);
+    index.stack.erase(std::remove(index.stack.begin(), index.stack.end(), window), index.stack.end());
+    index.restack();
+}
+
+static xcb_window_t window_at(int32_t x, int32_t y)
+{
+    ++index.stats.lookups;
+    auto it = index.cells.find(Index::key(x >> CellShift, y >> CellShift));
+    if (it == index.cells.end())
+        return XCB_WINDOW_NONE;
+
+    xcb_window_t best = XCB_WINDOW_NONE;
+    uint32_t bestPos = 0;
+    for (xcb_window_t window : it->second) {
+        ++index.stats.candidates;
+        const Frame& frame = index.frames[window];
+        if (!frame.contains(x, y))
+            continue;
+        if (best == XCB_WINDOW_NONE || frame.stackPos > bestPos) {
+            best = window;
+            bestPos = frame.stackPos;
+        }
+    }
+    return best;
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object spatial = Napi::Object::New(env);
+
+    spatial.Set("track", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "spatial.track requires an argument");
+        }
+
+        const auto arg = info[0].As<Napi::Object>();
+        if (!arg.Has("window")) {
+            throw Napi::TypeError::New(env, "spatial.track requires a window");
+        }
+        const xcb_window_t window = arg.Get("window").As<Napi::Number>().Uint32Value();
+        auto get = [&arg](const char* key) -> int32_t {
+            return arg.Has(key) ? arg.Get(key).As<Napi::Number>().Int32Value() : 0;
+        };
+
+        const bool mapped = arg.Has("mapped") && arg.Get("mapped").ToBoolean();
+        track(window, get("x"), get("y"), get("width"), get("height"), get("border_width"), mapped);
+
+        return env.Undefined();
+    }));
+
+    spatial.Set("untrack", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "spatial.untrack requires a window");
+        }
+
+        destroy(info[0].As<Napi::Number>().Uint32Value());
+
+        return env.Undefined();
+    }));
+
+    spatial.Set("windowAt", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+            throw Napi::TypeError::New(env, "spatial.windowAt requires two arguments");
+        }
+
+        const auto window = window_at(info[0].As<Napi::Number>().Int32Value(), info[1].As<Napi::Number>().Int32Value());
+        return Napi::Number::New(env, window);
+    }));
+
+    spatial.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("windows", Napi::Number::New(env, index.frames.size()));
+        ret.Set("cells", Napi::Number::New(env, index.cells.size()));
+        ret.Set("lookups", Napi::Number::New(env, index.stats.lookups));
+        ret.Set("candidates", Napi::Number::New(env, index.stats.candidates));
+        return ret;
+    }));
+
+    return spatial;
+}
+
+} // namespace spatial
@@ -0,0 +1,20 @@
+#ifndef OWM_SPATIAL_H
+#define OWM_SPATIAL_H
+
+#include <napi.h>
+#include <xcb/xcb.h>
+
+namespace spatial {
+
+Napi::Object make(napi_env env);
+
+// called from the request wrappers so the index follows what the window
+// manager itself does to the frames it tracks
+void track(xcb_window_t window, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t border, bool mapped);
+void configure(xcb_window_t window, uint16_t mask, const uint32_t* values);
+void map(xcb_window_t window, bool mapped);
+void destroy(xcb_window_t window);
+
+}
+
+#endif
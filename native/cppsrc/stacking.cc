@@ -0,0 +1,283 @@
+#include "stacking.h"
+#include "owm.h"
+#include "spatial.h"
+#include "property.h"
+#include "layout.h"
+#include <algorithm>
+#include <cstdint>
+
+template<typename T>
+using Wrap = owm::Wrap<T>;
+using WM = owm::WM;
+
+namespace stacking {
+
+// Raising a client means restacking its transients, its group's floating
+// windows, the container's on-top items, fullscreen and monitor global items
+// as well. Rather than sending a configure_window for each step, JS moves
+// frames around in the desired order here and commit() works out which
+// frames actually ended up somewhere else compared to what the server has,
+// restacks just those and updates _NET_CLIENT_LIST_STACKING in the same go.
+
+struct Entry
+{
+    xcb_window_t frame;
+    xcb_window_t client;
+};
+
+struct State
+{
+    // bottom to top
+    std::vector<Entry> desired;
+    std::vector<xcb_window_t> server;
+    bool dirty { false };
+
+    struct {
+        uint64_t commits { 0 };
+        uint64_t requested { 0 };
+        uint64_t sent { 0 };
+    } stats;
+
+    std::vector<Entry>::iterator find(xcb_window_t frame)
+    {
+        return std::find_if(desired.begin(), desired.end(), [frame](const Entry& e) { return e.frame == frame; });
+    }
+};
+
+static State state;
+
+static void move(xcb_window_t frame, xcb_window_t sibling, bool above)
+{
+    auto it = state.find(frame);
+    if (it == state.desired.end())
+        return;
+    const Entry entry = *it;
+    const auto oldPos = std::distance(state.desired.begin(), it);
+    state.desired.erase(it);
+
+    if (sibling == XCB_WINDOW_NONE) {
+        if (above) {
+            state.desired.push_back(entry);
+        } else {
+            state.desired.insert(state.desired.begin(), entry);
+        }
+    } else {
+        auto sit = state.find(sibling);
+        if (sit == state.desired.end()) {
+            // unknown sibling, leave it where it was
+            state.desired.insert(state.desired.begin() + oldPos, entry);
+            return;
+        }
+        if (above)
+            ++sit;
+        state.desired.insert(sit, entry);
+    }
+    ++state.stats.requested;
+    state.dirty = true;
+}
+
+// indices into desired of the frames that can stay where they are: the
+// longest run of frames whose relative order already matches the server
+static std::vector<bool> stable_frames(const std::vector<uint32_t>& serverPos)
+{
+    const size_t n = serverPos.size();
+    std::vector<size_t> tails, tailIdx, prev(n, SIZE_MAX);
+    for (size_t i = 0; i < n; ++i) {
+        const auto pos = std::lower_bound(tails.begin(), tails.end(), serverPos[i]);
+        const size_t len = pos - tails.begin();
+        if (pos == tails.end()) {
+            tails.push_back(serverPos[i]);
+            tailIdx.push_back(i);
+        } else {
+            *pos = serverPos[i];
+            tailIdx[len] = i;
+        }
+        if (len > 0)
+            prev[i] = tailIdx[len - 1];
+    }
+
+    std::vector<bool> stable(n, false);
+    if (tailIdx.empty())
+        return stable;
+    for (size_t i = tailIdx.back(); i != SIZE_MAX; i = prev[i]) {
+        stable[i] = true;
+    }
+    return stable;
+}
+
+static void commit(const std::shared_ptr<WM>& wm)
+{
+    if (!state.dirty)
+        return;
+    state.dirty = false;
+    ++state.stats.commits;
+
+    auto& desired = state.desired;
+    const size_t n = desired.size();
+
+    std::unordered_map<xcb_window_t, uint32_t> serverIndex;
+    serverIndex.reserve(state.server.size());
+    for (uint32_t i = 0; i < state.server.size(); ++i) {
+        serverIndex[state.server[i]] = i;
+    }
+    std::vector<uint32_t> serverPos(n);
+    for (size_t i = 0; i < n; ++i) {
+        serverPos[i] = serverIndex[desired[i].frame];
+    }
+
+    const auto stable = stable_frames(serverPos);
+
+    // walk bottom to top, everything below the current frame is already in
+    // its final relative order so stacking right above the previous frame
+    // is always correct. A frame that needs to move with nothing below it
+    // goes underneath the first frame that stays put.
+    size_t firstStable = 0;
+    while (firstStable < n && !stable[firstStable])
+        ++firstStable;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (stable[i])
+            continue;
+        uint32_t values[2];
+        if (i > 0) {
+            values[0] = desired[i - 1].frame;
+            values[1] = XCB_STACK_MODE_ABOVE;
+        } else {
+            values[0] = desired[firstStable].frame;
+            values[1] = XCB_STACK_MODE_BELOW;
+        }
+        const uint16_t mask = XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE;
+        layout::send(wm, desired[i].frame, mask, values);
+        ++state.stats.sent;
+    }
+
+    state.server.resize(n);
+    std::vector<xcb_window_t> clients(n);
+    for (size_t i = 0; i < n; ++i) {
+        state.server[i] = desired[i].frame;
+        clients[i] = desired[i].client;
+    }
+
+    property::set(wm, wm->defaultScreen->root, wm->ewmh->_NET_CLIENT_LIST_STACKING, XCB_ATOM_WINDOW, 32,
+                  clients.data(), clients.size());
+
+    uv_async_send(wm->asyncFlush);
+}
+
+void add(xcb_window_t frame, xcb_window_t client)
+{
+    if (state.find(frame) != state.desired.end())
+        return;
+
+    // a newly created window is on top of its siblings
+    state.desired.push_back({ frame, client });
+    state.server.push_back(frame);
+    state.dirty = true;
+}
+
+void remove(xcb_window_t frame)
+{
+    auto it = state.find(frame);
+    if (it != state.desired.end()) {
+        state.desired.erase(it);
+        state.dirty = true;
+    }
+    state.server.erase(std::remove(state.server.begin(), state.server.end(), frame), state.server.end());
+}
+
+static xcb_window_t window_arg(const Napi::CallbackInfo& info, size_t idx)
+{
+    if (info.Length() <= idx || !info[idx].IsNumber())
+        return XCB_WINDOW_NONE;
+    return info[idx].As<Napi::Number>().Uint32Value();
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object stacking = Napi::Object::New(env);
+
+    stacking.Set("add", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+            throw Napi::TypeError::New(env, "stacking.add requires two arguments");
+        }
+
+        add(window_arg(info, 0), window_arg(info, 1));
+
+        return env.Undefined();
+    }));
+
+    stacking.Set("remove", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "stacking.remove requires a frame");
+        }
+
+        remove(window_arg(info, 0));
+
+        return env.Undefined();
+    }));
+
+    stacking.Set("raise", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "stacking.raise requires a frame");
+        }
+
+        move(window_arg(info, 0), window_arg(info, 1), true);
+
+        return env.Undefined();
+    }));
+
+    stacking.Set("lower", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "stacking.lower requires a frame");
+        }
+
+        move(window_arg(info, 0), window_arg(info, 1), false);
+
+        return env.Undefined();
+    }));
+
+    stacking.Set("commit", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "stacking.commit requires a wm");
+        }
+
+        commit(Wrap<std::shared_ptr<WM> >::unwrap(info[0]));
+
+        return env.Undefined();
+    }));
+
+    stacking.Set("order", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Uint32Array::New(env, state.desired.size());
+        for (size_t i = 0; i < state.desired.size(); ++i) {
+            ret[i] = state.desired[i].frame;
+        }
+        return ret;
+    }));
+
+    stacking.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("windows", Napi::Number::New(env, state.desired.size()));
+        ret.Set("commits", Napi::Number::New(env, state.stats.commits));
+        ret.Set("requested", Napi::Number::New(env, state.stats.requested));
+        ret.Set("sent", Napi::Number::New(env, state.stats.sent));
+        return ret;
+    }));
+
+    return stacking;
+}
+
+} // namespace stacking
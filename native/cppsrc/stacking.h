@@ -0,0 +1,17 @@
+#ifndef OWM_STACKING_H
+#define OWM_STACKING_H
+
+#include <napi.h>
+#include <xcb/xcb.h>
+
+namespace stacking {
+
+Napi::Object make(napi_env env);
+
+// frames enter on top, the way the server puts newly created windows
+void add(xcb_window_t frame, xcb_window_t client);
+void remove(xcb_window_t frame);
+
+}
+
+#endif
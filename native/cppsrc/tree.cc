@@ -0,0 +1,452 @@
+#include "tree.h"
+#include "owm.h"
+#include "layout.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+template<typename T>
+using Wrap = owm::Wrap<T>;
+using WM = owm::WM;
+
+namespace tree {
+
+// Mirror of the top level windows, the frames and whatever lives in them, as
+// far as the server has told us. Root and frames have SubstructureNotify
+// selected for this, frames from creation on and through hiding so a
+// client's own map, unmap and destroy are seen. Everything here follows
+// notify events, never
+// requests, so it can lag the server by whatever is still in the queue but
+// it never disagrees with what the server eventually reports.
+
+struct Node
+{
+    xcb_window_t parent { XCB_NONE };
+    int16_t x { 0 }, y { 0 };
+    uint16_t width { 0 }, height { 0 }, border { 0 };
+    bool mapped { false };
+    bool overrideRedirect { false };
+    // bottom to top
+    std::vector<xcb_window_t> children;
+};
+
+static xcb_window_t root = XCB_NONE;
+static std::unordered_map<xcb_window_t, Node> nodes;
+
+static struct {
+    uint64_t events { 0 };
+    uint64_t swallowed { 0 };
+    uint64_t checks { 0 };
+    uint64_t mismatches { 0 };
+} stats;
+
+static Node* find(xcb_window_t window)
+{
+    auto it = nodes.find(window);
+    return it == nodes.end() ? nullptr : &it->second;
+}
+
+static void unlink(xcb_window_t window, xcb_window_t parent)
+{
+    Node* p = find(parent);
+    if (!p)
+        return;
+    auto it = std::find(p->children.begin(), p->children.end(), window);
+    if (it != p->children.end())
+        p->children.erase(it);
+}
+
+// above == XCB_NONE puts window at the bottom
+static void restack(xcb_window_t window, xcb_window_t parent, xcb_window_t above)
+{
+    Node* p = find(parent);
+    if (!p)
+        return;
+    auto& children = p->children;
+    auto it = std::find(children.begin(), children.end(), window);
+    if (it != children.end())
+        children.erase(it);
+    if (above == XCB_NONE) {
+        children.insert(children.begin(), window);
+        return;
+    }
+    auto sibling = std::find(children.begin(), children.end(), above);
+    if (sibling == children.end()) {
+        children.push_back(window);
+    } else {
+        children.insert(sibling + 1, window);
+    }
+}
+
+static void erase(xcb_window_t window)
+{
+    auto it = nodes.find(window);
+    if (it == nodes.end())
+        return;
+    std::vector<xcb_window_t> children;
+    children.swap(it->second.children);
+    unlink(window, it->second.parent);
+    nodes.erase(it);
+    // the server destroys children first, but a subtree reparented out of
+    // sight goes all at once
+    for (auto child : children) {
+        erase(child);
+    }
+}
+
+static void insert(xcb_window_t window, xcb_window_t parent, int16_t x, int16_t y,
+                   uint16_t width, uint16_t height, uint16_t border, bool overrideRedirect)
+{
+    if (!find(parent))
+        return;
+    Node& node = nodes[window];
+    if (node.parent != XCB_NONE && node.parent != parent)
+        unlink(window, node.parent);
+    node.parent = parent;
+    node.x = x;
+    node.y = y;
+    node.width = width;
+    node.height = height;
+    node.border = border;
+    node.overrideRedirect = overrideRedirect;
+    // new and reparented windows go on top of their siblings
+    Node& p = nodes[parent];
+    auto it = std::find(p.children.begin(), p.children.end(), window);
+    if (it != p.children.end())
+        p.children.erase(it);
+    p.children.push_back(window);
+}
+
+void reset(xcb_window_t r)
+{
+    nodes.clear();
+    root = r;
+    nodes[root] = Node();
+}
+
+void add(xcb_window_t window, xcb_window_t parent, const xcb_get_geometry_reply_t* geom,
+         const xcb_get_window_attributes_reply_t* attrib)
+{
+    if (!geom || !attrib)
+        return;
+    insert(window, parent, geom->x, geom->y, geom->width, geom->height, geom->border_width,
+           attrib->override_redirect);
+    nodes[window].mapped = attrib->map_state != XCB_MAP_STATE_UNMAPPED;
+}
+
+bool geometry(xcb_window_t window, int16_t& x, int16_t& y, uint16_t& width, uint16_t& height, uint16_t& border)
+{
+    const Node* node = find(window);
+    if (!node)
+        return false;
+    x = node->x;
+    y = node->y;
+    width = node->width;
+    height = node->height;
+    border = node->border;
+    return true;
+}
+
+bool viewable(xcb_window_t window)
+{
+    while (window != root) {
+        const Node* node = find(window);
+        if (!node || !node->mapped)
+            return false;
+        window = node->parent;
+    }
+    return true;
+}
+
+bool update(const xcb_generic_event_t* event)
+{
+    // synthetic events are for the window manager, not a statement of fact
+    if (event->response_type & 0x80)
+        return false;
+
+    // the window the event was reported on. Root and frames only report
+    // other windows' events because of SubstructureNotify, which nobody
+    // else in owm asked for
+    xcb_window_t reported = XCB_NONE, window = XCB_NONE;
+
+    switch (event->response_type) {
+    case XCB_CREATE_NOTIFY: {
+        auto create = reinterpret_cast<const xcb_create_notify_event_t*>(event);
+        insert(create->window, create->parent, create->x, create->y, create->width, create->height,
+               create->border_width, create->override_redirect);
+        layout::restacked();
+        // nothing ever selects these on anything but the parent
+        reported = create->parent;
+        window = create->window;
+        break; }
+    case XCB_DESTROY_NOTIFY: {
+        auto destroy = reinterpret_cast<const xcb_destroy_notify_event_t*>(event);
+        erase(destroy->window);
+        layout::forget(destroy->window);
+        reported = destroy->event;
+        window = destroy->window;
+        break; }
+    case XCB_MAP_NOTIFY: {
+        auto map = reinterpret_cast<const xcb_map_notify_event_t*>(event);
+        if (Node* node = find(map->window)) {
+            node->mapped = true;
+            node->overrideRedirect = map->override_redirect;
+        }
+        layout::restacked();
+        reported = map->event;
+        window = map->window;
+        break; }
+    case XCB_UNMAP_NOTIFY: {
+        auto unmap = reinterpret_cast<const xcb_unmap_notify_event_t*>(event);
+        if (Node* node = find(unmap->window))
+            node->mapped = false;
+        reported = unmap->event;
+        window = unmap->window;
+        break; }
+    case XCB_REPARENT_NOTIFY: {
+        auto reparent = reinterpret_cast<const xcb_reparent_notify_event_t*>(event);
+        Node* node = find(reparent->window);
+        if (!find(reparent->parent)) {
+            // moved somewhere we don't follow
+            erase(reparent->window);
+        } else if (node) {
+            insert(reparent->window, reparent->parent, reparent->x, reparent->y, node->width, node->height,
+                   node->border, reparent->override_redirect);
+        } else {
+            // size unknown until the first ConfigureNotify
+            insert(reparent->window, reparent->parent, reparent->x, reparent->y, 0, 0, 0,
+                   reparent->override_redirect);
+        }
+        layout::restacked();
+        reported = reparent->event;
+        window = reparent->window;
+        break; }
+    case XCB_CONFIGURE_NOTIFY: {
+        auto configure = reinterpret_cast<const xcb_configure_notify_event_t*>(event);
+        // the same notify can be reported on the window and its parent
+        if (configure->event == configure->window || configure->event == root) {
+            layout::configured(configure->window, configure->x, configure->y, configure->width,
+                               configure->height, configure->border_width);
+        }
+        if (Node* node = find(configure->window)) {
+            node->x = configure->x;
+            node->y = configure->y;
+            node->width = configure->width;
+            node->height = configure->height;
+            node->border = configure->border_width;
+            node->overrideRedirect = configure->override_redirect;
+            restack(configure->window, node->parent, configure->above_sibling);
+        }
+        reported = configure->event;
+        window = configure->window;
+        break; }
+    case XCB_GRAVITY_NOTIFY: {
+        auto gravity = reinterpret_cast<const xcb_gravity_notify_event_t*>(event);
+        if (Node* node = find(gravity->window)) {
+            node->x = gravity->x;
+            node->y = gravity->y;
+        }
+        reported = gravity->event;
+        window = gravity->window;
+        break; }
+    case XCB_CIRCULATE_NOTIFY: {
+        auto circulate = reinterpret_cast<const xcb_circulate_notify_event_t*>(event);
+        if (Node* node = find(circulate->window)) {
+            auto& children = nodes[node->parent].children;
+            if (circulate->place == XCB_PLACE_ON_TOP) {
+                restack(circulate->window, node->parent, children.empty() ? XCB_NONE : children.back());
+            } else {
+                restack(circulate->window, node->parent, XCB_NONE);
+            }
+        }
+        layout::restacked();
+        reported = circulate->event;
+        window = circulate->window;
+        break; }
+    default:
+        return false;
+    }
+
+    ++stats.events;
+    if (reported != window) {
+        ++stats.swallowed;
+        return true;
+    }
+    return false;
+}
+
+static Napi::Value makeNode(napi_env env, xcb_window_t window, const Node& node)
+{
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("window", Napi::Number::New(env, window));
+    obj.Set("parent", Napi::Number::New(env, node.parent));
+    obj.Set("x", Napi::Number::New(env, node.x));
+    obj.Set("y", Napi::Number::New(env, node.y));
+    obj.Set("width", Napi::Number::New(env, node.width));
+    obj.Set("height", Napi::Number::New(env, node.height));
+    obj.Set("border_width", Napi::Number::New(env, node.border));
+    obj.Set("mapped", Napi::Boolean::New(env, node.mapped));
+    obj.Set("override_redirect", Napi::Boolean::New(env, node.overrideRedirect));
+    int32_t pos = -1;
+    if (const Node* p = find(node.parent)) {
+        auto it = std::find(p->children.begin(), p->children.end(), window);
+        if (it != p->children.end())
+            pos = it - p->children.begin();
+    }
+    obj.Set("stackPos", Napi::Number::New(env, pos));
+    return obj;
+}
+
+// Compares the tree against the server, one level below root and below
+// each frame. Slow and synchronous, debugging only.
+static std::vector<std::string> check(const std::shared_ptr<WM>& wm)
+{
+    std::vector<std::string> problems;
+    auto problem = [&problems](xcb_window_t window, const std::string& what) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "0x%x: ", window);
+        problems.push_back(buf + what);
+    };
+
+    std::vector<xcb_window_t> parents = { root };
+    for (auto child : nodes[root].children)
+        parents.push_back(child);
+
+    for (auto parent : parents) {
+        auto reply = xcb_query_tree_reply(wm->conn, xcb_query_tree_unchecked(wm->conn, parent), nullptr);
+        const Node* node = find(parent);
+        if (!reply) {
+            if (node)
+                problem(parent, "tracked but gone from the server");
+            continue;
+        }
+        const xcb_window_t* wins = xcb_query_tree_children(reply);
+        const int len = xcb_query_tree_children_length(reply);
+        const std::vector<xcb_window_t> server(wins, wins + len);
+        free(reply);
+
+        if (!node)
+            continue;
+        if (server != node->children) {
+            problem(parent, "children differ, " + std::to_string(server.size()) + " on the server, "
+                    + std::to_string(node->children.size()) + " tracked");
+            continue;
+        }
+        if (parent != root)
+            continue;
+
+        for (auto window : server) {
+            auto geom = xcb_get_geometry_reply(wm->conn, xcb_get_geometry_unchecked(wm->conn, window), nullptr);
+            auto attrib = xcb_get_window_attributes_reply(wm->conn, xcb_get_window_attributes_unchecked(wm->conn, window),
+                                                          nullptr);
+            const Node* child = find(window);
+            if (geom && child && (geom->x != child->x || geom->y != child->y || geom->width != child->width
+                                  || geom->height != child->height || geom->border_width != child->border)) {
+                problem(window, "geometry differs");
+            }
+            if (attrib && child && (attrib->map_state != XCB_MAP_STATE_UNMAPPED) != child->mapped) {
+                problem(window, "map state differs");
+            }
+            if (attrib && child && static_cast<bool>(attrib->override_redirect) != child->overrideRedirect) {
+                problem(window, "override redirect differs");
+            }
+            free(geom);
+            free(attrib);
+        }
+    }
+
+    ++stats.checks;
+    stats.mismatches += problems.size();
+    return problems;
+}
+
+Napi::Object make(napi_env env)
+{
+    Napi::Object tree = Napi::Object::New(env);
+
+    tree.Set("window", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "tree.window requires a window");
+        }
+
+        const xcb_window_t window = info[0].As<Napi::Number>().Uint32Value();
+        const Node* node = find(window);
+        if (!node || window == root)
+            return env.Undefined();
+        return makeNode(env, window, *node);
+    }));
+
+    tree.Set("children", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsNumber()) {
+            throw Napi::TypeError::New(env, "tree.children requires a window");
+        }
+
+        const Node* node = find(info[0].As<Napi::Number>().Uint32Value());
+        if (!node)
+            return env.Undefined();
+        auto ret = Napi::Uint32Array::New(env, node->children.size());
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            ret[i] = node->children[i];
+        }
+        return ret;
+    }));
+
+    tree.Set("topLevelAt", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+            throw Napi::TypeError::New(env, "tree.topLevelAt requires x and y");
+        }
+
+        const int32_t x = info[0].As<Napi::Number>().Int32Value();
+        const int32_t y = info[1].As<Napi::Number>().Int32Value();
+        const auto& children = nodes[root].children;
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            const Node* node = find(*it);
+            if (!node || !node->mapped)
+                continue;
+            const int32_t w = node->width + (node->border * 2);
+            const int32_t h = node->height + (node->border * 2);
+            if (x >= node->x && x < node->x + w && y >= node->y && y < node->y + h)
+                return Napi::Number::New(env, *it);
+        }
+        return Napi::Number::New(env, 0);
+    }));
+
+    tree.Set("check", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        if (info.Length() < 1 || !info[0].IsObject()) {
+            throw Napi::TypeError::New(env, "tree.check requires a wm");
+        }
+
+        auto wm = Wrap<std::shared_ptr<WM> >::unwrap(info[0]);
+        const auto problems = check(wm);
+        auto ret = Napi::Array::New(env, problems.size());
+        for (size_t i = 0; i < problems.size(); ++i) {
+            ret.Set(i, Napi::String::New(env, problems[i]));
+        }
+        return ret;
+    }));
+
+    tree.Set("stats", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto env = info.Env();
+
+        auto ret = Napi::Object::New(env);
+        ret.Set("windows", Napi::Number::New(env, nodes.empty() ? 0 : nodes.size() - 1));
+        ret.Set("events", Napi::Number::New(env, stats.events));
+        ret.Set("swallowed", Napi::Number::New(env, stats.swallowed));
+        ret.Set("checks", Napi::Number::New(env, stats.checks));
+        ret.Set("mismatches", Napi::Number::New(env, stats.mismatches));
+        return ret;
+    }));
+
+    return tree;
+}
+
+} // namespace tree
@@ -0,0 +1,28 @@
+#ifndef OWM_TREE_H
+#define OWM_TREE_H
+
+#include <napi.h>
+#include <xcb/xcb.h>
+
+namespace tree {
+
+Napi::Object make(napi_env env);
+
+// seeded from the initial query of the root window, in stacking order
+void reset(xcb_window_t root);
+void add(xcb_window_t window, xcb_window_t parent, const xcb_get_geometry_reply_t* geom,
+         const xcb_get_window_attributes_reply_t* attrib);
+
+// fed every event before it's handed to js. returns true for events that
+// were only selected to keep the tree current and that js never sees
+bool update(const xcb_generic_event_t* event);
+
+// last geometry the server reported, relative to the parent
+bool geometry(xcb_window_t window, int16_t& x, int16_t& y, uint16_t& width, uint16_t& height, uint16_t& border);
+
+// mapped along with all of its ancestors, false for windows we don't know
+bool viewable(xcb_window_t window);
+
+}
+
+#endif
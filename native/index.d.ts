@@ -124,6 +124,8 @@ export namespace XCB {
         readonly child: number;
         readonly state: number;
         readonly same_screen: number;
+        // set if the click was replayed and this window focused natively
+        readonly focused?: number;
     }
 
     export interface MotionNotify {
@@ -156,6 +158,8 @@ export namespace XCB {
         readonly sym: number;
         readonly is_modifier: number;
         readonly same_screen: number;
+        // presses only, set for auto-repeats of a held key
+        readonly repeat?: boolean;
     }
 
     export interface EnterNotify {
@@ -542,6 +546,47 @@ interface ChangeSaveSetArgs {
     readonly mode: number;
 }
 
+interface ManageArgs {
+    readonly window: number;
+    readonly x?: number;
+    readonly y?: number;
+    readonly width: number;
+    readonly height: number;
+    readonly border?: number;
+    readonly parent?: number;
+    readonly grab?: boolean;
+}
+
+interface UnmanageArgs {
+    readonly window: number;
+    readonly frame: number;
+    readonly parent?: number;
+    readonly gc?: number;
+    readonly destroyed?: boolean;
+    readonly grab?: boolean;
+}
+
+interface KeyRepeatArgs {
+    readonly key: number;
+    readonly modifiers: number;
+    readonly mode: number;
+    readonly interval?: number;
+    readonly sync?: boolean;
+}
+
+interface KeyRepeatStats {
+    readonly detectable: boolean;
+    readonly bindings: number;
+    readonly delivered: number;
+    readonly dropped: number;
+}
+
+interface ClickFocusArgs {
+    readonly frame: number;
+    readonly window: number;
+    readonly mode: number;
+}
+
 interface PolyRectangleArgs {
     readonly window: number;
     readonly gc: number;
@@ -583,6 +628,25 @@ interface ICCCMEnums {
     readonly state: {[key: string]: number};
 }
 
+interface ClientStateEnums {
+    readonly entry: {
+        readonly Window: number;
+        readonly Frame: number;
+        readonly State: number;
+        readonly Flags: number;
+        readonly X: number;
+        readonly Y: number;
+        readonly Stride: number;
+    };
+    readonly flag: {
+        readonly Hidden: number;
+    };
+    readonly hide: {
+        readonly Unmap: number;
+        readonly Offscreen: number;
+    };
+}
+
 interface EWMHEnums {
     readonly clientSourceType: {[key: string]: number};
     readonly desktopLayoutOrientation: {[key: string]: number};
@@ -598,6 +662,63 @@ export namespace Graphics {
         readonly width: number;
         readonly height: number;
     }
+    interface CreateImageSurfaceArgs {
+        readonly width: number;
+        readonly height: number;
+        readonly backend?: "shm" | "image";
+    }
+    interface PutImageSurfaceArgs {
+        readonly drawable: number;
+        readonly gc: number;
+        readonly src_x?: number;
+        readonly src_y?: number;
+        readonly dst_x?: number;
+        readonly dst_y?: number;
+        readonly width?: number;
+        readonly height?: number;
+    }
+    interface CreateFromWindowIconArgs {
+        readonly window: number;
+        readonly size: number;
+    }
+    interface CreateRendererArgs {
+        readonly width: number;
+        readonly height: number;
+        readonly drawable: number;
+        readonly gc: number;
+        readonly dst_x?: number;
+        readonly dst_y?: number;
+        readonly callback?: (frame: number) => void;
+    }
+    export type DrawOp =
+        ["save"] | ["restore"] |
+        ["translate", number, number] | ["scale", number, number] |
+        ["setSourceRGB", number, number, number] |
+        ["setSourceRGBA", number, number, number, number] |
+        ["setSourceSurface", Surface, number?, number?] |
+        ["pathRectangle", number, number, number, number] |
+        ["pathMoveTo", number, number] | ["pathLineTo", number, number] |
+        ["pathArc", number, number, number, number, number] | ["pathClose"] |
+        ["fill"] | ["stroke", number?] | ["clip"] | ["paint"] |
+        ["drawText", string, string] | ["drawText", Text] | ["drawMarkup", string, string];
+    interface CreateThumbnailArgs {
+        readonly width: number;
+        readonly height: number;
+        readonly background?: number;
+        readonly callback?: () => void;
+    }
+    export interface ThumbnailWindow {
+        readonly window: number;
+        readonly x: number;
+        readonly y: number;
+        readonly width: number;
+        readonly height: number;
+    }
+    export interface RendererStats {
+        readonly submitted: number;
+        readonly presented: number;
+        readonly dropped: number;
+    }
     export interface StrokePathArgs {
         readonly path?: Context;
         readonly lineWidth?: number;
@@ -630,6 +751,8 @@ export namespace Graphics {
     export interface Context {}
     export interface Surface {}
     export interface Text {}
+    export interface Renderer {}
+    export interface Thumbnail {}
     export interface Engine {
         createFromDrawable(wm: OWM.WM, args: CreateFromDrawableArgs): Context;
         createFromSurface(surface: Surface): Context;
@@ -650,7 +773,12 @@ export namespace Graphics {
 
         createSurfaceFromDrawable(wm: OWM.WM, args: CreateFromDrawableArgs): Surface;
         createSurfaceFromPNG(ctx: Context, data: ArrayBuffer | XCB_TypedArray | Buffer): Surface;
+        createSurfaceFromPNGAsync(ctx: Context, data: ArrayBuffer | XCB_TypedArray | Buffer): Promise<Surface>;
         createSurfaceFromContext(ctx: Context): Surface;
+        createSurfaceFromWindowIcon(wm: OWM.WM, args: CreateFromWindowIconArgs): Surface | undefined;
+        createImageSurface(wm: OWM.WM, args: CreateImageSurfaceArgs): Surface;
+        putImageSurface(wm: OWM.WM, surface: Surface, args: PutImageSurfaceArgs): void;
+        surfaceBackend(surface: Surface): "xcb" | "image" | "shm";
         // destroySurface(surface: Surface): void;
         surfaceSize(surface: Surface): Size;
         surfaceFlush(surface: Surface): void;
@@ -677,6 +805,289 @@ export namespace Graphics {
         textSetText(txt: Text, text: string): void;
         textSetMarkup(txt: Text, text: string): void;
         textMetrics(txt: Text): Size;
+        // an independent copy, changing the original doesn't affect it
+        textCopy(txt: Text): Text;
+
+        createRenderer(wm: OWM.WM, args: CreateRendererArgs): Renderer;
+        renderSubmit(renderer: Renderer, ops: DrawOp[]): number;
+        rendererStats(renderer: Renderer): RendererStats;
+        destroyRenderer(renderer: Renderer): void;
+
+        createThumbnail(wm: OWM.WM, args: CreateThumbnailArgs): Thumbnail;
+        thumbnailSetWindows(thumbnail: Thumbnail, windows: ThumbnailWindow[], source: Rectangle): void;
+        thumbnailUpdate(thumbnail: Thumbnail): boolean;
+        thumbnailDirty(thumbnail: Thumbnail): boolean;
+        thumbnailSurface(thumbnail: Thumbnail): Surface;
+        destroyThumbnail(thumbnail: Thumbnail): void;
+    }
+}
+
+export namespace Compositor {
+    interface EnableArgs {
+        readonly unredirectFullscreen?: boolean;
+        readonly sync?: boolean;
+        readonly background?: number;
+    }
+    export interface Stats {
+        readonly redirected: boolean;
+        readonly windows: number;
+        readonly frames: number;
+        readonly damageEvents: number;
+        readonly unredirects: number;
+        readonly lastRepaintUs: number;
+        readonly maxRepaintUs: number;
+        readonly totalRepaintUs: number;
+        readonly avgRepaintUs: number;
+        readonly lastPainted: number;
+    }
+    export interface Engine {
+        enable(wm: OWM.WM, args?: EnableArgs): void;
+        disable(): void;
+        enabled(): boolean;
+        stats(): Stats | undefined;
+        resetStats(): void;
+    }
+}
+
+export namespace Layout {
+    export interface TileArgs {
+        readonly x: number;
+        readonly y: number;
+        readonly width: number;
+        readonly height: number;
+        readonly rows?: number;
+        readonly columns?: number;
+        readonly rowRatios?: Float64Array | number[];
+        readonly columnRatios?: Float64Array | number[];
+        readonly hints: Int32Array;
+        readonly count?: number;
+    }
+    export interface ConfigureStats {
+        readonly requested: number;
+        readonly sent: number;
+        readonly suppressed: number;
+        readonly fieldsDropped: number;
+        readonly requestsHandled: number;
+        readonly requestsForwarded: number;
+        readonly requestsClamped: number;
+        readonly requestsReported: number;
+        readonly crossingsSuppressed: number;
+    }
+    export interface PolicyArgs {
+        readonly window: number;
+        readonly policy: number;
+        readonly frame?: number;
+        readonly hints?: Int32Array;
+        readonly x?: number;
+        readonly y?: number;
+        readonly width?: number;
+        readonly height?: number;
+    }
+    export interface Configured {
+        readonly window: number;
+        readonly x: number;
+        readonly y: number;
+        readonly width: number;
+        readonly height: number;
+        readonly requested: {
+            readonly x?: number;
+            readonly y?: number;
+            readonly width?: number;
+            readonly height?: number;
+        };
+    }
+    export interface Engine {
+        readonly hint: {[key: string]: number};
+        readonly itemFlag: {[key: string]: number};
+        readonly result: {[key: string]: number};
+        readonly policy: {[key: string]: number};
+        tile(args: TileArgs): Int32Array;
+        configure(wm: OWM.WM, windows: Uint32Array, results: Int32Array): void;
+        setPolicy(args: PolicyArgs): void;
+        setDefaultPolicy(policy: number): void;
+        setCrossingFilter(enabled: boolean): void;
+        stats(): ConfigureStats;
+    }
+}
+
+export namespace Spatial {
+    export interface TrackArgs {
+        readonly window: number;
+        readonly x: number;
+        readonly y: number;
+        readonly width: number;
+        readonly height: number;
+        readonly border_width?: number;
+        readonly mapped?: boolean;
+    }
+    export interface Stats {
+        readonly windows: number;
+        readonly cells: number;
+        readonly lookups: number;
+        readonly candidates: number;
+    }
+    export interface Engine {
+        track(args: TrackArgs): void;
+        untrack(window: number): void;
+        windowAt(x: number, y: number): number;
+        stats(): Stats;
+    }
+}
+
+export namespace Stacking {
+    export interface Stats {
+        readonly windows: number;
+        readonly commits: number;
+        readonly requested: number;
+        readonly sent: number;
+    }
+    export interface Engine {
+        add(frame: number, client: number): void;
+        remove(frame: number): void;
+        raise(frame: number, sibling?: number): void;
+        lower(frame: number, sibling?: number): void;
+        commit(wm: OWM.WM): void;
+        order(): Uint32Array;
+        stats(): Stats;
+    }
+}
+
+export namespace Property {
+    export interface SetArgs {
+        readonly window: number;
+        readonly property: number;
+        readonly type: number;
+        readonly format: number;
+        readonly data: ArrayBuffer | XCB_TypedArray | Buffer;
+    }
+    export interface RemoveArgs {
+        readonly window: number;
+        readonly property: number;
+    }
+    export interface Stats {
+        readonly requested: number;
+        readonly skipped: number;
+        readonly appended: number;
+        readonly replaced: number;
+        readonly deleted: number;
+    }
+    export interface NotifyPolicyArgs {
+        readonly atom: number;
+        readonly policy: number;
+        // 0 or left out for every window
+        readonly window?: number;
+        // for Coalesce, in ms
+        readonly delay?: number;
+    }
+    export interface NotifyStats {
+        readonly atom: number;
+        readonly received: number;
+        readonly delivered: number;
+        readonly absorbed: number;
+        readonly coalesced: number;
+    }
+    export interface Engine {
+        readonly notifyPolicy: {
+            readonly Deliver: number;
+            readonly Absorb: number;
+            readonly Coalesce: number;
+        };
+        set(wm: OWM.WM, args: SetArgs): void;
+        remove(wm: OWM.WM, args: RemoveArgs): void;
+        forget(wm: OWM.WM, window: number, destroyed?: boolean): void;
+        setNotifyPolicy(args: NotifyPolicyArgs): void;
+        setDefaultNotifyPolicy(policy: number, delay?: number): void;
+        notifyStats(): NotifyStats[];
+        stats(): Stats;
+    }
+}
+
+export namespace IPC {
+    export interface Stats {
+        readonly listening: boolean;
+        readonly published: number;
+        readonly emitted: number;
+        readonly connections: number;
+        readonly queries: number;
+        readonly events: number;
+        readonly dropped: number;
+    }
+    export interface Engine {
+        listen(path: string): void;
+        close(): void;
+        publish(section: string, data: string | Buffer): void;
+        emit(event: string, data: string | Buffer): void;
+        stats(): Stats;
+    }
+}
+
+export namespace Snapshot {
+    export interface Workspace {
+        readonly id: number;
+        readonly name?: string;
+        readonly monitor?: string;
+        readonly active?: boolean;
+    }
+    export interface Client {
+        readonly window: number;
+        readonly frame?: number;
+        readonly workspace?: number;
+        readonly name?: string;
+        readonly class?: string;
+        readonly instance?: string;
+        readonly x?: number;
+        readonly y?: number;
+        readonly width?: number;
+        readonly height?: number;
+        readonly visible?: boolean;
+        readonly floating?: boolean;
+        readonly fullscreen?: boolean;
+        readonly staysOnTop?: boolean;
+    }
+    export interface State {
+        readonly focused: number;
+        readonly workspaces: Workspace[];
+        readonly clients: Client[];
+    }
+    export interface Stats {
+        readonly published: number;
+        readonly unchanged: number;
+        readonly truncated: number;
+    }
+    export interface Engine {
+        open(name: string): void;
+        close(): void;
+        publish(state: State): void;
+        stats(): Stats;
+    }
+}
+
+export namespace Tree {
+    export interface Window {
+        readonly window: number;
+        readonly parent: number;
+        readonly x: number;
+        readonly y: number;
+        readonly width: number;
+        readonly height: number;
+        readonly border_width: number;
+        readonly mapped: boolean;
+        readonly override_redirect: boolean;
+        readonly stackPos: number;
+    }
+    export interface Stats {
+        readonly windows: number;
+        readonly events: number;
+        readonly swallowed: number;
+        readonly checks: number;
+        readonly mismatches: number;
+    }
+    export interface Engine {
+        window(window: number): Window | undefined;
+        children(window: number): Uint32Array | undefined;
+        topLevelAt(x: number, y: number): number;
+        check(wm: OWM.WM): string[];
+        stats(): Stats;
     }
 }
 
@@ -704,9 +1115,20 @@ export namespace OWM {
         readonly cursorNone: number;
         readonly none: number;
         readonly icccm: ICCCMEnums;
+        readonly clientState: ClientStateEnums;
+        readonly clickFocus: {
+            readonly None: number;
+            readonly Input: number;
+            readonly TakeFocus: number;
+        };
+        readonly keyRepeat: {
+            readonly Every: number;
+            readonly Throttle: number;
+            readonly First: number;
+        };
         readonly ewmh: EWMHEnums;
         intern_atom(name: string, onlyIfExists?: boolean): number;
-        configure_window(wm: OWM.WM, args: ConfigureWindowArgs): void;
+        configure_window(wm: OWM.WM, args: ConfigureWindowArgs): boolean;
         change_window_attributes(wm: OWM.WM, args: ChangeWindowAttributesArgs): void;
         create_window(wm: OWM.WM, args: CreateWindowArgs): number;
         create_pixmap(wm: OWM.WM, args: CreatePixmapArgs): number;
@@ -724,6 +1146,14 @@ export namespace OWM {
         free_gc(wm: OWM.WM, gc: number): void;
         allow_events(wm: OWM.WM, args: AllowEventsArgs): void;
         change_save_set(wm: OWM.WM, args: ChangeSaveSetArgs): void;
+        manage(wm: OWM.WM, args: ManageArgs): number;
+        unmanage(wm: OWM.WM, args: UnmanageArgs): void;
+        set_states(wm: OWM.WM, entries: Int32Array, strategy: number, count?: number): void;
+        set_click_focus(wm: OWM.WM, args: ClickFocusArgs): void;
+        set_click_focus_enabled(wm: OWM.WM, enabled: boolean): void;
+        set_focused_frame(wm: OWM.WM, frame: number): void;
+        set_key_repeat(wm: OWM.WM, args: KeyRepeatArgs): void;
+        key_repeat_stats(wm: OWM.WM): KeyRepeatStats;
         copy_area(wm: OWM.WM, args: CopyAreaArgs): void;
         poly_fill_rectangle(wm: OWM.WM, args: PolyRectangleArgs): void;
         query_pointer(wm: OWM.WM, window?: number): QueryPointerReply;
@@ -759,6 +1189,7 @@ export namespace OWM {
         readonly screens?: Screens;
         readonly xcb?: XCB_Type;
         readonly xkb?: string;
+        readonly configured?: Layout.Configured[];
     }
     export interface GetProperty extends GetPropertyReply {}
 }
@@ -771,6 +1202,14 @@ interface Start
     readonly xcb: OWM.XCB;
     readonly xkb: OWM.XKB;
     readonly graphics: Graphics.Engine;
+    readonly compositor: Compositor.Engine;
+    readonly layout: Layout.Engine;
+    readonly spatial: Spatial.Engine;
+    readonly stacking: Stacking.Engine;
+    readonly property: Property.Engine;
+    readonly ipc: IPC.Engine;
+    readonly snapshot: Snapshot.Engine;
+    readonly tree: Tree.Engine;
     readonly ewmh: number;
     readonly windows: XCB.Window[];
     readonly screens: OWM.Screens;
@@ -124,18 +124,30 @@ function event(e: OWM.Event) {
         lib.updateScreens(screens);
     } else if (e.type === "xkb" && e.xkb === "recreate") {
         lib.recreateKeyBindings();
+    } else if (e.type === "configured" && e.configured) {
+        lib.handleConfigured(e.configured);
     }
 }
 
 const data = native.start(event, display);
 log.info("owm started");
 
-lib = new OWMLib(data.wm, data.xcb, data.xkb, data.graphics, {
+lib = new OWMLib(data.wm, data.xcb, data.xkb, data.graphics, data.compositor, data.layout, data.spatial, data.stacking, data.property, data.ipc, data.snapshot, data.tree, {
     display: display,
     level: level,
     killTimeout: options.int("kill-timeout", 1000),
+    hideStrategy: stringOption("hide-strategy"),
 });
 
+if (options("composite")) {
+    try {
+        data.compositor.enable(data.wm, { sync: !!options("composite-sync") });
+        log.info("compositing enabled");
+    } catch (err) {
+        log.error("Unable to enable compositing", err.message);
+    }
+}
+
 const rl = createInterface({ input: process.stdin, output: process.stdout });
 rl.setPrompt("owm> ");
 rl.on("line", (input) => {
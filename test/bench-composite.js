@@ -0,0 +1,87 @@
+/*global process*/
+
+// Drives the built-in compositor with a few windows that repaint small
+// areas, then a fullscreen one that should get unredirected, and prints
+// the repaint counters. No GPU involved, meant to run under Xvfb:
+//
+//   Xvfb :5 -screen 0 1920x1080x24 +extension Composite &
+//   node test/bench-composite.js :5 [frames]
+
+const native = require("../native");
+
+const display = process.argv[2] || process.env.DISPLAY;
+const frames = parseInt(process.argv[3] || "200", 10);
+
+const data = native.start(() => {}, display);
+const { wm, xcb, compositor } = data;
+const screen = data.screens.entries[0];
+
+compositor.enable(wm, { sync: true });
+
+function makeWindow(x, y, width, height) {
+    const window = xcb.create_window(wm, { x: x, y: y, width: width, height: height, parent: data.screens.root });
+    xcb.change_window_attributes(wm, { window: window, override_redirect: 1, back_pixel: 0 });
+    xcb.map_window(wm, window);
+    const gc = xcb.create_gc(wm, { window: window, values: { graphics_exposures: 0 } });
+    return { window: window, gc: gc, width: width, height: height };
+}
+
+function wait(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+function report(name) {
+    const stats = compositor.stats();
+    console.log(`${name.padEnd(12)} frames ${String(stats.frames).padStart(5)} ` +
+                `damage ${String(stats.damageEvents).padStart(5)} ` +
+                `avg ${stats.avgRepaintUs.toFixed(0).padStart(6)}us ` +
+                `max ${String(stats.maxRepaintUs).padStart(6)}us ` +
+                `redirected ${stats.redirected} unredirects ${stats.unredirects}`);
+    compositor.resetStats();
+}
+
+async function run() {
+    const windows = [];
+    for (let i = 0; i < 8; ++i) {
+        windows.push(makeWindow(40 + (i * 60), 40 + (i * 40), 400, 300));
+    }
+    xcb.flush(wm);
+    await wait(100);
+    compositor.resetStats();
+
+    // small damage, e.g. a blinking cursor or a clock
+    for (let i = 0; i < frames; ++i) {
+        const w = windows[i % windows.length];
+        xcb.change_gc(wm, { gc: w.gc, values: { foreground: (i * 0x10101) & 0xffffff } });
+        xcb.poly_fill_rectangle(wm, { window: w.window, gc: w.gc, rects: [{ x: 10, y: 10, width: 16, height: 16 }] });
+        xcb.flush(wm);
+        await wait(1);
+    }
+    report("small");
+
+    // whole window damage
+    for (let i = 0; i < frames; ++i) {
+        const w = windows[i % windows.length];
+        xcb.change_gc(wm, { gc: w.gc, values: { foreground: (i * 0x10101) & 0xffffff } });
+        xcb.poly_fill_rectangle(wm, { window: w.window, gc: w.gc, rects: [{ x: 0, y: 0, width: w.width, height: w.height }] });
+        xcb.flush(wm);
+        await wait(1);
+    }
+    report("window");
+
+    // a fullscreen window on top bypasses compositing altogether
+    const full = makeWindow(0, 0, screen.width, screen.height);
+    xcb.flush(wm);
+    await wait(100);
+    for (let i = 0; i < frames; ++i) {
+        xcb.poly_fill_rectangle(wm, { window: full.window, gc: full.gc, rects: [{ x: 0, y: 0, width: 64, height: 64 }] });
+        xcb.flush(wm);
+        await wait(1);
+    }
+    report("fullscreen");
+
+    native.stop();
+    process.exit();
+}
+
+run();
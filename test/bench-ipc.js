@@ -0,0 +1,74 @@
+/*global process*/
+
+// Queries a running owm through its native state endpoint and prints the
+// round trip times, then stays subscribed and prints events as they come in:
+//
+//   node test/bench-ipc.js :0 [queries]
+
+const net = require("net");
+
+const display = process.argv[2] || process.env.DISPLAY || ":0";
+const queries = parseInt(process.argv[3] || "1000", 10);
+const path = `/tmp/owm.${display.substr(display.lastIndexOf(":") + 1)}.state.sock`;
+
+const type = { Query: 1, Subscribe: 2, Reply: 0x81, Event: 0x82, Error: 0x83 };
+
+function frame(t, name) {
+    const payload = Buffer.from(name, "utf8");
+    const buf = Buffer.alloc(5 + payload.length);
+    buf.writeUInt32LE(1 + payload.length, 0);
+    buf.writeUInt8(t, 4);
+    payload.copy(buf, 5);
+    return buf;
+}
+
+const socket = net.connect(path);
+let pending = Buffer.alloc(0);
+let onFrame;
+
+socket.on("data", data => {
+    pending = Buffer.concat([pending, data]);
+    while (pending.length >= 4) {
+        const size = pending.readUInt32LE(0);
+        if (pending.length < 4 + size)
+            break;
+        const t = pending.readUInt8(4);
+        const body = pending.slice(5, 4 + size);
+        pending = pending.slice(4 + size);
+        const nul = body.indexOf(0);
+        onFrame(t, body.slice(0, nul).toString(), body.slice(nul + 1).toString());
+    }
+});
+
+function query(name) {
+    return new Promise(resolve => {
+        onFrame = (t, n, data) => resolve({ type: t, name: n, data: data });
+        socket.write(frame(type.Query, name));
+    });
+}
+
+async function run() {
+    for (const section of ["clients", "focus", "workspaces", "monitors"]) {
+        const reply = await query(section);
+        console.log(section, reply.type === type.Reply ? JSON.parse(reply.data) : reply.data);
+    }
+
+    const start = process.hrtime.bigint();
+    for (let i = 0; i < queries; ++i) {
+        await query("clients");
+    }
+    const elapsed = Number(process.hrtime.bigint() - start) / 1000;
+    console.log(`${queries} queries, avg ${(elapsed / queries).toFixed(1)}us`);
+
+    onFrame = (t, n, data) => {
+        if (t === type.Event)
+            console.log("event", n, data);
+    };
+    socket.write(frame(type.Subscribe, "*"));
+}
+
+socket.on("connect", run);
+socket.on("error", err => {
+    console.error(`unable to connect to ${path}`, err.message);
+    process.exit(1);
+});
@@ -0,0 +1,58 @@
+/*global process*/
+
+// Times the native layout kernel for a workspace full of tiled terminals
+// with resize increments, the way TilingLayoutPolicy calls it. Needs a
+// display only because that's what hands out the native bindings:
+//
+//   Xvfb :5 -screen 0 1920x1080x24 &
+//   node test/bench-layout.js :5 [clients] [iterations]
+
+const native = require("../native");
+
+const display = process.argv[2] || process.env.DISPLAY;
+const clients = parseInt(process.argv[3] || "32", 10);
+const iterations = parseInt(process.argv[4] || "10000", 10);
+
+const data = native.start(() => {}, display);
+const { layout, xcb } = data;
+const hint = layout.hint;
+const sizeHint = xcb.icccm.sizeHint;
+
+const hints = new Int32Array(clients * hint.Stride);
+for (let i = 0; i < clients; ++i) {
+    const off = i * hint.Stride;
+    hints[off + hint.Border] = 1;
+    hints[off + hint.ItemFlags] = layout.itemFlag.Tiled;
+    hints[off + hint.Flags] = sizeHint.BASE_SIZE | sizeHint.P_MIN_SIZE | sizeHint.P_RESIZE_INC;
+    hints[off + hint.BaseWidth] = 4;
+    hints[off + hint.BaseHeight] = 4;
+    hints[off + hint.MinWidth] = 20;
+    hints[off + hint.MinHeight] = 20;
+    hints[off + hint.WidthInc] = 7;
+    hints[off + hint.HeightInc] = 14;
+}
+
+const rows = 4;
+const columns = Math.ceil(clients / rows);
+const args = {
+    x: 0, y: 20, width: 1920, height: 1060,
+    rows: rows, columns: columns,
+    rowRatios: new Float64Array(rows).fill(1),
+    columnRatios: new Float64Array(columns).fill(1),
+    hints: hints, count: clients
+};
+
+for (let i = 0; i < 1000; ++i) {
+    layout.tile(args);
+}
+
+const start = process.hrtime.bigint();
+for (let i = 0; i < iterations; ++i) {
+    layout.tile(args);
+}
+const elapsed = Number(process.hrtime.bigint() - start) / 1000;
+
+console.log(`${clients} clients, ${iterations} layouts, ${(elapsed / iterations).toFixed(2)}us per layout`);
+
+native.stop();
+process.exit();
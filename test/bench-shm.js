@@ -0,0 +1,51 @@
+/*global process*/
+
+// Compares pushing client side pixels to the server through MIT-SHM
+// against plain put_image, for a bar sized and a full screen surface.
+// owm needs to be the window manager so run it on a spare display, e.g.
+//
+//   Xvfb :5 -screen 0 1920x1080x24 &
+//   node test/bench-shm.js :5 [frames]
+
+const native = require("../native");
+
+const display = process.argv[2] || process.env.DISPLAY;
+const frames = parseInt(process.argv[3] || "200", 10);
+
+const data = native.start(() => {}, display);
+const { wm, xcb, graphics } = data;
+const screen = data.screens.entries[0];
+
+function run(backend, width, height) {
+    const pixmap = xcb.create_pixmap(wm, { width: width, height: height });
+    const gc = xcb.create_gc(wm, { window: pixmap, values: { graphics_exposures: 0 } });
+    const surface = graphics.createImageSurface(wm, { width: width, height: height, backend: backend });
+    const ctx = graphics.createFromSurface(surface);
+    const actual = graphics.surfaceBackend(surface);
+
+    const start = process.hrtime.bigint();
+    for (let i = 0; i < frames; ++i) {
+        graphics.setSourceRGB(ctx, (i % 255) / 255, 0.5, 1 - ((i % 255) / 255));
+        graphics.paint(ctx);
+        graphics.putImageSurface(wm, surface, { drawable: pixmap, gc: gc });
+    }
+    // round trip so that every put has been processed
+    xcb.query_pointer(wm);
+    const elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+
+    const mb = (width * height * 4 * frames) / (1024 * 1024);
+    console.log(`${actual.padEnd(5)} ${`${width}x${height}`.padEnd(10)} ` +
+                `${(elapsed / frames).toFixed(3)} ms/frame ${(mb / (elapsed / 1000)).toFixed(1)} MB/s`);
+
+    graphics.destroySurface(surface);
+    xcb.free_gc(wm, gc);
+    xcb.free_pixmap(wm, pixmap);
+}
+
+for (const [width, height] of [[screen.width, 20], [screen.width, screen.height]]) {
+    run("image", width, height);
+    run("shm", width, height);
+}
+
+native.stop();
+process.exit();
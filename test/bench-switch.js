@@ -0,0 +1,96 @@
+/*global process*/
+
+// Switches between two workspaces worth of managed windows with both hide
+// strategies and prints how long each switch took until the server was done
+// with it, and how many events it caused. Meant to run under Xvfb:
+//
+//   Xvfb :5 -screen 0 1920x1080x24 &
+//   node test/bench-switch.js :5 [windows] [switches]
+
+const native = require("../native");
+
+const display = process.argv[2] || process.env.DISPLAY;
+const count = parseInt(process.argv[3] || "200", 10);
+const switches = parseInt(process.argv[4] || "50", 10);
+
+let events = 0;
+const data = native.start(() => { ++events; }, display);
+const { wm, xcb } = data;
+const screen = data.screens.entries[0];
+
+const entry = xcb.clientState.entry;
+const state = xcb.icccm.state;
+
+function makeClient(i) {
+    const x = (i * 37) % (screen.width - 400);
+    const y = (i * 23) % (screen.height - 300);
+    const window = xcb.create_window(wm, { x: x, y: y, width: 400, height: 300, parent: data.screens.root });
+    xcb.change_window_attributes(wm, { window: window, back_pixel: (i * 0x10101) & 0xffffff });
+    const frame = xcb.manage(wm, { window: window, x: x, y: y, width: 402, height: 302, border: 1 });
+    return { window: window, frame: frame, x: x, y: y };
+}
+
+function pack(entries, clients, visible) {
+    for (let i = 0; i < clients.length; ++i) {
+        const off = i * entry.Stride;
+        entries[off + entry.Window] = clients[i].window;
+        entries[off + entry.Frame] = clients[i].frame;
+        entries[off + entry.State] = visible ? state.NORMAL : state.ICONIC;
+        entries[off + entry.Flags] = 0;
+        entries[off + entry.X] = clients[i].x;
+        entries[off + entry.Y] = clients[i].y;
+    }
+}
+
+function wait(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+async function run() {
+    const workspaces = [ [], [] ];
+    for (let i = 0; i < count; ++i) {
+        workspaces[i % 2].push(makeClient(i));
+    }
+
+    const half = Math.ceil(count / 2);
+    const entries = new Int32Array(half * 2 * entry.Stride);
+
+    for (const [ name, strategy ] of [ [ "unmap", xcb.clientState.hide.Unmap ],
+                                       [ "offscreen", xcb.clientState.hide.Offscreen ] ]) {
+        // start out with the first workspace showing
+        pack(entries, workspaces[0], true);
+        xcb.set_states(wm, entries, strategy, workspaces[0].length);
+        pack(entries, workspaces[1], false);
+        xcb.set_states(wm, entries, strategy, workspaces[1].length);
+        xcb.query_pointer(wm);
+        await wait(100);
+        events = 0;
+
+        let total = 0, max = 0;
+        for (let i = 0; i < switches; ++i) {
+            const shown = workspaces[(i + 1) % 2];
+            const hidden = workspaces[i % 2];
+            pack(entries, hidden, false);
+            pack(entries.subarray(hidden.length * entry.Stride), shown, true);
+
+            const start = process.hrtime.bigint();
+            xcb.set_states(wm, entries, strategy, hidden.length + shown.length);
+            // a round trip, everything before it has been processed
+            xcb.query_pointer(wm);
+            const elapsed = Number(process.hrtime.bigint() - start) / 1000;
+            total += elapsed;
+            max = Math.max(max, elapsed);
+
+            // let the events come in
+            await wait(5);
+        }
+        console.log(`${name.padEnd(10)} ${switches} switches of ${count} windows, ` +
+                    `avg ${(total / switches).toFixed(0).padStart(6)}us ` +
+                    `max ${max.toFixed(0).padStart(6)}us events ${events}`);
+    }
+
+    native.stop();
+    process.exit();
+}
+
+run();